@@ -0,0 +1,313 @@
+/**
+ * @file    cache_snapshot.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+
+/**
+ * @brief Read only view of a whole file, mapped into memory
+ */
+class MappedFile {
+  public:
+    MappedFile() = default;
+    MappedFile(const MappedFile &) = delete;
+    MappedFile &operator=(const MappedFile &) = delete;
+    ~MappedFile() { close(); }
+
+    bool open(const std::string &path) {
+        close();
+#ifdef _WIN32
+        file_ = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ | FILE_SHARE_DELETE, nullptr, OPEN_EXISTING,
+                            FILE_ATTRIBUTE_NORMAL, nullptr);
+        LARGE_INTEGER size;
+        if (file_ == INVALID_HANDLE_VALUE || !GetFileSizeEx(file_, &size) || size.QuadPart == 0) {
+            close();
+            return false;
+        }
+        mapping_ = CreateFileMappingA(file_, nullptr, PAGE_READONLY, 0, 0, nullptr);
+        data_ = mapping_ ? static_cast<const char *>(MapViewOfFile(mapping_, FILE_MAP_READ, 0, 0, 0)) : nullptr;
+        size_ = static_cast<size_t>(size.QuadPart);
+#else
+        auto fd = ::open(path.c_str(), O_RDONLY);
+        struct stat info {};
+        if (fd < 0 || fstat(fd, &info) != 0 || info.st_size == 0) {
+            if (fd >= 0)
+                ::close(fd);
+            return false;
+        }
+        auto data = mmap(nullptr, info.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+        ::close(fd);
+        data_ = data == MAP_FAILED ? nullptr : static_cast<const char *>(data);
+        size_ = static_cast<size_t>(info.st_size);
+#endif
+        if (!data_) {
+            close();
+            return false;
+        }
+        return true;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (data_)
+            UnmapViewOfFile(data_);
+        if (mapping_)
+            CloseHandle(mapping_);
+        if (file_ != INVALID_HANDLE_VALUE)
+            CloseHandle(file_);
+        mapping_ = nullptr;
+        file_ = INVALID_HANDLE_VALUE;
+#else
+        if (data_)
+            munmap(const_cast<char *>(data_), size_);
+#endif
+        data_ = nullptr;
+        size_ = 0;
+    }
+
+    const char *data() const noexcept { return data_; }
+
+    size_t size() const noexcept { return size_; }
+
+  private:
+    const char *data_ = nullptr;
+    size_t size_ = 0;
+#ifdef _WIN32
+    HANDLE file_ = INVALID_HANDLE_VALUE;
+    HANDLE mapping_ = nullptr;
+#endif
+};
+
+
+/**
+ * @brief Resolved tracks exported from one machine's <TrackCache> to seed others.
+ *
+ * Laid out to be used straight from a memory map, nothing is parsed on import:
+ *   header:  "TRPCSNAP" version entrySize entryCount stringsSize checksum
+ *   entries: <Entry> sorted by key hash, so lookups are a binary search
+ *   strings: the text of all entries back to back
+ * Integers are little endian. The checksum covers entries and strings, it is checked once when
+ * the file is opened.
+ */
+class CacheSnapshot {
+  public:
+    static const uint32_t FORMAT_VERSION = 1;
+
+    /// @brief One track, as it is passed in and out
+    struct Track {
+        std::string title, artist, album, coverId, quality;
+        unsigned id;
+        int64_t runtime;
+        uint8_t trackNumber, volumeNumber;
+        int64_t resolvedAt;
+    };
+
+    /**
+     * @brief Writes <tracks> as a snapshot to <path>
+     * @return false if it could not be written, or the strings don't fit 32 bit offsets
+     */
+    static bool write(const std::string &path, const std::vector<Track> &tracks) {
+        std::vector<Entry> entries;
+        entries.reserve(tracks.size());
+        std::string strings;
+
+        for (auto &track : tracks) {
+            Entry entry{};
+            entry.keyHash = hash(track.title, track.artist);
+            entry.resolvedAt = track.resolvedAt;
+            entry.id = track.id;
+            entry.runtime = static_cast<uint32_t>(track.runtime);
+            entry.trackNumber = track.trackNumber;
+            entry.volumeNumber = track.volumeNumber;
+
+            const std::string *fields[FIELDS] = {&track.title, &track.artist, &track.album, &track.coverId,
+                                                 &track.quality};
+            for (int i = 0; i < FIELDS; i++) {
+                auto size = std::min<size_t>(fields[i]->size(), UINT16_MAX);
+                if (strings.size() + size > UINT32_MAX)
+                    return false;
+                entry.offset[i] = static_cast<uint32_t>(strings.size());
+                entry.length[i] = static_cast<uint16_t>(size);
+                strings.append(*fields[i], 0, size);
+            }
+            entries.push_back(entry);
+        }
+        std::sort(entries.begin(), entries.end(),
+                  [](const Entry &a, const Entry &b) { return a.keyHash < b.keyHash; });
+
+        Header header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = FORMAT_VERSION;
+        header.entrySize = sizeof(Entry);
+        header.entryCount = entries.size();
+        header.stringsSize = strings.size();
+        header.checksum = checksum(strings.data(), strings.size(),
+                                   checksum(entries.data(), entries.size() * sizeof(Entry), CHECKSUM_SEED));
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(entries.data()), entries.size() * sizeof(Entry));
+        out.write(strings.data(), strings.size());
+        out.flush();
+        return static_cast<bool>(out);
+    }
+
+    /**
+     * @return false with the reason in <error> if <path> isn't a valid snapshot
+     */
+    bool open(const std::string &path, std::string &error) {
+        close();
+        if (!file_.open(path)) {
+            error = "can't be read";
+            return false;
+        }
+
+        Header header;
+        if (file_.size() < sizeof(header)) {
+            error = "too short";
+        } else if (memcpy(&header, file_.data(), sizeof(header)), memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+            error = "not a snapshot";
+        } else if (header.version != FORMAT_VERSION || header.entrySize != sizeof(Entry)) {
+            error = "unsupported version " + std::to_string(header.version);
+        } else if (header.entryCount > (file_.size() - sizeof(header)) / sizeof(Entry)
+                   || file_.size() != sizeof(header) + header.entryCount * sizeof(Entry) + header.stringsSize) {
+            error = "truncated";
+        } else {
+            entries_ = reinterpret_cast<const Entry *>(file_.data() + sizeof(header));
+            count_ = header.entryCount;
+            strings_ = file_.data() + sizeof(header) + count_ * sizeof(Entry);
+            stringsSize_ = header.stringsSize;
+
+            if (checksum(strings_, stringsSize_, checksum(entries_, count_ * sizeof(Entry), CHECKSUM_SEED))
+                == header.checksum)
+                return true;
+            error = "checksum mismatch";
+        }
+
+        close();
+        return false;
+    }
+
+    void close() {
+        file_.close();
+        entries_ = nullptr;
+        count_ = 0;
+    }
+
+    bool isOpen() const noexcept { return entries_ != nullptr; }
+
+    size_t size() const noexcept { return count_; }
+
+    bool find(const std::string &title, const std::string &artist, Track &track) const {
+        auto keyHash = hash(title, artist);
+        auto it = std::lower_bound(entries_, entries_ + count_, keyHash,
+                                   [](const Entry &entry, uint64_t keyHash) { return entry.keyHash < keyHash; });
+        for (; it != entries_ + count_ && it->keyHash == keyHash; ++it) {
+            if (field(*it, 0) == title && field(*it, 1) == artist) {
+                decode(*it, track);
+                return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief Track at <index>, in key hash order
+    void at(size_t index, Track &track) const { decode(entries_[index], track); }
+
+  private:
+    static constexpr char MAGIC[8] = {'T', 'R', 'P', 'C', 'S', 'N', 'A', 'P'};
+    static const int FIELDS = 5;  ///< title, artist, album, coverId, quality
+    static const uint64_t CHECKSUM_SEED = 0xcbf29ce484222325u;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t entrySize;
+        uint64_t entryCount;
+        uint64_t stringsSize;
+        uint64_t checksum;
+    };
+
+    struct Entry {
+        uint64_t keyHash;
+        int64_t resolvedAt;
+        uint32_t offset[FIELDS];
+        uint32_t id;
+        uint32_t runtime;
+        uint16_t length[FIELDS];
+        uint8_t trackNumber;
+        uint8_t volumeNumber;
+    };
+    static_assert(sizeof(Header) == 40 && sizeof(Entry) == 56, "snapshot layout has no padding");
+
+    /// @brief FNV-1a of title, a unit separator and artist
+    static uint64_t hash(const std::string &title, const std::string &artist) {
+        uint64_t hash = 0xcbf29ce484222325u;
+        auto mix = [&hash](unsigned char c) { hash = (hash ^ c) * 0x100000001b3u; };
+        for (unsigned char c : title)
+            mix(c);
+        mix(0x1f);
+        for (unsigned char c : artist)
+            mix(c);
+        return hash;
+    }
+
+    /// @brief FNV-1a style, but over 8 byte words so checking a large snapshot stays cheap
+    static uint64_t checksum(const void *data, size_t size, uint64_t hash) {
+        auto bytes = static_cast<const char *>(data);
+        for (; size >= 8; bytes += 8, size -= 8) {
+            uint64_t word;
+            memcpy(&word, bytes, 8);
+            hash = (hash ^ word) * 0x100000001b3u;
+            hash ^= hash >> 29u;
+        }
+        uint64_t tail = 0;
+        memcpy(&tail, bytes, size);
+        return ((hash ^ tail) * 0x100000001b3u) ^ size;
+    }
+
+    std::string field(const Entry &entry, int i) const {
+        if (static_cast<uint64_t>(entry.offset[i]) + entry.length[i] > stringsSize_)
+            return {};
+        return std::string(strings_ + entry.offset[i], entry.length[i]);
+    }
+
+    void decode(const Entry &entry, Track &track) const {
+        track.title = field(entry, 0);
+        track.artist = field(entry, 1);
+        track.album = field(entry, 2);
+        track.coverId = field(entry, 3);
+        track.quality = field(entry, 4);
+        track.id = entry.id;
+        track.runtime = entry.runtime;
+        track.trackNumber = entry.trackNumber;
+        track.volumeNumber = entry.volumeNumber;
+        track.resolvedAt = entry.resolvedAt;
+    }
+
+    MappedFile file_;
+    const Entry *entries_ = nullptr;
+    size_t count_ = 0;
+    const char *strings_ = nullptr;
+    uint64_t stringsSize_ = 0;
+};
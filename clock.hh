@@ -0,0 +1,109 @@
+/**
+ * @file    clock.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <chrono>
+#include <cstdint>
+#include <ctime>
+#include <thread>
+
+
+/**
+ * @brief Time source and sleep of the rpc loop.
+ * Everything the loop does with time goes through here, so it can run on a <VirtualClock>.
+ */
+class Clock {
+  public:
+    using duration = std::chrono::milliseconds;
+    using time_point = std::chrono::steady_clock::time_point;
+
+    virtual ~Clock() = default;
+
+    /// @brief Monotonic time, for measuring
+    virtual time_point now() const = 0;
+
+    /// @brief Wall clock in seconds since the epoch, for timestamps shown to others
+    virtual int64_t unixTime() const = 0;
+
+    virtual void sleepFor(duration timeout) = 0;
+};
+
+
+class SystemClock : public Clock {
+  public:
+    time_point now() const override { return std::chrono::steady_clock::now(); }
+
+    int64_t unixTime() const override { return static_cast<int64_t>(std::time(nullptr)); }
+
+    void sleepFor(duration timeout) override { std::this_thread::sleep_for(timeout); }
+};
+
+
+/**
+ * @brief Real time running <speed> times faster, starting at <unixStart>
+ */
+class ScaledClock : public Clock {
+  public:
+    ScaledClock(double speed, int64_t unixStart)
+        : speed_(speed), unixStart_(unixStart), realStart_(std::chrono::steady_clock::now()) {}
+
+    time_point now() const override {
+        auto elapsed = std::chrono::duration<double, std::milli>(std::chrono::steady_clock::now() - realStart_);
+        return realStart_ + std::chrono::duration_cast<duration>(elapsed * speed_);
+    }
+
+    int64_t unixTime() const override {
+        return unixStart_ + std::chrono::duration_cast<std::chrono::seconds>(now() - realStart_).count();
+    }
+
+    void sleepFor(duration timeout) override {
+        std::this_thread::sleep_for(std::chrono::duration<double, std::milli>(timeout.count() / speed_));
+    }
+
+  private:
+    double speed_;
+    int64_t unixStart_;
+    time_point realStart_;
+};
+
+
+/**
+ * @brief Clock that only advances when slept on (or when told to), so hours of the loop run in
+ * milliseconds. Not thread safe, meant to be driven from the loop's thread.
+ */
+class VirtualClock : public Clock {
+  public:
+    explicit VirtualClock(int64_t unixStart = 1600000000) : unixStart_(unixStart) {}
+
+    time_point now() const override { return now_; }
+
+    int64_t unixTime() const override {
+        return unixStart_ + std::chrono::duration_cast<std::chrono::seconds>(now_ - time_point{}).count();
+    }
+
+    void sleepFor(duration timeout) override {
+        if (timeout.count() > 0) {
+            now_ += timeout;
+            slept_ += timeout;
+        }
+        sleeps_++;
+    }
+
+    void advance(duration by) { now_ += by; }
+
+    /// @brief Number of <sleepFor> calls, i.e. loop wake-ups
+    uint64_t sleepCount() const noexcept { return sleeps_; }
+
+    duration totalSlept() const noexcept { return slept_; }
+
+  private:
+    int64_t unixStart_;
+    time_point now_{};
+    uint64_t sleeps_ = 0;
+    duration slept_{0};
+};
@@ -0,0 +1,577 @@
+/**
+ * @file    discord_ipc.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// local libs
+#include "json.hh"
+#include "logger.hh"
+
+#ifdef _WIN32
+#include <windows.h>
+#else
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include <poll.h>
+#include <unistd.h>
+#endif
+
+
+/*
+ * Discord's local rpc protocol, what the game SDK speaks under the hood. Every client (stable, PTB,
+ * canary) listens on the first free one of discord-ipc-0..9, a unix socket or a windows named pipe.
+ * Frames are: opcode (u32 little endian), payload length (u32 little endian), json payload.
+ */
+namespace discord_ipc {
+
+enum Opcode : uint32_t { handshake = 0, frame = 1, close = 2, ping = 3, pong = 4 };
+
+static const int MAX_PIPES = 10;
+/// discord drops bigger frames anyway
+static const uint32_t MAX_FRAME = 64u * 1024u;
+/// bounds a write to or read from a client that stopped responding
+static const int IO_TIMEOUT_MS = 1000;
+
+/**
+ * @brief Where the client with <index> may listen, including flatpak and snap sandboxes
+ */
+inline std::vector<std::string> pipePaths(int index) {
+    auto name = "discord-ipc-" + std::to_string(index);
+#ifdef _WIN32
+    return {"\\\\?\\pipe\\" + name};
+#else
+    std::string dir = "/tmp";
+    for (auto var : {"XDG_RUNTIME_DIR", "TMPDIR", "TMP", "TEMP"}) {
+        if (auto value = std::getenv(var)) {
+            dir = value;
+            break;
+        }
+    }
+    return {dir + "/" + name, dir + "/app/com.discordapp.Discord/" + name, dir + "/snap.discord/" + name};
+#endif
+}
+
+
+/**
+ * @brief Blocking connection to one client's pipe, every read and write bounded by IO_TIMEOUT_MS
+ */
+class Pipe {
+  public:
+    Pipe() = default;
+    Pipe(const Pipe &) = delete;
+    Pipe &operator=(const Pipe &) = delete;
+    ~Pipe() { close(); }
+
+    bool open(int index) {
+        close();
+        for (auto &path : pipePaths(index)) {
+#ifdef _WIN32
+            // overlapped, so every read and write can be given up on after IO_TIMEOUT_MS
+            handle_ = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, nullptr, OPEN_EXISTING,
+                                  FILE_FLAG_OVERLAPPED, nullptr);
+            if (handle_ == INVALID_HANDLE_VALUE)
+                continue;
+            event_ = CreateEventA(nullptr, TRUE, FALSE, nullptr);
+            if (event_)
+                return true;
+            close();
+#else
+            sockaddr_un addr{};
+            if (path.size() >= sizeof(addr.sun_path))
+                continue;
+            addr.sun_family = AF_UNIX;
+            strcpy(addr.sun_path, path.c_str());
+
+            fd_ = socket(AF_UNIX, SOCK_STREAM, 0);
+            if (fd_ < 0)
+                return false;
+            timeval timeout{IO_TIMEOUT_MS / 1000, (IO_TIMEOUT_MS % 1000) * 1000};
+            setsockopt(fd_, SOL_SOCKET, SO_SNDTIMEO, &timeout, sizeof(timeout));
+            setsockopt(fd_, SOL_SOCKET, SO_RCVTIMEO, &timeout, sizeof(timeout));
+#ifdef SO_NOSIGPIPE
+            int one = 1;
+            setsockopt(fd_, SOL_SOCKET, SO_NOSIGPIPE, &one, sizeof(one));
+#endif
+            if (::connect(fd_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) == 0)
+                return true;
+            close();
+#endif
+        }
+        return false;
+    }
+
+    void close() {
+#ifdef _WIN32
+        if (handle_ != INVALID_HANDLE_VALUE)
+            CloseHandle(handle_);
+        handle_ = INVALID_HANDLE_VALUE;
+        if (event_)
+            CloseHandle(event_);
+        event_ = nullptr;
+#else
+        if (fd_ >= 0)
+            ::close(fd_);
+        fd_ = -1;
+#endif
+        isBroken_ = false;
+    }
+
+    bool write(Opcode opcode, const std::string &payload) {
+        char header[8];
+        putU32(header, opcode);
+        putU32(header + 4, static_cast<uint32_t>(payload.size()));
+        return writeAll(header, sizeof(header)) && writeAll(payload.data(), payload.size());
+    }
+
+    /**
+     * @return 1 with a frame in <opcode> and <payload>, 0 if none started within <timeout>,
+     *         -1 once the pipe is broken
+     */
+    int read(uint32_t &opcode, std::string &payload, std::chrono::milliseconds timeout) {
+        if (!isReadable(timeout))
+            return isBroken_ ? -1 : 0;
+
+        char header[8];
+        if (!readAll(header, sizeof(header)))
+            return -1;
+        opcode = getU32(header);
+        auto size = getU32(header + 4);
+        if (size > MAX_FRAME)
+            return -1;
+
+        payload.resize(size);
+        return readAll(&payload[0], size) ? 1 : -1;
+    }
+
+  private:
+    static void putU32(char *out, uint32_t value) {
+        for (int i = 0; i < 4; i++)
+            out[i] = static_cast<char>(value >> (8 * i));
+    }
+
+    static uint32_t getU32(const char *in) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+        return value;
+    }
+
+#ifdef _WIN32
+    bool isReadable(std::chrono::milliseconds timeout) {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        for (;;) {
+            DWORD available = 0;
+            if (!PeekNamedPipe(handle_, nullptr, 0, nullptr, &available, nullptr)) {
+                isBroken_ = true;
+                return false;
+            }
+            if (available)
+                return true;
+            if (std::chrono::steady_clock::now() >= deadline)
+                return false;
+            Sleep(1);
+        }
+    }
+
+    bool writeAll(const char *data, size_t size) {
+        while (size) {
+            DWORD sent;
+            if (!transfer(true, const_cast<char *>(data), static_cast<DWORD>(size), sent))
+                return false;
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    bool readAll(char *data, size_t size) {
+        while (size) {
+            DWORD got;
+            if (!transfer(false, data, static_cast<DWORD>(size), got))
+                return false;
+            data += got;
+            size -= got;
+        }
+        return true;
+    }
+
+    /**
+     * @brief One overlapped ReadFile or WriteFile, cancelled if it isn't done within IO_TIMEOUT_MS
+     * @return false on errors, timeouts and end of file
+     */
+    bool transfer(bool isWrite, char *data, DWORD size, DWORD &done) {
+        OVERLAPPED overlapped{};
+        overlapped.hEvent = event_;
+        auto isStarted = isWrite ? WriteFile(handle_, data, size, nullptr, &overlapped)
+                                 : ReadFile(handle_, data, size, nullptr, &overlapped);
+        if (!isStarted && GetLastError() != ERROR_IO_PENDING)
+            return false;
+
+        if (WaitForSingleObject(event_, IO_TIMEOUT_MS) != WAIT_OBJECT_0) {
+            CancelIo(handle_);
+            // <data> and <overlapped> are in use until the cancelled operation is through
+            GetOverlappedResult(handle_, &overlapped, &done, TRUE);
+            return false;
+        }
+        return GetOverlappedResult(handle_, &overlapped, &done, FALSE) && done > 0;
+    }
+
+    HANDLE handle_ = INVALID_HANDLE_VALUE;
+    HANDLE event_ = nullptr;  ///< signalled when an overlapped operation completes
+#else
+    bool isReadable(std::chrono::milliseconds timeout) {
+        pollfd pfd{fd_, POLLIN, 0};
+        auto ready = poll(&pfd, 1, static_cast<int>(timeout.count()));
+        if (ready < 0 || (ready && !(pfd.revents & POLLIN))) {
+            isBroken_ = true;
+            return false;
+        }
+        return ready > 0;
+    }
+
+    bool writeAll(const char *data, size_t size) {
+#ifdef MSG_NOSIGNAL
+        const int flags = MSG_NOSIGNAL;
+#else
+        const int flags = 0;
+#endif
+        while (size) {
+            auto sent = send(fd_, data, size, flags);
+            if (sent <= 0)
+                return false;
+            data += sent;
+            size -= sent;
+        }
+        return true;
+    }
+
+    bool readAll(char *data, size_t size) {
+        while (size) {
+            auto got = recv(fd_, data, size, 0);
+            if (got <= 0)
+                return false;
+            data += got;
+            size -= got;
+        }
+        return true;
+    }
+
+    int fd_ = -1;
+#endif
+    bool isBroken_ = false;
+};
+
+}  // namespace discord_ipc
+
+
+/**
+ * @brief Keeps the presence of the client on one pipe up to date, from a thread of its own.
+ *
+ * Connects (and reconnects) every <RECONNECT_INTERVAL>, only the latest activity is ever sent, and
+ * it is sent again after a reconnect. Replies are read every <ACTIVE_INTERVAL> while some are
+ * outstanding, so their latency can be measured.
+ */
+class DiscordIpcConnection {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds RECONNECT_INTERVAL{5000};
+    static constexpr std::chrono::milliseconds HANDSHAKE_TIMEOUT{3000};
+    static constexpr std::chrono::milliseconds ACK_TIMEOUT{10000};
+    static constexpr std::chrono::milliseconds ACTIVE_INTERVAL{16};
+    static constexpr std::chrono::milliseconds IDLE_INTERVAL{1000};
+    /// how long a stopping connection waits for the reply to its last update
+    static constexpr std::chrono::milliseconds STOP_TIMEOUT{500};
+
+    struct Metrics {
+        int index = 0;
+        bool isReady = false;
+        uint64_t connects = 0;
+        uint64_t sent = 0;
+        uint64_t acknowledged = 0;
+        uint64_t failed = 0;  ///< error replies and replies that never came
+        uint64_t lastAckMs = 0;
+        uint64_t maxAckMs = 0;
+    };
+
+    DiscordIpcConnection(int index, std::string clientId) : index_(index), clientId_(std::move(clientId)) {
+        metrics_.index = index;
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    DiscordIpcConnection(const DiscordIpcConnection &) = delete;
+    DiscordIpcConnection &operator=(const DiscordIpcConnection &) = delete;
+
+    /// @brief Sends what is pending, then closes the pipe
+    ~DiscordIpcConnection() {
+        stop();
+        thread_.join();
+    }
+
+    /**
+     * @param activity Activity object as json, "null" clears the presence
+     */
+    void send(std::shared_ptr<const std::string> activity) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            activity_ = std::move(activity);
+        }
+        wake_.notify_one();
+    }
+
+    /// @brief Asks the thread to finish, without waiting for it
+    void stop() {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            isStopping_ = true;
+        }
+        wake_.notify_one();
+    }
+
+    bool isReady() const noexcept { return isReady_; }
+
+    Metrics metrics() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto metrics = metrics_;
+        metrics.isReady = isReady_;
+        return metrics;
+    }
+
+  private:
+    void run() {
+        auto nextConnect = clock::now();
+        for (;;) {
+            std::shared_ptr<const std::string> activity;
+            bool isStopping;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                auto deadline = !isReady_ ? nextConnect
+                                          : clock::now() + (inFlight_.empty() ? IDLE_INTERVAL : ACTIVE_INTERVAL);
+                wake_.wait_until(lock, deadline, [this]() { return isStopping_ || (isReady_ && activity_ != sent_); });
+                isStopping = isStopping_;
+                if (isReady_ && activity_ != sent_)
+                    activity = sent_ = activity_;
+            }
+
+            if (!isReady_) {
+                if (isStopping)
+                    return;
+                if (clock::now() >= nextConnect && !connect())
+                    nextConnect = clock::now() + RECONNECT_INTERVAL;
+                continue;
+            }
+
+            if ((activity && !setActivity(*activity)) || !receive(std::chrono::milliseconds(0))) {
+                disconnect();
+                continue;
+            }
+
+            if (isStopping) {
+                auto deadline = clock::now() + STOP_TIMEOUT;
+                while (!inFlight_.empty() && clock::now() < deadline && receive(ACTIVE_INTERVAL)) {}
+                pipe_.write(discord_ipc::close, "{}");
+                disconnect();
+                return;
+            }
+        }
+    }
+
+    bool connect() {
+        if (!pipe_.open(index_))
+            return false;
+
+        uint32_t opcode;
+        std::string reply;
+        if (pipe_.write(discord_ipc::handshake, R"({"v":1,"client_id":")" + clientId_ + "\"}")
+            && pipe_.read(opcode, reply, HANDSHAKE_TIMEOUT) == 1 && opcode == discord_ipc::frame
+            && reply.find(R"("READY")") != std::string::npos) {
+            std::lock_guard<std::mutex> lock(mutex_);
+            isReady_ = true;
+            sent_ = nullptr;
+            metrics_.connects++;
+            LOG_INFO("Connected to discord-ipc-", index_);
+            return true;
+        }
+
+        pipe_.close();
+        return false;
+    }
+
+    void disconnect() {
+        pipe_.close();
+        inFlight_.clear();
+        if (isReady_)
+            LOG_INFO("Disconnected from discord-ipc-", index_);
+        std::lock_guard<std::mutex> lock(mutex_);
+        isReady_ = false;
+    }
+
+    bool setActivity(const std::string &activity) {
+        auto nonce = ++nonce_;
+        auto payload = R"({"cmd":"SET_ACTIVITY","args":{"pid":)" + std::to_string(pid()) + R"(,"activity":)"
+                       + activity + R"(},"nonce":")" + std::to_string(nonce) + "\"}";
+        if (!pipe_.write(discord_ipc::frame, payload))
+            return false;
+
+        inFlight_[nonce] = clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        metrics_.sent++;
+        return true;
+    }
+
+    /**
+     * @brief Handles whatever the client sent
+     * @return false once the connection is gone
+     */
+    bool receive(std::chrono::milliseconds timeout) {
+        uint32_t opcode;
+        std::string payload;
+        int result;
+        while ((result = pipe_.read(opcode, payload, timeout)) == 1) {
+            timeout = std::chrono::milliseconds(0);
+            if (opcode == discord_ipc::close)
+                return false;
+            if (opcode == discord_ipc::ping && !pipe_.write(discord_ipc::pong, payload))
+                return false;
+            if (opcode == discord_ipc::frame)
+                acknowledge(payload);
+        }
+
+        auto now = clock::now();
+        for (auto it = inFlight_.begin(); it != inFlight_.end();) {
+            if (now - it->second < ACK_TIMEOUT) {
+                ++it;
+                continue;
+            }
+            it = inFlight_.erase(it);
+            std::lock_guard<std::mutex> lock(mutex_);
+            metrics_.failed++;
+        }
+        return result == 0;
+    }
+
+    void acknowledge(const std::string &payload) {
+        auto reply = nlohmann::json::parse(payload, nullptr, false);
+        if (!reply.is_object() || !reply["nonce"].is_string())
+            return;
+
+        auto it = inFlight_.find(std::strtoull(reply["nonce"].get<std::string>().c_str(), nullptr, 10));
+        if (it == inFlight_.end())
+            return;
+        auto latency = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - it->second);
+        inFlight_.erase(it);
+
+        auto isError = reply["evt"].is_string() && reply["evt"].get<std::string>() == "ERROR";
+        if (isError)
+            LOG_WARNING("discord-ipc-", index_, " refused the activity: ", payload);
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (isError) {
+            metrics_.failed++;
+        } else {
+            metrics_.acknowledged++;
+            metrics_.lastAckMs = latency.count();
+            metrics_.maxAckMs = std::max<uint64_t>(metrics_.maxAckMs, latency.count());
+        }
+    }
+
+    static unsigned long pid() {
+#ifdef _WIN32
+        return GetCurrentProcessId();
+#else
+        return static_cast<unsigned long>(getpid());
+#endif
+    }
+
+    const int index_;
+    const std::string clientId_;
+
+    // connection thread only
+    discord_ipc::Pipe pipe_;
+    std::map<uint64_t, clock::time_point> inFlight_;
+    uint64_t nonce_ = 0;
+
+    mutable std::mutex mutex_;
+    std::condition_variable wake_;
+    std::shared_ptr<const std::string> activity_;
+    std::shared_ptr<const std::string> sent_;
+    std::atomic<bool> isReady_{false};
+    bool isStopping_ = false;
+    Metrics metrics_;
+    std::thread thread_;
+};
+
+
+/**
+ * @brief Presence on every discord client running at once (stable, PTB, canary, other accounts),
+ * one <DiscordIpcConnection> per pipe, so a slow or dead client never holds up the others
+ */
+class DiscordIpcFanout {
+  public:
+    explicit DiscordIpcFanout(const std::string &clientId, int pipes = discord_ipc::MAX_PIPES) {
+        for (int i = 0; i < pipes; i++)
+            connections_.emplace_back(new DiscordIpcConnection(i, clientId));
+    }
+
+    /// @brief Clears the presence everywhere, the connections stop side by side
+    ~DiscordIpcFanout() {
+        send("null");
+        for (auto &connection : connections_)
+            connection->stop();
+    }
+
+    /**
+     * @param activity Activity object as json, "null" clears the presence
+     */
+    void send(std::string activity) {
+        auto shared = std::make_shared<const std::string>(std::move(activity));
+        for (auto &connection : connections_)
+            connection->send(shared);
+    }
+
+    size_t readyCount() const {
+        return std::count_if(connections_.begin(), connections_.end(),
+                             [](const std::unique_ptr<DiscordIpcConnection> &connection) { return connection->isReady(); });
+    }
+
+    /**
+     * @return false if no client finished the handshake within <timeout>
+     */
+    bool waitReady(std::chrono::milliseconds timeout) const {
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+        while (!readyCount()) {
+            if (std::chrono::steady_clock::now() >= deadline)
+                return false;
+            std::this_thread::sleep_for(std::chrono::milliseconds(10));
+        }
+        return true;
+    }
+
+    std::vector<DiscordIpcConnection::Metrics> metrics() const {
+        std::vector<DiscordIpcConnection::Metrics> metrics;
+        for (auto &connection : connections_)
+            metrics.push_back(connection->metrics());
+        return metrics;
+    }
+
+  private:
+    std::vector<std::unique_ptr<DiscordIpcConnection>> connections_;
+};
@@ -0,0 +1,269 @@
+/**
+ * @file    discord_pump.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <deque>
+#include <functional>
+#include <future>
+#include <map>
+#include <memory>
+#include <mutex>
+#include <thread>
+// local libs
+#include "discord_game_sdk.h"
+#include "logger.hh"
+
+
+/**
+ * @brief Owns the thread every discord SDK call happens on.
+ *
+ * The SDK is pumped (run_callbacks) every <ACTIVE_INTERVAL> while an update waits for its
+ * acknowledgement or a retry is due, and only every <IDLE_INTERVAL> otherwise. Updates are sent
+ * with a completion callback, so ack latency and result codes end up in <Metrics>. A failed or
+ * unacknowledged update is retried with exponential backoff, unless a newer one superseded it.
+ */
+class DiscordPump {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    static constexpr std::chrono::milliseconds ACTIVE_INTERVAL{16};
+    static constexpr std::chrono::milliseconds IDLE_INTERVAL{1000};
+    static constexpr std::chrono::milliseconds ACK_TIMEOUT{10000};
+    static constexpr std::chrono::milliseconds RETRY_BACKOFF{500};
+    static constexpr std::chrono::milliseconds MAX_RETRY_BACKOFF{30000};
+    static constexpr int MAX_ATTEMPTS = 6;
+
+    struct Metrics {
+        uint64_t sent = 0;          ///< update_activity calls, retries included
+        uint64_t acknowledged = 0;  ///< completions with DiscordResult_Ok
+        uint64_t failed = 0;        ///< completions with an error
+        uint64_t timedOut = 0;      ///< no completion within ACK_TIMEOUT
+        uint64_t retried = 0;
+        uint64_t superseded = 0;    ///< replaced by a newer update before being sent or retried
+        uint64_t lastAckMs = 0;
+        uint64_t maxAckMs = 0;
+        uint64_t totalAckMs = 0;    ///< over all acknowledged updates
+        int lastResult = DiscordResult_Ok;
+    };
+
+    static DiscordPump &instance() {
+        // never destroyed, like the detached threads that use it
+        static auto pump = new DiscordPump();
+        return *pump;
+    }
+
+    /**
+     * @brief Runs <work> on the pump thread and waits for its result
+     */
+    template<typename F>
+    auto call(F work) -> decltype(work()) {
+        using Result = decltype(work());
+        auto task = std::make_shared<std::packaged_task<Result()>>(std::move(work));
+        auto result = task->get_future();
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            work_.emplace_back([task]() { (*task)(); });
+        }
+        wake_.notify_one();
+        return result.get();
+    }
+
+    /**
+     * @brief Sets the core to pump and send through, nullptr once it is destroyed.
+     * Updates of the previous core are forgotten. Pump thread only, i.e. from within <call>.
+     */
+    void setCore(IDiscordCore *core) {
+        core_ = core;
+        std::lock_guard<std::mutex> lock(mutex_);
+        inFlight_.clear();
+        hasPending_ = false;
+        isRetryDue_ = false;
+        attempt_ = 0;
+    }
+
+    /**
+     * @brief Sends <activity> from the pump thread, replacing whatever wasn't sent yet
+     */
+    void update(const DiscordActivity &activity) {
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (hasPending_ || isRetryDue_)
+                metrics_.superseded++;
+            latest_ = activity;
+            latestId_++;
+            hasPending_ = true;
+            isRetryDue_ = false;
+            attempt_ = 0;
+        }
+        wake_.notify_one();
+    }
+
+    Metrics metrics() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return metrics_;
+    }
+
+  private:
+    /// @brief One update_activity call waiting for its completion
+    struct Ticket {
+        uint64_t id;  ///< of the update
+        clock::time_point sentAt;
+    };
+
+    DiscordPump() {
+        std::thread([this]() { run(); }).detach();
+    }
+
+    void run() {
+        for (;;) {
+            std::deque<std::function<void()>> work;
+            {
+                std::unique_lock<std::mutex> lock(mutex_);
+                // without a core nothing can be sent, a pending update waits for one
+                wake_.wait_for(lock, interval(), [this]() { return !work_.empty() || (hasPending_ && core_); });
+                work.swap(work_);
+            }
+
+            for (auto &task : work)
+                task();
+
+            if (!core_)
+                continue;
+
+            send();
+            auto result = core_->run_callbacks(core_);
+            if (result != DiscordResult_Ok)
+                LOG_WARNING("Bad result ", static_cast<int>(result));
+            expire();
+        }
+    }
+
+    /// @brief How long the pump may sleep, called with <mutex_> held
+    std::chrono::milliseconds interval() const {
+        if (!core_)
+            return IDLE_INTERVAL;
+        if (!inFlight_.empty())
+            return ACTIVE_INTERVAL;
+        if (isRetryDue_) {
+            auto untilRetry = std::chrono::duration_cast<std::chrono::milliseconds>(retryAt_ - clock::now());
+            return std::max(std::min(untilRetry, IDLE_INTERVAL), std::chrono::milliseconds(0));
+        }
+        return IDLE_INTERVAL;
+    }
+
+    /// @brief Sends the latest activity if it is new or its retry is due
+    void send() {
+        DiscordActivity activity;
+        // the callback data is a ticket number, not a pointer: a late completion of a ticket that
+        // expired or belonged to an earlier core is looked up, not dereferenced
+        uint64_t number;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto isRetry = isRetryDue_ && clock::now() >= retryAt_;
+            if (!hasPending_ && !isRetry)
+                return;
+            if (isRetry)
+                metrics_.retried++;
+
+            activity = latest_;
+            hasPending_ = false;
+            isRetryDue_ = false;
+            metrics_.sent++;
+
+            number = ++lastTicket_;
+            inFlight_[number] = Ticket{latestId_, clock::now()};
+        }
+
+        auto manager = core_->get_activity_manager(core_);
+        manager->update_activity(manager, &activity, reinterpret_cast<void *>(static_cast<uintptr_t>(number)),
+                                 [](void *data, EDiscordResult result) {
+                                     instance().completed(reinterpret_cast<uintptr_t>(data), result);
+                                 });
+    }
+
+    void completed(uint64_t number, EDiscordResult result) {
+        std::chrono::milliseconds latency;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto it = inFlight_.find(number);
+            if (it == inFlight_.end())
+                return;
+            auto ticket = it->second;
+            inFlight_.erase(it);
+
+            latency = std::chrono::duration_cast<std::chrono::milliseconds>(clock::now() - ticket.sentAt);
+            metrics_.lastResult = result;
+            if (result == DiscordResult_Ok) {
+                metrics_.acknowledged++;
+                metrics_.lastAckMs = latency.count();
+                metrics_.maxAckMs = std::max<uint64_t>(metrics_.maxAckMs, latency.count());
+                metrics_.totalAckMs += latency.count();
+                if (ticket.id == latestId_)
+                    attempt_ = 0;
+            } else {
+                metrics_.failed++;
+                scheduleRetry(ticket.id);
+            }
+        }
+
+        if (result == DiscordResult_Ok)
+            LOG_DEBUG("Presence acknowledged after ", latency.count(), " ms");
+        else
+            LOG_WARNING("Presence update failed with ", static_cast<int>(result));
+    }
+
+    /// @brief Gives up waiting on updates that were never acknowledged
+    void expire() {
+        auto now = clock::now();
+        std::lock_guard<std::mutex> lock(mutex_);
+        for (auto it = inFlight_.begin(); it != inFlight_.end();) {
+            if (now - it->second.sentAt < ACK_TIMEOUT) {
+                ++it;
+                continue;
+            }
+            metrics_.timedOut++;
+            scheduleRetry(it->second.id);
+            LOG_WARNING("Presence update not acknowledged within ", ACK_TIMEOUT.count(), " ms");
+            it = inFlight_.erase(it);
+        }
+    }
+
+    /// @brief Called with <mutex_> held
+    void scheduleRetry(uint64_t id) {
+        if (id != latestId_ || hasPending_) {
+            metrics_.superseded++;
+            return;
+        }
+        if (++attempt_ >= MAX_ATTEMPTS)
+            return;
+
+        auto backoff = std::min(RETRY_BACKOFF * (1 << (attempt_ - 1)), MAX_RETRY_BACKOFF);
+        retryAt_ = clock::now() + backoff;
+        isRetryDue_ = true;
+    }
+
+    // pump thread only
+    IDiscordCore *core_ = nullptr;
+
+    mutable std::mutex mutex_;
+    std::map<uint64_t, Ticket> inFlight_;  ///< by ticket number
+    uint64_t lastTicket_ = 0;
+    std::condition_variable wake_;
+    std::deque<std::function<void()>> work_;
+    DiscordActivity latest_{};
+    uint64_t latestId_ = 0;
+    bool hasPending_ = false;
+    bool isRetryDue_ = false;
+    clock::time_point retryAt_;
+    int attempt_ = 0;
+    Metrics metrics_;
+};
@@ -49,6 +49,8 @@ typedef SOCKET socket_t;
 #include <cstring>
 #include <netdb.h>
 #include <netinet/in.h>
+#include <netinet/tcp.h>
+#include <poll.h>
 #include <pthread.h>
 #include <signal.h>
 #include <sys/select.h>
@@ -59,7 +61,11 @@ typedef int socket_t;
 #define INVALID_SOCKET (-1)
 #endif //_WIN32
 
+#include <algorithm>
 #include <assert.h>
+#include <atomic>
+#include <condition_variable>
+#include <deque>
 #include <fcntl.h>
 #include <fstream>
 #include <functional>
@@ -70,11 +76,17 @@ typedef int socket_t;
 #include <string>
 #include <sys/stat.h>
 #include <thread>
+#include <vector>
 
 #ifdef CPPHTTPLIB_OPENSSL_SUPPORT
 #include <openssl/err.h>
 #include <openssl/ssl.h>
 #include <openssl/x509v3.h>
+
+#ifdef _WIN32
+#include <wincrypt.h>
+#pragma comment(lib, "crypt32.lib")
+#endif
 #endif
 
 #ifdef CPPHTTPLIB_ZLIB_SUPPORT
@@ -89,11 +101,19 @@ typedef int socket_t;
 #define CPPHTTPLIB_KEEPALIVE_MAX_COUNT 5
 #define CPPHTTPLIB_REQUEST_URI_MAX_LENGTH 8192
 #define CPPHTTPLIB_PAYLOAD_MAX_LENGTH std::numeric_limits<size_t>::max()
+#define CPPHTTPLIB_RECV_BUFSIZ size_t(4096u)
+#define CPPHTTPLIB_THREAD_POOL_COUNT                                           \
+  ((std::max)(8u, std::thread::hardware_concurrency()))
+#define CPPHTTPLIB_MAX_QUEUED_CONNECTIONS 1024
 
 namespace httplib {
 
 namespace detail {
 
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+class decompressor;
+#endif
+
 struct ci {
   bool operator()(const std::string &s1, const std::string &s2) const {
       return std::lexicographical_compare(
@@ -115,6 +135,8 @@ std::pair<std::string, std::string> make_range_header(uint64_t value,
 typedef std::multimap<std::string, std::string> Params;
 typedef std::smatch Match;
 typedef std::function<bool(uint64_t current, uint64_t total)> Progress;
+typedef std::function<bool(const char *data, size_t data_length)>
+    ContentReceiver;
 
 struct MultipartFile {
   std::string filename;
@@ -169,6 +191,12 @@ struct Response {
   Response() : status(-1) {}
 };
 
+struct ClientStats {
+  uint64_t requests = 0;
+  uint64_t bytes_on_wire = 0; // Response bodies as received
+  uint64_t bytes_decoded = 0; // Response bodies after content decoding
+};
+
 class Stream {
  public:
   virtual ~Stream() {}
@@ -211,6 +239,29 @@ class BufferStream : public Stream {
   std::string buffer;
 };
 
+// Fixed set of worker threads fed from a bounded queue
+class ThreadPool {
+ public:
+  ThreadPool(size_t thread_count, size_t max_queued);
+  ~ThreadPool();
+
+  // Returns false when the queue is full or the pool is shutting down
+  bool enqueue(std::function<void()> fn);
+
+  // Runs the jobs still queued, then joins the workers
+  void shutdown();
+
+ private:
+  void worker();
+
+  std::vector<std::thread> threads_;
+  std::deque<std::function<void()>> jobs_;
+  std::mutex mutex_;
+  std::condition_variable cond_;
+  const size_t max_queued_;
+  bool shutdown_;
+};
+
 class Server {
  public:
   typedef std::function<void(const Request &, Response &)> Handler;
@@ -238,7 +289,13 @@ class Server {
   void set_keep_alive_max_count(size_t count);
   void set_payload_max_length(uint64_t length);
 
+  // Connections are served by a fixed pool of workers, accepted connections
+  // beyond the queue limit are closed right away. Takes effect on listen.
+  void set_thread_pool_size(size_t count);
+  void set_max_queued_connections(size_t count);
+
   int bind_to_any_port(const char *host, int socket_flags = 0);
+  int bind_to_port(const char *host, int port, int socket_flags = 0);
   bool listen_after_bind();
 
   bool listen(const char *host, int port, int socket_flags = 0);
@@ -283,9 +340,8 @@ class Server {
   Handler error_handler_;
   Logger logger_;
 
-  // TODO: Use thread pool...
-  std::mutex running_threads_mutex_;
-  int running_threads_;
+  size_t thread_pool_size_;
+  size_t max_queued_connections_;
 };
 
 class Client {
@@ -337,23 +393,48 @@ class Client {
 
   bool send(Request &req, Response &res);
 
+  // Keep the connection open between requests instead of reconnecting for
+  // every call. The client is not thread safe while this is enabled.
+  void set_keep_alive(bool on);
+
+  // Ask for gzip'd responses, they are inflated while being received.
+  // Only has an effect with CPPHTTPLIB_ZLIB_SUPPORT.
+  void set_decompress(bool on);
+
+  const ClientStats &get_stats() const;
+
  protected:
   bool process_request(Stream &strm, Request &req, Response &res,
                        bool &connection_close);
 
+  virtual bool open_persistent_socket();
+  virtual void close_persistent_socket();
+  virtual bool process_persistent_request(Request &req, Response &res,
+                                          bool &connection_close);
+
   const std::string host_;
   const int port_;
   time_t timeout_sec_;
   const std::string host_and_port_;
+  bool keep_alive_;
+  socket_t sock_;
+  bool decompress_;
+  ClientStats stats_;
 
  private:
   socket_t create_client_socket() const;
+  bool send_persistent(Request &req, Response &res);
   bool read_response_line(Stream &strm, Response &res);
   void write_request(Stream &strm, Request &req);
 
   virtual bool read_and_close_socket(socket_t sock, Request &req,
                                      Response &res);
   virtual bool is_ssl() const;
+
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+  // Kept between responses so the zlib state and buffers are reused
+  std::unique_ptr<detail::decompressor> decompressor_;
+#endif
 };
 
 #ifdef CPPHTTPLIB_OPENSSL_SUPPORT
@@ -400,11 +481,25 @@ public:
 
   long get_openssl_verify_result() const;
 
+  size_t get_full_handshake_count() const;
+  size_t get_resumed_handshake_count() const;
+
+protected:
+  virtual bool open_persistent_socket();
+  virtual void close_persistent_socket();
+  virtual bool process_persistent_request(Request &req, Response &res,
+                                          bool &connection_close);
+
 private:
   virtual bool read_and_close_socket(socket_t sock, Request &req,
                                      Response &res);
   virtual bool is_ssl() const;
 
+  bool initialize_ssl(SSL *ssl);
+  bool load_verify_locations();
+  bool connect_and_verify(SSL *ssl);
+  int store_session(SSL_SESSION *session);
+
   bool verify_host(X509 *server_cert) const;
   bool verify_host_with_subject_alt_name(X509 *server_cert) const;
   bool verify_host_with_common_name(X509 *server_cert) const;
@@ -415,7 +510,16 @@ private:
   std::vector<std::string> host_components_;
   std::string ca_cert_path_;
   bool server_certificate_verification_ = false;
+  bool verify_locations_loaded_ = false;
   long verify_result_ = 0;
+
+  // Last session (or ticket) handed out by the server, offered again on the
+  // next handshake so reconnects skip the full key exchange
+  SSL_SESSION *session_ = nullptr;
+  std::mutex session_mutex_;
+  SSL *ssl_ = nullptr;
+  std::atomic<size_t> full_handshakes_{0};
+  std::atomic<size_t> resumed_handshakes_{0};
 };
 #endif
 
@@ -519,7 +623,13 @@ inline int close_socket(socket_t sock) {
 #endif
 }
 
+// select() can't take descriptors past FD_SETSIZE, which a server with a thousand clients gets to:
+// poll() where there is one
 inline int select_read(socket_t sock, time_t sec, time_t usec) {
+#ifndef _WIN32
+    pollfd pfd{sock, POLLIN, 0};
+    return poll(&pfd, 1, static_cast<int>(sec * 1000 + usec / 1000));
+#else
     fd_set fds;
     FD_ZERO(&fds);
     FD_SET(sock, &fds);
@@ -529,9 +639,21 @@ inline int select_read(socket_t sock, time_t sec, time_t usec) {
     tv.tv_usec = static_cast<long>(usec);
 
     return select(static_cast<int>(sock + 1), &fds, nullptr, nullptr, &tv);
+#endif
 }
 
 inline bool wait_until_socket_is_ready(socket_t sock, time_t sec, time_t usec) {
+#ifndef _WIN32
+    pollfd pfd{sock, POLLIN | POLLOUT, 0};
+    if (poll(&pfd, 1, static_cast<int>(sec * 1000 + usec / 1000)) <= 0)
+        return false;
+    if (pfd.revents & (POLLIN | POLLOUT)) {
+        int error = 0;
+        socklen_t len = sizeof(error);
+        return getsockopt(sock, SOL_SOCKET, SO_ERROR, (char *) &error, &len) >= 0 && !error;
+    }
+    return false;
+#else
     fd_set fdsr;
     FD_ZERO(&fdsr);
     FD_SET(sock, &fdsr);
@@ -557,6 +679,7 @@ inline bool wait_until_socket_is_ready(socket_t sock, time_t sec, time_t usec) {
     }
 
     return true;
+#endif
 }
 
 template<typename T>
@@ -788,6 +911,7 @@ inline const char *status_message(int status) {
         case 413: return "Payload Too Large";
         case 414: return "Request-URI Too Long";
         case 415: return "Unsupported Media Type";
+        case 503: return "Service Unavailable";
         default:
         case 500: return "Internal Server Error";
     }
@@ -836,13 +960,14 @@ inline bool read_headers(Stream &strm, Headers &headers) {
     return true;
 }
 
-inline bool read_content_with_length(Stream &strm, std::string &out, size_t len,
-                                     Progress progress) {
-    out.assign(len, 0);
+inline bool read_content_with_length(Stream &strm, size_t len,
+                                     Progress progress, ContentReceiver out) {
+    char buf[CPPHTTPLIB_RECV_BUFSIZ];
     size_t r = 0;
     while (r < len) {
-        auto n = strm.read(&out[r], len - r);
+        auto n = strm.read(buf, std::min(len - r, CPPHTTPLIB_RECV_BUFSIZ));
         if (n <= 0) { return false; }
+        if (!out(buf, n)) { return false; }
 
         r += n;
 
@@ -864,22 +989,22 @@ inline void skip_content_with_length(Stream &strm, size_t len) {
     }
 }
 
-inline bool read_content_without_length(Stream &strm, std::string &out) {
+inline bool read_content_without_length(Stream &strm, ContentReceiver out) {
+    char buf[CPPHTTPLIB_RECV_BUFSIZ];
     for (;;) {
-        char byte;
-        auto n = strm.read(&byte, 1);
+        auto n = strm.read(buf, CPPHTTPLIB_RECV_BUFSIZ);
         if (n < 0) {
             return false;
         } else if (n==0) {
             return true;
         }
-        out += byte;
+        if (!out(buf, n)) { return false; }
     }
 
     return true;
 }
 
-inline bool read_content_chunked(Stream &strm, std::string &out) {
+inline bool read_content_chunked(Stream &strm, ContentReceiver out) {
     const auto bufsiz = 16;
     char buf[bufsiz];
 
@@ -890,8 +1015,7 @@ inline bool read_content_chunked(Stream &strm, std::string &out) {
     auto chunk_len = std::stoi(reader.ptr(), 0, 16);
 
     while (chunk_len > 0) {
-        std::string chunk;
-        if (!read_content_with_length(strm, chunk, chunk_len, nullptr)) {
+        if (!read_content_with_length(strm, chunk_len, nullptr, out)) {
             return false;
         }
 
@@ -899,8 +1023,6 @@ inline bool read_content_chunked(Stream &strm, std::string &out) {
 
         if (strcmp(reader.ptr(), "\r\n")) { break; }
 
-        out += chunk;
-
         if (!reader.getline()) { return false; }
 
         chunk_len = std::stoi(reader.ptr(), 0, 16);
@@ -914,17 +1036,25 @@ inline bool read_content_chunked(Stream &strm, std::string &out) {
     return true;
 }
 
+// The body is appended to `x.body` unless a receiver is given, in which case
+// the raw bytes are handed to it as they arrive.
 template<typename T>
 bool read_content(Stream &strm, T &x, uint64_t payload_max_length,
                   bool &exceed_payload_max_length,
-                  Progress progress = Progress()) {
+                  Progress progress = Progress(),
+                  ContentReceiver receiver = nullptr) {
+    auto out = receiver ? receiver : [&](const char *buf, size_t n) {
+      x.body.append(buf, n);
+      return true;
+    };
+
     if (has_header(x.headers, "Content-Length")) {
         auto len = get_header_value_uint64(x.headers, "Content-Length", 0);
         if (len==0) {
             const auto &encoding =
                 get_header_value(x.headers, "Transfer-Encoding", 0, "");
             if (!strcasecmp(encoding, "chunked")) {
-                return read_content_chunked(strm, x.body);
+                return read_content_chunked(strm, out);
             }
         }
 
@@ -937,14 +1067,15 @@ bool read_content(Stream &strm, T &x, uint64_t payload_max_length,
             return false;
         }
 
-        return read_content_with_length(strm, x.body, len, progress);
+        if (!receiver) { x.body.reserve(len); }
+        return read_content_with_length(strm, len, progress, out);
     } else {
         const auto &encoding =
             get_header_value(x.headers, "Transfer-Encoding", 0, "");
         if (!strcasecmp(encoding, "chunked")) {
-            return read_content_chunked(strm, x.body);
+            return read_content_chunked(strm, out);
         }
-        return read_content_without_length(strm, x.body);
+        return read_content_without_length(strm, out);
     }
     return true;
 }
@@ -1295,6 +1426,65 @@ inline void decompress(std::string &content) {
 
   inflateEnd(&strm);
 }
+
+// Incremental gzip inflater, fed with the body as it comes off the socket
+class decompressor {
+public:
+  decompressor() {
+    memset(&strm_, 0, sizeof(strm_));
+    strm_.zalloc = Z_NULL;
+    strm_.zfree = Z_NULL;
+    strm_.opaque = Z_NULL;
+
+    // 16 + 15: gzip wrapper with the largest window, see decompress()
+    is_valid_ = inflateInit2(&strm_, 16 + 15) == Z_OK;
+  }
+
+  ~decompressor() {
+    if (is_valid_) { inflateEnd(&strm_); }
+  }
+
+  bool is_valid() const { return is_valid_; }
+
+  // Start over for a new stream, keeping the allocated window
+  void reset() {
+    inflateReset(&strm_);
+    is_complete_ = false;
+  }
+
+  // Whether the end of the gzip stream was reached, a body cut short
+  // inflates without an error but never gets there
+  bool is_complete() const { return is_complete_; }
+
+  bool decompress(const char *data, size_t data_length, std::string &out) {
+    strm_.avail_in = static_cast<uInt>(data_length);
+    strm_.next_in = (Bytef *)data;
+
+    do {
+      strm_.avail_out = sizeof(buff_);
+      strm_.next_out = (Bytef *)buff_;
+
+      auto ret = inflate(&strm_, Z_NO_FLUSH);
+      if (ret != Z_OK && ret != Z_STREAM_END && ret != Z_BUF_ERROR) {
+        return false;
+      }
+
+      out.append(buff_, sizeof(buff_) - strm_.avail_out);
+      if (ret == Z_STREAM_END) {
+        is_complete_ = true;
+        break;
+      }
+    } while (strm_.avail_out == 0);
+
+    return true;
+  }
+
+private:
+  z_stream strm_;
+  bool is_valid_;
+  bool is_complete_ = false;
+  char buff_[16384];
+};
 #endif
 
 #ifdef _WIN32
@@ -1479,11 +1669,62 @@ inline std::string BufferStream::get_remote_addr() const { return ""; }
 
 inline const std::string &BufferStream::get_buffer() const { return buffer; }
 
+// Thread pool implementation
+inline ThreadPool::ThreadPool(size_t thread_count, size_t max_queued)
+    : max_queued_(max_queued), shutdown_(false) {
+    thread_count = (std::max)(thread_count, size_t(1));
+    threads_.reserve(thread_count);
+    while (thread_count--) {
+        threads_.emplace_back([this]() { worker(); });
+    }
+}
+
+inline ThreadPool::~ThreadPool() { shutdown(); }
+
+inline bool ThreadPool::enqueue(std::function<void()> fn) {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (shutdown_ || jobs_.size() >= max_queued_) { return false; }
+        jobs_.push_back(std::move(fn));
+    }
+    cond_.notify_one();
+    return true;
+}
+
+inline void ThreadPool::shutdown() {
+    {
+        std::lock_guard<std::mutex> guard(mutex_);
+        if (shutdown_) { return; }
+        shutdown_ = true;
+    }
+    cond_.notify_all();
+
+    for (auto &t : threads_) {
+        t.join();
+    }
+}
+
+inline void ThreadPool::worker() {
+    for (;;) {
+        std::function<void()> fn;
+        {
+            std::unique_lock<std::mutex> lock(mutex_);
+            cond_.wait(lock, [&] { return shutdown_ || !jobs_.empty(); });
+            if (jobs_.empty()) { return; } // Shut down and drained
+            fn = std::move(jobs_.front());
+            jobs_.pop_front();
+        }
+        fn();
+    }
+}
+
 // HTTP server implementation
 inline Server::Server()
     : keep_alive_max_count_(CPPHTTPLIB_KEEPALIVE_MAX_COUNT),
       payload_max_length_(CPPHTTPLIB_PAYLOAD_MAX_LENGTH), is_running_(false),
-      svr_sock_(INVALID_SOCKET), running_threads_(0) {
+      svr_sock_(INVALID_SOCKET),
+      thread_pool_size_(CPPHTTPLIB_THREAD_POOL_COUNT),
+      max_queued_connections_(CPPHTTPLIB_MAX_QUEUED_CONNECTIONS) {
 #ifndef _WIN32
     signal(SIGPIPE, SIG_IGN);
 #endif
@@ -1543,10 +1784,23 @@ inline void Server::set_payload_max_length(uint64_t length) {
     payload_max_length_ = length;
 }
 
+inline void Server::set_thread_pool_size(size_t count) {
+    thread_pool_size_ = count;
+}
+
+inline void Server::set_max_queued_connections(size_t count) {
+    max_queued_connections_ = count;
+}
+
 inline int Server::bind_to_any_port(const char *host, int socket_flags) {
     return bind_internal(host, 0, socket_flags);
 }
 
+inline int Server::bind_to_port(const char *host, int port,
+                                int socket_flags) {
+    return bind_internal(host, port, socket_flags);
+}
+
 inline bool Server::listen_after_bind() { return listen_internal(); }
 
 inline bool Server::listen(const char *host, int port, int socket_flags) {
@@ -1686,9 +1940,7 @@ inline socket_t Server::create_server_socket(const char *host, int port,
           if (::bind(sock, ai.ai_addr, static_cast<int>(ai.ai_addrlen))) {
               return false;
           }
-          if (::listen(sock, 5)) { // Listen through 5 channels
-              return false;
-          }
+          if (::listen(sock, SOMAXCONN)) { return false; }
           return true;
         },
         socket_flags);
@@ -1725,6 +1977,8 @@ inline bool Server::listen_internal() {
 
     is_running_ = true;
 
+    ThreadPool pool(thread_pool_size_, max_queued_connections_);
+
     for (;;) {
         auto val = detail::select_read(svr_sock_, 0, 100000);
 
@@ -1747,28 +2001,19 @@ inline bool Server::listen_internal() {
             break;
         }
 
-        // TODO: Use thread pool...
-        std::thread([=]() {
-          {
-              std::lock_guard<std::mutex> guard(running_threads_mutex_);
-              running_threads_++;
-          }
-
-          read_and_close_socket(sock);
+        // Responses go out as several small writes, which would otherwise
+        // stall keep-alive clients on delayed ACKs
+        int yes = 1;
+        setsockopt(sock, IPPROTO_TCP, TCP_NODELAY, (char *) &yes, sizeof(yes));
 
-          {
-              std::lock_guard<std::mutex> guard(running_threads_mutex_);
-              running_threads_--;
-          }
-        }).detach();
+        if (!pool.enqueue([=]() { read_and_close_socket(sock); })) {
+            // Overloaded, shed the connection instead of queueing unboundedly
+            detail::close_socket(sock);
+        }
     }
 
-    // TODO: Use thread pool...
-    for (;;) {
-        std::this_thread::sleep_for(std::chrono::milliseconds(10));
-        std::lock_guard<std::mutex> guard(running_threads_mutex_);
-        if (!running_threads_) { break; }
-    }
+    // Let the connections already accepted finish
+    pool.shutdown();
 
     is_running_ = false;
 
@@ -1885,6 +2130,11 @@ inline bool Server::process_request(Stream &strm, bool last_connection,
         res.status = 404;
     }
 
+    // a handler can end the connection, instead of it holding a worker until the keep-alive times out
+    if (res.get_header_value("Connection")=="close") {
+        connection_close = true;
+    }
+
     write_response(strm, last_connection, req, res);
     return true;
 }
@@ -1902,9 +2152,10 @@ inline bool Server::read_and_close_socket(socket_t sock) {
 // HTTP client implementation
 inline Client::Client(const char *host, int port, time_t timeout_sec)
     : host_(host), port_(port), timeout_sec_(timeout_sec),
-      host_and_port_(host_ + ":" + std::to_string(port_)) {}
+      host_and_port_(host_ + ":" + std::to_string(port_)), keep_alive_(false),
+      sock_(INVALID_SOCKET), decompress_(false) {}
 
-inline Client::~Client() {}
+inline Client::~Client() { Client::close_persistent_socket(); }
 
 inline bool Client::is_valid() const { return true; }
 
@@ -1949,12 +2200,65 @@ inline bool Client::read_response_line(Stream &strm, Response &res) {
 inline bool Client::send(Request &req, Response &res) {
     if (req.path.empty()) { return false; }
 
+    if (keep_alive_) { return send_persistent(req, res); }
+
     auto sock = create_client_socket();
     if (sock==INVALID_SOCKET) { return false; }
 
     return read_and_close_socket(sock, req, res);
 }
 
+inline void Client::set_keep_alive(bool on) {
+    keep_alive_ = on;
+    if (!on) { close_persistent_socket(); }
+}
+
+inline void Client::set_decompress(bool on) { decompress_ = on; }
+
+inline const ClientStats &Client::get_stats() const { return stats_; }
+
+inline bool Client::send_persistent(Request &req, Response &res) {
+    // The server may drop an idle connection at any time, so a failure on a
+    // reused socket is retried once on a fresh one.
+    for (auto attempt = 0; attempt < 2; attempt++) {
+        auto reused = sock_!=INVALID_SOCKET;
+
+        // An idle connection that became readable was closed by the peer
+        if (reused && detail::select_read(sock_, 0, 0)!=0) {
+            close_persistent_socket();
+            reused = false;
+        }
+
+        if (!reused && !open_persistent_socket()) { return false; }
+
+        auto connection_close = false;
+        auto ret = process_persistent_request(req, res, connection_close);
+        if (!ret || connection_close) { close_persistent_socket(); }
+        if (ret || !reused) { return ret; }
+
+        res = Response();
+    }
+    return false;
+}
+
+inline bool Client::open_persistent_socket() {
+    sock_ = create_client_socket();
+    return sock_!=INVALID_SOCKET;
+}
+
+inline void Client::close_persistent_socket() {
+    if (sock_!=INVALID_SOCKET) {
+        detail::close_socket(sock_);
+        sock_ = INVALID_SOCKET;
+    }
+}
+
+inline bool Client::process_persistent_request(Request &req, Response &res,
+                                               bool &connection_close) {
+    SocketStream strm(sock_);
+    return process_request(strm, req, res, connection_close);
+}
+
 inline void Client::write_request(Stream &strm, Request &req) {
     BufferStream bstrm;
 
@@ -1982,14 +2286,19 @@ inline void Client::write_request(Stream &strm, Request &req) {
 
     if (!req.has_header("Accept")) { req.set_header("Accept", "*/*"); }
 
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    if (decompress_ && !req.has_header("Accept-Encoding")) {
+        req.set_header("Accept-Encoding", "gzip");
+    }
+#endif
+
     if (!req.has_header("User-Agent")) {
         req.set_header("User-Agent", "cpp-httplib/0.2");
     }
 
-    // TODO: Support KeepAlive connection
-    // if (!req.has_header("Connection")) {
-    req.set_header("Connection", "close");
-    // }
+    if (!req.has_header("Connection")) {
+        req.set_header("Connection", keep_alive_ ? "Keep-Alive" : "close");
+    }
 
     if (req.body.empty()) {
         if (req.method=="POST" || req.method=="PUT" || req.method=="PATCH") {
@@ -2032,21 +2341,45 @@ inline bool Client::process_request(Stream &strm, Request &req, Response &res,
         connection_close = true;
     }
 
+    stats_.requests++;
+
     // Body
     if (req.method!="HEAD") {
-        bool exceed_payload_max_length = false;
-        if (!detail::read_content(strm, res, std::numeric_limits<uint64_t>::max(),
-                                  exceed_payload_max_length, req.progress)) {
-            return false;
-        }
+        ContentReceiver out = [&](const char *buf, size_t n) {
+          stats_.bytes_on_wire += n;
+          res.body.append(buf, n);
+          return true;
+        };
 
-        if (res.get_header_value("Content-Encoding")=="gzip") {
+        auto is_gzip = res.get_header_value("Content-Encoding")=="gzip";
+        if (is_gzip) {
 #ifdef CPPHTTPLIB_ZLIB_SUPPORT
-            detail::decompress(res.body);
+            if (!decompressor_) {
+                decompressor_.reset(new detail::decompressor());
+            }
+            if (!decompressor_->is_valid()) { return false; }
+            decompressor_->reset();
+
+            out = [&](const char *buf, size_t n) {
+              stats_.bytes_on_wire += n;
+              return decompressor_->decompress(buf, n, res.body);
+            };
 #else
             return false;
 #endif
         }
+
+        bool exceed_payload_max_length = false;
+        if (!detail::read_content(strm, res, std::numeric_limits<uint64_t>::max(),
+                                  exceed_payload_max_length, req.progress,
+                                  out)) {
+            return false;
+        }
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+        if (is_gzip && !decompressor_->is_complete()) { return false; }
+#endif
+
+        stats_.bytes_decoded += res.body.size();
     }
 
     return true;
@@ -2376,6 +2709,19 @@ inline SSLClient::SSLClient(const char *host, int port, time_t timeout_sec)
     : Client(host, port, timeout_sec) {
   ctx_ = SSL_CTX_new(SSLv23_client_method());
 
+  if (ctx_) {
+    // Sessions are kept by the client itself rather than the (server oriented)
+    // internal cache, see store_session()
+    SSL_CTX_set_session_cache_mode(ctx_, SSL_SESS_CACHE_CLIENT |
+                                             SSL_SESS_CACHE_NO_INTERNAL_STORE);
+    SSL_CTX_set_app_data(ctx_, this);
+    SSL_CTX_sess_set_new_cb(ctx_, [](SSL *ssl, SSL_SESSION *session) {
+      auto client =
+          static_cast<SSLClient *>(SSL_CTX_get_app_data(SSL_get_SSL_CTX(ssl)));
+      return client->store_session(session);
+    });
+  }
+
   detail::split(&host_[0], &host_[host_.size()], '.',
                 [&](const char *b, const char *e) {
                   host_components_.emplace_back(std::string(b, e));
@@ -2383,6 +2729,8 @@ inline SSLClient::SSLClient(const char *host, int port, time_t timeout_sec)
 }
 
 inline SSLClient::~SSLClient() {
+  close_persistent_socket();
+  if (session_) { SSL_SESSION_free(session_); }
   if (ctx_) { SSL_CTX_free(ctx_); }
 }
 
@@ -2400,47 +2748,147 @@ inline long SSLClient::get_openssl_verify_result() const {
   return verify_result_;
 }
 
+inline size_t SSLClient::get_full_handshake_count() const {
+  return full_handshakes_;
+}
+
+inline size_t SSLClient::get_resumed_handshake_count() const {
+  return resumed_handshakes_;
+}
+
 inline bool SSLClient::read_and_close_socket(socket_t sock, Request &req,
                                              Response &res) {
 
   return is_valid() &&
          detail::read_and_close_socket_ssl(
              sock, 0, ctx_, ctx_mutex_,
-             [&](SSL *ssl) {
-               if (ca_cert_path_.empty()) {
-                 SSL_CTX_set_verify(ctx_, SSL_VERIFY_NONE, nullptr);
-               } else {
-                 if (!SSL_CTX_load_verify_locations(ctx_, ca_cert_path_.c_str(),
-                                                    nullptr)) {
-                   return false;
-                 }
-                 SSL_CTX_set_verify(ctx_, SSL_VERIFY_PEER, nullptr);
-               }
+             [&](SSL *ssl) { return connect_and_verify(ssl); },
+             [&](SSL *ssl) { return initialize_ssl(ssl); },
+             [&](Stream &strm, bool /*last_connection*/,
+                 bool &connection_close) {
+               return process_request(strm, req, res, connection_close);
+             });
+}
 
-               if (SSL_connect(ssl) != 1) { return false; }
+inline bool SSLClient::open_persistent_socket() {
+  if (!is_valid() || !Client::open_persistent_socket()) { return false; }
 
-               if (server_certificate_verification_) {
-                 verify_result_ = SSL_get_verify_result(ssl);
+  {
+    std::lock_guard<std::mutex> guard(ctx_mutex_);
+    ssl_ = SSL_new(ctx_);
+  }
 
-                 if (verify_result_ != X509_V_OK) { return false; }
+  if (ssl_) {
+    auto bio = BIO_new_socket(sock_, BIO_NOCLOSE);
+    SSL_set_bio(ssl_, bio, bio);
 
-                 auto server_cert = SSL_get_peer_certificate(ssl);
+    if (initialize_ssl(ssl_) && connect_and_verify(ssl_)) { return true; }
+  }
 
-                 if (server_cert == nullptr) { return false; }
+  close_persistent_socket();
+  return false;
+}
 
-                 if (!verify_host(server_cert)) { return false; }
-               }
+inline void SSLClient::close_persistent_socket() {
+  if (ssl_) {
+    SSL_shutdown(ssl_);
+    {
+      std::lock_guard<std::mutex> guard(ctx_mutex_);
+      SSL_free(ssl_);
+    }
+    ssl_ = nullptr;
+  }
+  Client::close_persistent_socket();
+}
 
-               return true;
-             },
-             [&](SSL *ssl) {
-               SSL_set_tlsext_host_name(ssl, host_.c_str());
-               return true;
-             },
-             [&](Stream &strm, bool /*last_connection*/,
-                 bool &connection_close) {
-               return process_request(strm, req, res, connection_close);
-             });
+inline bool SSLClient::process_persistent_request(Request &req, Response &res,
+                                                  bool &connection_close) {
+  SSLSocketStream strm(sock_, ssl_);
+  return process_request(strm, req, res, connection_close);
+}
+
+inline bool SSLClient::initialize_ssl(SSL *ssl) {
+  SSL_set_tlsext_host_name(ssl, host_.c_str());
+
+  std::lock_guard<std::mutex> guard(session_mutex_);
+  if (session_) { SSL_set_session(ssl, session_); }
+  return true;
+}
+
+// Trusted roots come from <ca_cert_path_> if set, otherwise from the system:
+// OpenSSL's default locations, or the certificate store on Windows where
+// OpenSSL has none. Loaded into the context once, on the first handshake.
+inline bool SSLClient::load_verify_locations() {
+  std::lock_guard<std::mutex> guard(ctx_mutex_);
+  if (verify_locations_loaded_) { return true; }
+
+  if (!ca_cert_path_.empty()) {
+    verify_locations_loaded_ = SSL_CTX_load_verify_locations(
+                                   ctx_, ca_cert_path_.c_str(), nullptr) == 1;
+    return verify_locations_loaded_;
+  }
+
+#ifdef _WIN32
+  auto store = CertOpenSystemStoreW(0, L"ROOT");
+  if (!store) { return false; }
+
+  auto x509_store = SSL_CTX_get_cert_store(ctx_);
+  PCCERT_CONTEXT cert = nullptr;
+  while ((cert = CertEnumCertificatesInStore(store, cert)) != nullptr) {
+    auto der = static_cast<const unsigned char *>(cert->pbCertEncoded);
+    auto x509 = d2i_X509(nullptr, &der, static_cast<long>(cert->cbCertEncoded));
+    if (x509) {
+      X509_STORE_add_cert(x509_store, x509);
+      X509_free(x509);
+    }
+  }
+  CertCloseStore(store, 0);
+  verify_locations_loaded_ = true;
+#else
+  verify_locations_loaded_ = SSL_CTX_set_default_verify_paths(ctx_) == 1;
+#endif
+  return verify_locations_loaded_;
+}
+
+inline bool SSLClient::connect_and_verify(SSL *ssl) {
+  // Set on the connection: SSL_new() already copied the context's mode
+  if (server_certificate_verification_ || !ca_cert_path_.empty()) {
+    if (!load_verify_locations()) { return false; }
+    SSL_set_verify(ssl, SSL_VERIFY_PEER, nullptr);
+  } else {
+    SSL_set_verify(ssl, SSL_VERIFY_NONE, nullptr);
+  }
+
+  if (SSL_connect(ssl) != 1) { return false; }
+
+  if (SSL_session_reused(ssl)) {
+    resumed_handshakes_++;
+  } else {
+    full_handshakes_++;
+  }
+
+  if (server_certificate_verification_) {
+    verify_result_ = SSL_get_verify_result(ssl);
+
+    if (verify_result_ != X509_V_OK) { return false; }
+
+    auto server_cert = SSL_get_peer_certificate(ssl);
+
+    if (server_cert == nullptr) { return false; }
+
+    if (!verify_host(server_cert)) { return false; }
+  }
+
+  return true;
+}
+
+// Called by OpenSSL whenever the server issues a new session or TLS 1.3
+// ticket; returning 1 takes ownership of it.
+inline int SSLClient::store_session(SSL_SESSION *session) {
+  std::lock_guard<std::mutex> guard(session_mutex_);
+  if (session_) { SSL_SESSION_free(session_); }
+  session_ = session;
+  return 1;
 }
 
 inline bool SSLClient::is_ssl() const { return true; }
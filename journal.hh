@@ -0,0 +1,183 @@
+/**
+ * @file    journal.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <vector>
+
+
+/**
+ * @brief One entry of a session journal: what happened, when and its fields.
+ * The meaning of the fields is up to the writer of each <Type>.
+ */
+struct JournalRecord {
+    enum Type : uint8_t { observation = 1, apiRequest, apiResponse, presence };
+
+    Type type;
+    uint64_t time;  ///< ms since the start of the session
+    std::vector<uint64_t> numbers;
+    std::vector<std::string> strings;
+};
+
+
+/*
+ * File layout, all integers are LEB128 varints:
+ *   "TRPCJRNL" version unixStart
+ *   per record: type timeDelta numberCount numbers... stringCount (length bytes)...
+ */
+namespace journal_detail {
+
+static const char MAGIC[8] = {'T', 'R', 'P', 'C', 'J', 'R', 'N', 'L'};
+static const uint64_t FORMAT_VERSION = 1;
+
+inline void putVarint(std::string &out, uint64_t value) {
+    while (value >= 0x80u) {
+        out.push_back(static_cast<char>((value & 0x7Fu) | 0x80u));
+        value >>= 7u;
+    }
+    out.push_back(static_cast<char>(value));
+}
+
+inline bool getVarint(std::istream &in, uint64_t &value) {
+    value = 0;
+    for (unsigned shift = 0; shift < 64; shift += 7) {
+        auto c = in.get();
+        if (c == std::char_traits<char>::eof())
+            return false;
+        value |= static_cast<uint64_t>(c & 0x7F) << shift;
+        if (!(c & 0x80))
+            return true;
+    }
+    return false;
+}
+
+}  // namespace journal_detail
+
+
+/**
+ * @brief Appends records to a journal file, safe to share between threads.
+ * Every record is flushed, so a crash loses nothing before it.
+ */
+class JournalWriter {
+  public:
+    /**
+     * @return false if <path> could not be created
+     */
+    bool open(const std::string &path, int64_t unixStart) {
+        out_.open(path, std::ios::binary | std::ios::trunc);
+        if (!out_)
+            return false;
+
+        std::string header(journal_detail::MAGIC, sizeof(journal_detail::MAGIC));
+        journal_detail::putVarint(header, journal_detail::FORMAT_VERSION);
+        journal_detail::putVarint(header, static_cast<uint64_t>(unixStart));
+        out_.write(header.data(), header.size());
+        out_.flush();
+        return static_cast<bool>(out_);
+    }
+
+    bool isOpen() const { return out_.is_open(); }
+
+    /// @brief Records have to come in time order
+    void write(const JournalRecord &record) {
+        std::string buffer;
+        buffer.push_back(static_cast<char>(record.type));
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        journal_detail::putVarint(buffer, record.time >= lastTime_ ? record.time - lastTime_ : 0);
+        lastTime_ = std::max(lastTime_, record.time);
+
+        journal_detail::putVarint(buffer, record.numbers.size());
+        for (auto number : record.numbers)
+            journal_detail::putVarint(buffer, number);
+        journal_detail::putVarint(buffer, record.strings.size());
+        for (auto &str : record.strings) {
+            journal_detail::putVarint(buffer, str.size());
+            buffer += str;
+        }
+
+        out_.write(buffer.data(), buffer.size());
+        out_.flush();
+    }
+
+  private:
+    std::ofstream out_;
+    std::mutex mutex_;
+    uint64_t lastTime_ = 0;
+};
+
+
+class JournalReader {
+  public:
+    /**
+     * @return false if <path> can't be read or isn't a journal
+     */
+    bool open(const std::string &path) {
+        in_.open(path, std::ios::binary);
+        char magic[sizeof(journal_detail::MAGIC)];
+        uint64_t version, unixStart;
+
+        if (!in_.read(magic, sizeof(magic)) || memcmp(magic, journal_detail::MAGIC, sizeof(magic)) != 0
+            || !journal_detail::getVarint(in_, version) || version != journal_detail::FORMAT_VERSION
+            || !journal_detail::getVarint(in_, unixStart))
+            return false;
+
+        unixStart_ = static_cast<int64_t>(unixStart);
+        return true;
+    }
+
+    int64_t unixStart() const noexcept { return unixStart_; }
+
+    /**
+     * @return false at the end of the journal, or at a truncated record
+     */
+    bool next(JournalRecord &record) {
+        auto type = in_.get();
+        uint64_t delta, count;
+        if (type == std::char_traits<char>::eof() || !journal_detail::getVarint(in_, delta))
+            return false;
+
+        record.type = static_cast<JournalRecord::Type>(type);
+        time_ += delta;
+        record.time = time_;
+
+        if (!journal_detail::getVarint(in_, count) || count > MAX_FIELDS)
+            return false;
+        record.numbers.resize(count);
+        for (auto &number : record.numbers)
+            if (!journal_detail::getVarint(in_, number))
+                return false;
+
+        if (!journal_detail::getVarint(in_, count) || count > MAX_FIELDS)
+            return false;
+        record.strings.resize(count);
+        for (auto &str : record.strings) {
+            uint64_t size;
+            if (!journal_detail::getVarint(in_, size) || size > MAX_STRING)
+                return false;
+            str.resize(size);
+            if (!in_.read(&str[0], size))
+                return false;
+        }
+        return true;
+    }
+
+  private:
+    // sanity limits, so a corrupt length doesn't allocate gigabytes
+    static const uint64_t MAX_FIELDS = 64;
+    static const uint64_t MAX_STRING = 64u << 20u;
+
+    std::ifstream in_;
+    int64_t unixStart_ = 0;
+    uint64_t time_ = 0;
+};
@@ -0,0 +1,323 @@
+/**
+ * @file    linux_api_hook.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <cctype>
+#include <codecvt>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <locale>
+#include <map>
+#include <regex>
+#include <string>
+#include <vector>
+// linux api
+#include <unistd.h>
+// x11
+#include <X11/Xatom.h>
+#include <X11/Xlib.h>
+#include <X11/Xutil.h>
+
+
+/**
+ * @brief Converts an std::wstring to a utf-8 std::string
+ * @param wstr The wstring to be converted
+ * @return The converted string
+ */
+inline std::string rawWstringToString(const std::wstring &wstr) {
+    return std::wstring_convert<std::codecvt_utf8<wchar_t>>().to_bytes(wstr);
+}
+
+
+/// @brief Enum describing the state of TIDAL app
+enum status { error, closed, opened, playing };
+
+
+/// @brief Process names of the player: tidal-hifi (its electron helpers too), the windows app under wine
+static const std::vector<std::string> TIDAL_PROCESS_NAMES = {"tidal-hifi", "TIDAL.exe"};
+
+/// @brief WM_CLASS names and classes of the player's windows, wine lowercases the name
+static const std::vector<std::string> TIDAL_WINDOW_CLASSES = {"tidal-hifi", "tidal.exe", "TIDAL.exe"};
+
+
+/**
+ * @brief Keeps track of the top level windows of TIDAL (wine or electron wrappers) and their titles.
+ *
+ * The window list is only scanned when it changes (_NET_CLIENT_LIST on the root window, or
+ * top level windows being created/destroyed if there is no EWMH window manager).
+ * Titles are re-read only when a PropertyNotify for the title arrives on a cached window.
+ * Windows are matched by their exact WM_CLASS or process name, never our own (tidal-rpc).
+ */
+class TidalWindows {
+  public:
+    ~TidalWindows() {
+        if (display_)
+            XCloseDisplay(display_);
+    }
+
+    /**
+     * @brief Handles the pending X events
+     * @return false if there is no X display
+     */
+    bool update() {
+        if (!display_ && !open())
+            return false;
+
+        while (XPending(display_)) {
+            XEvent event;
+            XNextEvent(display_, &event);
+            handle(event);
+        }
+
+        if (isListDirty_) {
+            isListDirty_ = false;
+            scan();
+        }
+        return true;
+    }
+
+    /// @brief Current titles of all TIDAL windows, as utf-8
+    const std::map<Window, std::string> &titles() const noexcept { return titles_; }
+
+  private:
+    bool open() {
+        display_ = XOpenDisplay(nullptr);
+        if (!display_)
+            return false;
+
+        // windows may vanish between the list and the query, don't let Xlib exit on BadWindow
+        XSetErrorHandler([](Display *, XErrorEvent *) { return 0; });
+
+        root_ = DefaultRootWindow(display_);
+        netClientList_ = XInternAtom(display_, "_NET_CLIENT_LIST", False);
+        netWmPid_ = XInternAtom(display_, "_NET_WM_PID", False);
+        netWmName_ = XInternAtom(display_, "_NET_WM_NAME", False);
+        utf8String_ = XInternAtom(display_, "UTF8_STRING", False);
+
+        XSelectInput(display_, root_, PropertyChangeMask | SubstructureNotifyMask);
+        isListDirty_ = true;
+        return true;
+    }
+
+    void handle(const XEvent &event) {
+        switch (event.type) {
+            case PropertyNotify:
+                if (event.xproperty.window == root_) {
+                    if (event.xproperty.atom == netClientList_)
+                        isListDirty_ = true;
+                } else if (event.xproperty.atom == netWmName_ || event.xproperty.atom == XA_WM_NAME) {
+                    auto it = titles_.find(event.xproperty.window);
+                    if (it != titles_.end())
+                        it->second = title(it->first);
+                }
+                break;
+            case DestroyNotify:
+                titles_.erase(event.xdestroywindow.window);
+                break;
+            case CreateNotify:
+            case MapNotify:
+            case ReparentNotify:
+                // only matters when the window manager doesn't maintain _NET_CLIENT_LIST
+                if (!hasClientList_)
+                    isListDirty_ = true;
+                break;
+            default:
+                break;
+        }
+    }
+
+    void scan() {
+        std::map<Window, std::string> found;
+
+        for (auto window : clients()) {
+            if (!isTIDAL(window))
+                continue;
+
+            auto it = titles_.find(window);
+            if (it != titles_.end()) {
+                found.emplace(*it);
+                continue;
+            }
+
+            XSelectInput(display_, window, PropertyChangeMask | StructureNotifyMask);
+            found.emplace(window, title(window));
+        }
+        titles_.swap(found);
+    }
+
+    /// @brief Top level client windows, from the window manager if it provides them
+    std::vector<Window> clients() {
+        std::vector<Window> windows;
+
+        unsigned char *data = nullptr;
+        unsigned long count = 0;
+        if (property(root_, netClientList_, XA_WINDOW, data, count)) {
+            hasClientList_ = true;
+            auto list = reinterpret_cast<Window *>(data);
+            windows.assign(list, list + count);
+            XFree(data);
+            return windows;
+        }
+
+        hasClientList_ = false;
+        Window rootReturn, parent, *children = nullptr;
+        unsigned int childCount = 0;
+        if (XQueryTree(display_, root_, &rootReturn, &parent, &children, &childCount)) {
+            windows.assign(children, children + childCount);
+            if (children)
+                XFree(children);
+        }
+        return windows;
+    }
+
+    bool isTIDAL(Window window) {
+        // format 32 properties come back as longs
+        unsigned char *data = nullptr;
+        unsigned long count = 0;
+        unsigned long pid = 0;
+        if (property(window, netWmPid_, XA_CARDINAL, data, count)) {
+            pid = *reinterpret_cast<unsigned long *>(data);
+            XFree(data);
+            if (pid == static_cast<unsigned long>(getpid()))
+                return false;
+        }
+
+        XClassHint hint;
+        if (XGetClassHint(display_, window, &hint)) {
+            auto match = isOneOf(hint.res_name, TIDAL_WINDOW_CLASSES) || isOneOf(hint.res_class, TIDAL_WINDOW_CLASSES);
+            XFree(hint.res_name);
+            XFree(hint.res_class);
+            if (match)
+                return true;
+        }
+
+        if (!pid)
+            return false;
+        std::ifstream comm("/proc/" + std::to_string(pid) + "/comm");
+        std::string name;
+        return std::getline(comm, name) && isOneOf(name.c_str(), TIDAL_PROCESS_NAMES);
+    }
+
+    static bool isOneOf(const char *name, const std::vector<std::string> &names) {
+        return name && std::find(names.begin(), names.end(), name) != names.end();
+    }
+
+    std::string title(Window window) {
+        unsigned char *data = nullptr;
+        unsigned long count = 0;
+        if (property(window, netWmName_, utf8String_, data, count)) {
+            std::string name(reinterpret_cast<char *>(data), count);
+            XFree(data);
+            return name;
+        }
+
+        char *name = nullptr;
+        if (XFetchName(display_, window, &name) && name) {
+            std::string result(name);
+            XFree(name);
+            return result;
+        }
+        return std::string();
+    }
+
+    /**
+     * @brief Reads a whole property of <window>
+     * @return false if it is missing or not of <type>, otherwise <data> has to be XFree'd
+     */
+    bool property(Window window, Atom name, Atom type, unsigned char *&data, unsigned long &count) {
+        Atom actualType;
+        int format;
+        unsigned long remaining;
+
+        data = nullptr;
+        auto result = XGetWindowProperty(display_, window, name, 0, 65536, False, type,
+                                         &actualType, &format, &count, &remaining, &data);
+        if (result != Success || actualType != type || !data || !count) {
+            if (data)
+                XFree(data);
+            return false;
+        }
+        return true;
+    }
+
+    Display *display_ = nullptr;
+    Window root_ = 0;
+    Atom netClientList_ = 0;
+    Atom netWmPid_ = 0;
+    Atom netWmName_ = 0;
+    Atom utf8String_ = 0;
+    bool hasClientList_ = true;
+    bool isListDirty_ = true;
+    std::map<Window, std::string> titles_;
+};
+
+
+/**
+ * @brief Checks tidal Info
+ * @param song Track name if tidal is playing else empty string
+ * @param artist Artist name if tidal is playing else empty string
+ * @return returns a <status> struct with current tidal ifno
+ */
+status tidalInfo(std::wstring &song, std::wstring &artist) {
+    static const std::wregex rgx(L"(.+) - (?!\\{)(.+)");
+    static TidalWindows windows;
+
+    song = L"";
+    artist = L"";
+
+    if (!windows.update())
+        return error;
+
+    status result = closed;
+    for (auto &window : windows.titles()) {
+        if (window.second.empty())
+            continue;
+        result = opened;
+
+        std::wstring title;
+        try {
+            title = std::wstring_convert<std::codecvt_utf8<wchar_t>>().from_bytes(window.second);
+        } catch (const std::range_error &) {
+            continue;
+        }
+
+        std::wsmatch matches;
+        if (std::regex_search(title, matches, rgx)) {
+            song = matches[1].str();
+            artist = matches[2].str();
+            return playing;
+        }
+    }
+    return result;
+}
+
+
+/**
+ * Gets locale of current user
+ * @return ISO 2 letter formated country code
+ */
+inline char *getLocale() noexcept {
+    static char buffer[3] = "US";
+
+    // e.g. en_GB.UTF-8
+    for (auto name : {"LC_ALL", "LC_MESSAGES", "LANG"}) {
+        auto value = std::getenv(name);
+        if (!value || !*value)
+            continue;
+
+        auto country = std::strchr(value, '_');
+        if (country && std::isalpha((unsigned char) country[1]) && std::isalpha((unsigned char) country[2])) {
+            buffer[0] = static_cast<char>(std::toupper((unsigned char) country[1]));
+            buffer[1] = static_cast<char>(std::toupper((unsigned char) country[2]));
+        }
+        break;
+    }
+    return buffer;
+}
@@ -0,0 +1,245 @@
+/**
+ * @file    local_api.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+// local libs
+#include "httplib.hh"
+#include "json.hh"
+#include "now_playing.hh"
+#include "sse_server.hh"
+
+
+// The epoll server on linux. LOCAL_API_POOLED builds the pooled httplib::Server used elsewhere,
+// so it can be benchmarked on linux too
+#if defined(__linux__) && !defined(LOCAL_API_POOLED)
+#define LOCAL_API_EPOLL
+#endif
+
+static const int LOCAL_API_DEFAULT_PORT = 7654;
+static const size_t LOCAL_API_THREADS = 64;
+// Without epoll every event stream holds a server worker, keep some free for plain requests.
+// A deliberate limit off linux, further subscribers get a 503 (see the README)
+static const int LOCAL_API_MAX_SUBSCRIBERS = 48;
+
+
+/**
+ * @brief Serializes a <NowPlaying> snapshot to the json served by <LocalApi>
+ */
+inline nlohmann::json toJson(const NowPlaying &np) {
+    static const char *states[] = {"stopped", "playing", "paused"};
+
+    nlohmann::json j;
+    j["state"] = states[np.state];
+    if (np.state == NowPlaying::stopped)
+        return j;
+
+    std::string cover(np.coverId);
+    std::replace(cover.begin(), cover.end(), '-', '/');
+
+    j["title"] = np.title;
+    j["artist"] = np.artist;
+    j["album"] = np.album;
+    j["id"] = np.id;
+    j["url"] = np.id[0] ? "https://tidal.com/browse/track/" + std::string(np.id) : "";
+    j["cover_url"] = cover.empty() ? "" : "https://resources.tidal.com/images/" + cover + "/1280x1280.jpg";
+    j["start_time"] = np.startTime;
+    j["end_time"] = np.endTime;
+    j["duration"] = np.runtime;
+    j["repeat_count"] = np.repeatCount;
+    j["track_number"] = np.trackNumber;
+    j["volume_number"] = np.volumeNumber;
+    j["high_res"] = np.isHighRes;
+    return j;
+}
+
+
+/**
+ * @brief Loopback http api exposing the current track to overlays and dashboards.
+ *
+ *  GET /now-playing         current state as json
+ *  GET /now-playing/events  Server-Sent Events stream, one event per change
+ *
+ * Every change is serialized exactly once in <publish>, all clients share the resulting payload.
+ * On linux both are served by an epoll <SseServer>, so idle subscribers cost no thread,
+ * elsewhere by a pooled httplib::Server.
+ */
+class LocalApi {
+  public:
+    LocalApi() {
+        NowPlaying stopped;
+        memset(&stopped, 0, sizeof(stopped));
+        publish(stopped);
+
+#ifndef LOCAL_API_EPOLL
+        server_.set_thread_pool_size(LOCAL_API_THREADS);
+
+        server_.Get("/now-playing", [this](const httplib::Request &, httplib::Response &res) {
+            auto payload = current();
+            res.set_header("Access-Control-Allow-Origin", "*");
+            res.set_content(payload->json, "application/json");
+        });
+
+        server_.Get("/now-playing/events", [this](const httplib::Request &, httplib::Response &res) {
+            if (subscribers_.fetch_add(1) >= LOCAL_API_MAX_SUBSCRIBERS) {
+                subscribers_--;
+                // closed right away, a refused client must not keep a worker from /now-playing
+                res.status = 503;
+                res.set_header("Connection", "close");
+                return;
+            }
+
+            res.set_header("Content-Type", "text/event-stream");
+            res.set_header("Cache-Control", "no-cache");
+            res.set_header("Access-Control-Allow-Origin", "*");
+
+            // released together with the response, once the stream ended
+            auto subscription = std::make_shared<Subscription>(subscribers_);
+            res.streamcb = [this, subscription](uint64_t) { return nextEvent(subscription->seen); };
+        });
+#endif
+    }
+
+    ~LocalApi() { stop(); }
+
+    /**
+     * @brief Starts serving on a background thread
+     * @return false if <port> could not be bound
+     */
+    bool start(const char *host, int port) {
+#ifdef LOCAL_API_EPOLL
+        return sseServer_.bind(host, port) >= 0 && sseServer_.start();
+#else
+        if (server_.bind_to_port(host, port) < 0)
+            return false;
+
+        thread_ = std::thread([this]() { server_.listen_after_bind(); });
+        return true;
+#endif
+    }
+
+    void stop() {
+#ifdef LOCAL_API_EPOLL
+        sseServer_.stop();
+#else
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            if (isStopping_)
+                return;
+            isStopping_ = true;
+        }
+        changed_.notify_all();
+
+        server_.stop();
+        if (thread_.joinable())
+            thread_.join();
+#endif
+    }
+
+    /**
+     * @brief Serializes <np> and wakes up all event stream subscribers
+     */
+    void publish(const NowPlaying &np) {
+        std::string json;
+        try {
+            json = toJson(np).dump();
+        } catch (...) {
+            // invalid utf-8 in a title, keep serving the previous state
+            return;
+        }
+        auto event = "data: " + json + "\n\n";
+
+#ifdef LOCAL_API_EPOLL
+        sseServer_.publish(json, std::move(event));
+#else
+        auto payload = std::make_shared<Payload>();
+        payload->json = std::move(json);
+        payload->event = std::move(event);
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            payload->version = payload_ ? payload_->version + 1 : 1;
+            payload_ = std::move(payload);
+        }
+        changed_.notify_all();
+#endif
+    }
+
+    /// @brief Event streams open right now
+    size_t subscriberCount() const noexcept {
+#ifdef LOCAL_API_EPOLL
+        return sseServer_.subscriberCount();
+#else
+        return static_cast<size_t>(subscribers_.load());
+#endif
+    }
+
+  private:
+#ifdef LOCAL_API_EPOLL
+    SseServer sseServer_{"/now-playing", "/now-playing/events"};
+#else
+    struct Payload {
+        uint64_t version;
+        std::string json;
+        std::string event;
+    };
+
+    struct Subscription {
+        explicit Subscription(std::atomic<int> &count) : count(count) {}
+        ~Subscription() { count--; }
+
+        std::atomic<int> &count;
+        uint64_t seen = 0;  ///< version of the last event sent
+    };
+
+    // Idle streams get a comment line this often, which is also how dead clients get noticed
+    static constexpr std::chrono::seconds HEARTBEAT_INTERVAL{15};
+
+    std::shared_ptr<const Payload> current() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return payload_;
+    }
+
+    /**
+     * @brief Blocks until there is something newer than <seen> to send
+     * @return the next chunk of the event stream, empty to end it
+     */
+    std::string nextEvent(uint64_t &seen) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        auto hasNews = changed_.wait_for(lock, HEARTBEAT_INTERVAL, [&]() {
+            return isStopping_ || payload_->version != seen;
+        });
+
+        if (isStopping_)
+            return std::string();
+        if (!hasNews)
+            return ": heartbeat\n\n";
+
+        auto payload = payload_;
+        lock.unlock();
+
+        seen = payload->version;
+        return payload->event;
+    }
+
+    httplib::Server server_;
+    std::thread thread_;
+
+    std::mutex mutex_;
+    std::condition_variable changed_;
+    std::shared_ptr<const Payload> payload_;
+    std::atomic<int> subscribers_{0};
+    bool isStopping_ = false;
+#endif
+};
@@ -0,0 +1,195 @@
+/**
+ * @file    logger.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <atomic>
+#include <chrono>
+#include <condition_variable>
+#include <cstddef>
+#include <cstdint>
+#include <ctime>
+#include <iomanip>
+#include <iostream>
+#include <mutex>
+#include <new>
+#include <string>
+#include <thread>
+#include <tuple>
+#include <type_traits>
+#include <utility>
+
+
+enum class LogLevel : uint8_t { debug, info, warning, error };
+
+
+/// @brief How a log argument is stored until it is formatted, c strings may not outlive the call
+template<typename T>
+struct LogArg {
+    using type = typename std::decay<T>::type;
+};
+
+template<typename T>
+struct LogArg<T *> {
+    using type = typename std::conditional<std::is_same<typename std::remove_cv<T>::type, char>::value,
+                                           std::string, T *>::type;
+};
+
+
+/**
+ * @brief Asynchronous logger for the hot path.
+ *
+ * A log call copies its arguments into a slot of a bounded ring and returns, formatting and the
+ * write to std::clog happen later on a background thread. Producers never lock: slots are claimed
+ * with a compare-and-swap (bounded MPMC queue with per slot sequence numbers), a full ring drops
+ * the line and counts it.
+ */
+class Logger {
+  public:
+    static constexpr size_t CAPACITY = 1024;
+    /// room for the copied arguments of one line
+    static constexpr size_t ARGS_SIZE = 224;
+
+    static Logger &instance() {
+        // never destroyed, detached threads may still log while the process exits
+        static auto logger = new Logger();
+        return *logger;
+    }
+
+    template<typename... Args>
+    void log(LogLevel level, Args &&... args) {
+        using Tuple = std::tuple<typename LogArg<typename std::decay<Args>::type>::type...>;
+        static_assert(sizeof(Tuple) <= ARGS_SIZE, "too many log arguments");
+        static_assert(alignof(Tuple) <= alignof(std::max_align_t), "log argument alignment");
+
+        auto position = enqueue_.load(std::memory_order_relaxed);
+        Slot *slot;
+        for (;;) {
+            slot = &slots_[position % CAPACITY];
+            auto sequence = slot->sequence.load(std::memory_order_acquire);
+            auto diff = static_cast<intptr_t>(sequence) - static_cast<intptr_t>(position);
+            if (diff == 0) {
+                if (enqueue_.compare_exchange_weak(position, position + 1, std::memory_order_relaxed))
+                    break;
+            } else if (diff < 0) {
+                dropped_.fetch_add(1, std::memory_order_relaxed);
+                return;
+            } else {
+                position = enqueue_.load(std::memory_order_relaxed);
+            }
+        }
+
+        slot->level = level;
+        slot->time = std::chrono::system_clock::now();
+        new (slot->args) Tuple(std::forward<Args>(args)...);
+        slot->write = [](std::ostream &out, void *data) {
+            auto tuple = static_cast<Tuple *>(data);
+            writeTuple(out, *tuple, std::index_sequence_for<Args...>());
+            tuple->~Tuple();
+        };
+        slot->sequence.store(position + 1, std::memory_order_seq_cst);
+
+        if (isWaiting_.load(std::memory_order_seq_cst))
+            wake_.notify_one();
+    }
+
+    /// @brief Lines lost to a full ring so far
+    uint64_t dropped() const noexcept { return dropped_.load(std::memory_order_relaxed); }
+
+    /// @brief Blocks until everything logged before the call is written
+    void flush() {
+        auto target = enqueue_.load(std::memory_order_acquire);
+        while (dequeue_.load(std::memory_order_acquire) < target) {
+            wake_.notify_one();
+            std::this_thread::sleep_for(std::chrono::milliseconds(1));
+        }
+    }
+
+  private:
+    struct Slot {
+        std::atomic<size_t> sequence;
+        LogLevel level;
+        std::chrono::system_clock::time_point time;
+        void (*write)(std::ostream &, void *);
+        alignas(std::max_align_t) unsigned char args[ARGS_SIZE];
+    };
+
+    Logger() {
+        for (size_t i = 0; i < CAPACITY; i++)
+            slots_[i].sequence.store(i, std::memory_order_relaxed);
+        std::thread([this]() { run(); }).detach();
+    }
+
+    template<typename Tuple, size_t... I>
+    static void writeTuple(std::ostream &out, const Tuple &tuple, std::index_sequence<I...>) {
+        (void) std::initializer_list<int>{((out << std::get<I>(tuple)), 0)...};
+    }
+
+    void run() {
+        static const char *levels[] = {"debug", "info", "warning", "error"};
+        uint64_t reportedDrops = 0;
+
+        for (;;) {
+            auto position = dequeue_.load(std::memory_order_relaxed);
+            auto &slot = slots_[position % CAPACITY];
+
+            if (slot.sequence.load(std::memory_order_acquire) != position + 1) {
+                auto drops = dropped();
+                if (drops != reportedDrops) {
+                    std::clog << "[logger] " << drops - reportedDrops << " lines dropped\n";
+                    reportedDrops = drops;
+                }
+                std::clog.flush();
+
+                // producers only notify while we wait, the timeout covers a notify that came
+                // just before the wait started
+                std::unique_lock<std::mutex> lock(mutex_);
+                isWaiting_.store(true, std::memory_order_seq_cst);
+                if (slot.sequence.load(std::memory_order_seq_cst) != position + 1)
+                    wake_.wait_for(lock, std::chrono::seconds(1));
+                isWaiting_.store(false, std::memory_order_relaxed);
+                continue;
+            }
+
+            auto time = std::chrono::system_clock::to_time_t(slot.time);
+            auto ms = std::chrono::duration_cast<std::chrono::milliseconds>(slot.time.time_since_epoch()).count() % 1000;
+            std::tm local{};
+#ifdef _WIN32
+            localtime_s(&local, &time);
+#else
+            localtime_r(&time, &local);
+#endif
+
+            std::clog << std::put_time(&local, "%H:%M:%S") << '.' << std::setfill('0') << std::setw(3) << ms
+                      << std::setfill(' ') << ' ' << levels[static_cast<int>(slot.level)] << ": ";
+            slot.write(std::clog, slot.args);
+            std::clog << '\n';
+
+            slot.sequence.store(position + CAPACITY, std::memory_order_release);
+            dequeue_.store(position + 1, std::memory_order_release);
+        }
+    }
+
+    Slot slots_[CAPACITY];
+    alignas(64) std::atomic<size_t> enqueue_{0};
+    alignas(64) std::atomic<size_t> dequeue_{0};
+    std::atomic<uint64_t> dropped_{0};
+
+    std::mutex mutex_;
+    std::condition_variable wake_;
+    std::atomic<bool> isWaiting_{false};
+};
+
+
+#ifdef DEBUG
+#define LOG_DEBUG(...) Logger::instance().log(LogLevel::debug, __VA_ARGS__)
+#else
+#define LOG_DEBUG(...) ((void) 0)
+#endif
+#define LOG_INFO(...) Logger::instance().log(LogLevel::info, __VA_ARGS__)
+#define LOG_WARNING(...) Logger::instance().log(LogLevel::warning, __VA_ARGS__)
+#define LOG_ERROR(...) Logger::instance().log(LogLevel::error, __VA_ARGS__)
@@ -15,9 +15,14 @@
 #include <cctype>
 #include <chrono>
 #include <cstdio>
+#include <deque>
+#include <filesystem>
+#include <fstream>
+#include <functional>
 #include <iomanip>
 #include <iostream>
 #include <locale>
+#include <set>
 #include <stack>
 #include <string>
 #include <thread>
@@ -31,8 +36,21 @@
 #include <QSystemTrayIcon>
 #include <QTimer>
 /* local libs*/
+#include "clock.hh"
+#include "discord_ipc.hh"
+#include "discord_pump.hh"
 #include "httplib.hh"
+#include "journal.hh"
 #include "json.hh"
+#include "local_api.hh"
+#include "logger.hh"
+#include "now_playing.hh"
+#include "playback_tracker.hh"
+#include "poll_scheduler.hh"
+#include "process_watcher.hh"
+#include "seed_index.hh"
+#include "track_cache.hh"
+#include "track_resolver.hh"
 
 #define DISCORD_REQUIRE(x) assert(x == DiscordResult_Ok)
 
@@ -40,88 +58,95 @@
 #include "windows_api_hook.hh"
 #elif defined(__APPLE__) or defined(__MACH__)
 #include "osx_api_hook.hh"
+#elif defined(__linux__)
+#include "linux_api_hook.hh"
 #else
 #error "Not supported target"
 #endif
 
 #include "discord_game_sdk.h"
+#include "rpc_loop.hh"
 
-// TIDAL logo from the official TIDAL "artist" page: https://tidal.com/browse/artist/6712922
-static const std::string TIDAL_LOGO_URL = "https://resources.tidal.com/images/d156d3e0/a5cd/4066/8c36/b13edab7bbcc/750x750.jpg";
-
-#define CURRENT_TIME std::time(nullptr)
 #define HIFI_ASSET "hifi"
 
-static long long APPLICATION_ID = 584458858731405315;
-static const int RPC_IDLE_TIMEOUT_SECONDS = 5;
+static const int UPDATE_CHECK_TIMEOUT_MS = 10000;
+static const char *LATEST_RELEASE_URL =
+	"https://api.github.com/repos/purpl3F0x/TIDAL-Discord-Rich-Presence-UNOFFICIAL/releases/latest";
 
-std::atomic<bool> isPresenceActive;
 static char *countryCode = nullptr;
 
-static std::string currentStatus;
-static std::mutex currentSongMutex;
+// Status line of the tray menu, only touched on the UI thread
+static QAction *statusAction = nullptr;
 
-struct Song {
-  enum AudioQualityEnum {
-	master, hifi, normal
-  };
-  std::string title;
-  std::string artist;
-  std::string album;
-  std::string url;
-  std::string cover_id;
-  char id[10];
-  int64_t starttime;
-  int64_t runtime;
-  uint64_t pausedtime;
-  uint64_t repeatCount;
-  uint_fast8_t trackNumber;
-  uint_fast8_t volumeNumber;
-  bool isPaused = false;
-  AudioQualityEnum quality;
-  bool loaded = false;
-
-  void setQuality(const std::string &q) {
-	if (q == "HI_RES") {
-	  quality = master;
-	} else {
-	  quality = hifi;
-	}
-  }
+// Startup instrumentation, milestones are logged relative to entering main()
+static std::chrono::steady_clock::time_point startupTime;
+static std::atomic<bool> isFirstPresenceSent{false};
 
-  inline bool isHighRes() const noexcept { return quality == master; }
+static void logStartupMilestone(const char *milestone) {
+  auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(
+	  std::chrono::steady_clock::now() - startupTime);
+  LOG_INFO("Startup: ", milestone, " after ", elapsed.count(), " ms");
+}
 
-  inline int64_t endtime() const noexcept { return runtime ? starttime + runtime + pausedtime : 0; }
+/**
+ * @brief Pushes a new status to the tray menu.
+ * Called from the rpc thread, the text is handed to the UI thread through a
+ * queued call and only when it actually changed.
+ */
+static void setStatus(const std::string &status) {
+  static std::string lastStatus;
+  if (status == lastStatus) return;
+  lastStatus = status;
+
+  // no tray when replaying
+  if (!qApp) return;
+
+  auto text = "Status: " + QString::fromStdString(status);
+  QMetaObject::invokeMethod(qApp, [text]() {
+	if (statusAction) statusAction->setText(text);
+  }, Qt::QueuedConnection);
+}
 
-  friend std::ostream &operator<<(std::ostream &out, const Song &song) {
-	out << song.title << " of " << song.album << " from " << song.artist << "("
-		<< song.runtime << ")";
-	return out;
-  }
-};
+// Snapshot of the current track, readable from any thread without locking
+static SeqLock<NowPlaying> nowPlaying;
+// Optional loopback api (--local-api), lives until the process exits
+static LocalApi *localApi = nullptr;
 
-std::string urlEncode(const std::string &value) {
-  std::ostringstream escaped;
-  escaped.fill('0');
-  escaped << std::hex;
-
-  for (std::string::value_type c : value) {
-	if (isalnum((unsigned char)c) || c == '-' || c == '_' || c == '.' ||
-		c == '~')
-	  escaped << c;
-	else {
-	  escaped << std::uppercase;
-	  escaped << '%' << std::setw(2) << int((unsigned char)c);
-	  escaped << std::nouppercase;
-	}
+/**
+ * @brief Publishes the state of <song> to <nowPlaying>, if it changed since the last call.
+ * Only called from the rpc thread.
+ */
+static void publishNowPlaying(const Song &song) {
+  static NowPlaying last{};
+  NowPlaying np;
+  memset(&np, 0, sizeof(np));
+
+  if (song.loaded) {
+	np.state = song.isPaused() ? NowPlaying::paused : NowPlaying::playing;
+	copyString(np.title, song.title);
+	copyString(np.artist, song.artist);
+	copyString(np.album, song.album);
+	copyString(np.coverId, song.cover_id);
+	copyString(np.id, song.id);
+	np.startTime = song.starttime;
+	np.endTime = song.isPaused() ? 0 : song.endtime();
+	np.runtime = song.runtime;
+	np.repeatCount = song.repeatCount;
+	np.trackNumber = song.trackNumber;
+	np.volumeNumber = song.volumeNumber;
+	np.isHighRes = song.isHighRes();
   }
-  return escaped.str();
+
+  if (memcmp(&np, &last, sizeof(np)) == 0) return;
+  last = np;
+  nowPlaying.store(np);
+  if (localApi) localApi->publish(np);
 }
 
 struct Application {
   struct IDiscordCore *core;
   struct IDiscordUsers *users;
-  bool isDiscordOK = false;
+  std::atomic<bool> isDiscordOK{false};
 };
 
 struct Application app;
@@ -129,74 +154,22 @@ struct Application app;
 static void updateDiscordPresence(const Song &song) {
   if (!app.isDiscordOK) return;
 
-  struct IDiscordActivityManager *manager =
-	  app.core->get_activity_manager(app.core);
-
-  if (isPresenceActive && song.loaded && !song.isPaused) {
-	struct DiscordActivityTimestamps timestamps{};
-	memset(&timestamps, 0, sizeof(timestamps));
-	timestamps.start = song.starttime;
-	timestamps.end = song.endtime();
-
-	struct DiscordActivity activity{
-		DiscordActivityType_Listening
-	};
-	memset(&activity, 0, sizeof(activity));
-	activity.type = DiscordActivityType_Listening;
-	activity.application_id = APPLICATION_ID;
-	snprintf(activity.details, 128, "%s - %s", song.title.c_str(), song.artist.c_str());
-	snprintf(activity.state, 128, ""); // empty, so that the text box isn't taller than the cover image
-
-	struct DiscordActivityAssets assets{};
-	memset(&assets, 0, sizeof(assets));
-	activity.timestamps = timestamps;
-
-	// Get url of album picture
-	auto cover_id_url = song.cover_id;
-	std::replace(cover_id_url.begin(), cover_id_url.end(), '-', '/');
-	auto cover_url = "https://resources.tidal.com/images/" + cover_id_url + "/1280x1280.jpg";
-	std::cout << cover_url << "\n";
-
-	snprintf(assets.large_image, 128, "%s", cover_url.c_str());
-	snprintf(assets.large_text, 128, "Album: %s", song.album.c_str());
-
-	snprintf(assets.small_image, 128, "%s", TIDAL_LOGO_URL.c_str());
-	snprintf(assets.small_text, 128, "%s", "Streaming on TIDAL");
-
-	if (song.id[0] != '\0') {
-	  struct DiscordActivitySecrets secrets{};
-	  memset(&secrets, 0, sizeof(secrets));
-	  snprintf(secrets.join, 128, "%s", song.id);
-	  activity.secrets = secrets;
-	}
-	activity.assets = assets;
-
-	activity.instance = false;
-
-	manager->update_activity(manager, &activity, nullptr, nullptr);
-  } else {
-	//        std::clog << "Clearing activity\n";
-	// manager->clear_activity(manager, nullptr, nullptr);
-	struct DiscordActivity activity {
-	  DiscordActivityType_Listening
-	};
-	memset(&activity, 0, sizeof(activity));
-	activity.type = DiscordActivityType_Listening;
-	activity.application_id = APPLICATION_ID;
-	snprintf(activity.details, 128, "Idle");
-	snprintf(activity.state, 128, "");
-	struct DiscordActivityAssets assets {};
-	memset(&assets, 0, sizeof(assets));
-	snprintf(assets.large_image, 128, "%s", TIDAL_LOGO_URL.c_str());
-	snprintf(assets.large_text, 128, "%s", "TIDAL");
-	activity.assets = assets;
-	activity.instance = false;
-	manager->update_activity(manager, &activity, nullptr, nullptr);
+  // sent from the pump thread, whichever thread this is called on
+  auto &activity = presenceActivity(song);
+  DiscordPump::instance().update(activity);
+
+  if (song.loaded && !isFirstPresenceSent.exchange(true)) {
+	logStartupMilestone("first presence");
   }
 }
 
+/**
+ * @brief Creates the core, on the pump thread
+ */
 static void discordInit() {
-  memset(&app, 0, sizeof(app));
+  app.core = nullptr;
+  app.users = nullptr;
+  app.isDiscordOK = false;
 
   IDiscordCoreEvents events;
   memset(&events, 0, sizeof(events));
@@ -211,199 +184,344 @@ static void discordInit() {
   auto result = DiscordCreate(DISCORD_VERSION, &params, &app.core);
   if (result == DiscordResult_Ok) {
 	app.isDiscordOK = true;
+	DiscordPump::instance().setCore(app.core);
   }
 
   auto user_manager = &app.core->get_user_manager;
 
-  std::lock_guard<std::mutex> lock(currentSongMutex);
-  currentStatus = "Connected to Discord";
+  setStatus("Connected to Discord");
 }
 
-[[noreturn]] inline void rpcLoop() {
-  using json = nlohmann::json;
-  using string = std::string;
-  httplib::Client cli("api.tidal.com", 80, 3);
-  char getSongInfoBuf[1024];
-  json j;
-  static Song curSong;
-  int kill_timeout = 0;
-
-  for (;;) {
-	bool kill_discord = false;
-
-	if (isPresenceActive) {
-	  std::wstring tmpTrack, tmpArtist;
-	  auto localStatus = tidalInfo(tmpTrack, tmpArtist);
-
-	  // If song is playing
-	  if (localStatus == playing) {
-		// only init if something is playing
-		if (!app.isDiscordOK) {
-		  discordInit();
-		  std::clog << "Discord Initialized\n";
-		  if (!app.isDiscordOK) {
-			std::this_thread::sleep_for(std::chrono::seconds(2));
-			continue;
-		  }
-		}
-
-		// if new song is playing
-		if (rawWstringToString(tmpTrack) != curSong.title || rawWstringToString(tmpArtist) != curSong.artist) {
-		  // assign new info to current track
-		  curSong.title = rawWstringToString(tmpTrack);
-		  curSong.artist = rawWstringToString(tmpArtist);
-
-		  curSong.runtime = 0;
-		  curSong.pausedtime = 0;
-		  curSong.repeatCount = 0;
-		  curSong.setQuality("");
-		  curSong.id[0] = '\0';
-		  curSong.loaded = true;
-
-		  std::lock_guard<std::mutex> lock(currentSongMutex);
-		  currentStatus = "Playing " + curSong.title;
-
-		  // get info form TIDAL api
-		  auto search_param = std::string(curSong.title + " - " + curSong.artist.substr(0, curSong.artist.find('&')));
-
-		  sprintf(getSongInfoBuf, "/v1/search?query=%s&limit=50&offset=0&types=TRACKS&countryCode=%s",
-				  urlEncode(search_param).c_str(), countryCode ? countryCode : "US");
-
-		  std::clog << "Querying :" << getSongInfoBuf << "\n";
-
-		  httplib::Headers headers = {{"x-tidal-token", "zU4XHVVkc2tDPo4t"}};
-		  auto res = cli.Get(getSongInfoBuf, headers);
-
-		  if (res && res->status == 200) {
-			try {
-			  j = json::parse(res->body);
-			  bool isSongSet = false;
-			  unsigned int lastAlbumDate = 0;
-			  for (auto i = 0u;
-				   i < j["tracks"]["totalNumberOfItems"].get<unsigned>(); i++) {
-				// convert title from windows and from tidal api to strings,
-				// json lib doesn't support wide string so wstrings are pared as
-				// strings and have the same convention errors
-				auto fetched_str =
-					j["tracks"]["items"][i]["title"].get<std::string>();
-				auto c_str = rawWstringToString(tmpTrack);
-
-				if (fetched_str == c_str) {
-				  if (curSong.runtime == 0 || j["tracks"]["items"][i]["audioQuality"].get<std::string>()
-					  == "HI_RES") { // Ignore songs with same name if you have found
-					// song
-					if (!isSongSet) {
-					  curSong.setQuality(j["tracks"]["items"][i]["audioQuality"].get<std::string>());
-					  curSong.trackNumber = j["tracks"]["items"][i]["trackNumber"].get<uint_fast8_t>();
-					  curSong.volumeNumber = j["tracks"]["items"][i]["volumeNumber"].get<uint_fast8_t>();
-					  curSong.runtime = j["tracks"]["items"][i]["duration"].get<int64_t>();
-					  sprintf(curSong.id, "%u", j["tracks"]["items"][i]["id"].get<unsigned>());
-					}
-
-					// find the newest album
-					int year = 0, month = 0, day = 0;
-					std::clog << j["tracks"]["items"][i]["album"]["releaseDate"].get<std::string>().c_str() << std::endl << std::flush;
-					sscanf(j["tracks"]["items"][i]["album"]["releaseDate"].get<std::string>().c_str(), "%d-%d-%d", &year, &month, &day);
-					unsigned int albumDate = year * 10000 + month * 100 + day;
-					if (albumDate > lastAlbumDate) {
-					  curSong.cover_id = j["tracks"]["items"][i]["album"]["cover"].get<std::string>();
-					  curSong.album = j["tracks"]["items"][i]["album"]["title"].get<std::string>();
-					  lastAlbumDate = albumDate;
-					}
-
-					if (curSong.isHighRes()) {
-					  isSongSet = true; // keep searching for high-res version.
-					}
-				  }
-				}
-			  }
-			} catch (...) {
-			  std::cerr << "Error getting info from api: " << curSong << "\n";
-			}
-		  } else {
-			std::clog << "Did not get results\n";
-		  }
-
-#ifdef DEBUG
-		  std::clog << curSong.title << "\tFrom: " << curSong.artist << "\n";
+class DiscordSink : public PresenceSink {
+ public:
+  bool isConnected() const override { return app.isDiscordOK; }
+
+  bool connect() override {
+	auto isConnected = DiscordPump::instance().call([]() {
+	  discordInit();
+	  return app.isDiscordOK.load();
+	});
+	LOG_INFO("Discord Initialized");
+	return isConnected;
+  }
+
+  void update(const Song &song) override { updateDiscordPresence(song); }
+
+  // the pump runs them, as often as pending updates need
+  void runCallbacks() override {}
+
+  void release() override {
+	auto &pump = DiscordPump::instance();
+	pump.call([&pump]() {
+	  struct IDiscordActivityManager *manager = app.core->get_activity_manager(app.core);
+	  manager->clear_activity(manager, nullptr, nullptr);
+	  pump.setCore(nullptr);
+	  app.core->destroy(app.core);
+	  app.core = nullptr;
+	  app.isDiscordOK = false;
+	});
+
+	auto metrics = pump.metrics();
+	LOG_INFO("Presence updates: ", metrics.sent, " sent, ", metrics.acknowledged, " acknowledged in ",
+			 metrics.acknowledged ? metrics.totalAckMs / metrics.acknowledged : 0, " ms avg / ",
+			 metrics.maxAckMs, " ms max");
+	LOG_INFO("Presence updates: ", metrics.failed, " failed, ", metrics.timedOut, " timed out, ",
+			 metrics.retried, " retried, ", metrics.superseded, " superseded");
+  }
+};
+
+/**
+ * @brief Queries api.tidal.com over a single kept alive connection, one query at a time
+ */
+static ApiQuery tidalApi() {
+#ifdef CPPHTTPLIB_OPENSSL_SUPPORT
+  // TLS sessions are resumed and the connection kept alive, so only the very
+  // first query pays for a full handshake
+  auto cli = std::make_shared<httplib::SSLClient>("api.tidal.com", 443, 3);
+  // against the system's trusted roots, host name included
+  cli->enable_server_certificate_verification(true);
+#else
+  auto cli = std::make_shared<httplib::Client>("api.tidal.com", 80, 3);
 #endif
+  cli->set_keep_alive(true);
+  cli->set_decompress(true);
+  // the resolver revalidates in the background while the loop may be querying
+  auto mutex = std::make_shared<std::mutex>();
+
+  return [cli, mutex](const std::string &path, const httplib::Headers &extraHeaders) {
+	httplib::Headers headers = extraHeaders;
+	headers.emplace("x-tidal-token", "zU4XHVVkc2tDPo4t");
+	std::lock_guard<std::mutex> lock(*mutex);
+	auto wireBytes = cli->get_stats().bytes_on_wire;
+	auto res = cli->Get(path.c_str(), headers);
+	if (res) {
+	  LOG_INFO("Got ", res->body.size(), " bytes (", cli->get_stats().bytes_on_wire - wireBytes, " on the wire)");
+	}
+	return res;
+  };
+}
 
-		  // get time just before passing it to RPC handlers
-		  curSong.starttime =
-			  CURRENT_TIME +
-				  2; // add 2 seconds to be more accurate, not a chance
-		  updateDiscordPresence(curSong);
-		} else {
-		  if (curSong.isPaused) {
-			curSong.isPaused = false;
-			updateDiscordPresence(curSong);
-
-			std::lock_guard<std::mutex> lock(currentSongMutex);
-			currentStatus = "Playing " + curSong.title;
-		  }
-		  if (CURRENT_TIME > curSong.endtime()) {
-			curSong.starttime = CURRENT_TIME;
-			curSong.pausedtime = 0;
-			curSong.repeatCount += 1;
-			updateDiscordPresence(curSong);
-		  }
-		}
-
-	  } else if (localStatus == opened) {
-		curSong.pausedtime += 1;
-		curSong.isPaused = true;
-		updateDiscordPresence(curSong);
-		kill_discord = true;
-
-		std::lock_guard<std::mutex> lock(currentSongMutex);
-		currentStatus = "Paused " + curSong.title;
-	  } else {
-		curSong = Song();
-		updateDiscordPresence(curSong);
-		kill_discord = true;
-
-		std::lock_guard<std::mutex> lock(currentSongMutex);
-		currentStatus = "Waiting for Tidal";
+#ifdef __linux__
+/**
+ * @brief Real time clock whose sleeps are cut short when TIDAL starts or exits
+ */
+class TidalProcessClock : public SystemClock {
+  public:
+	void sleepFor(duration timeout) override {
+	  // with the player closed and no TIDAL process the sleep can wait for it to start, the cap
+	  // only covers wrappers running under a process name other than the known ones
+	  if (isPlayerClosed_ && !watcher_.isRunning()) {
+		timeout = std::chrono::seconds(30);
 	  }
+	  watcher_.waitForChange(timeout);
 	}
 
-	if (app.isDiscordOK) {
-	  if (!isPresenceActive) {
-		kill_discord = true;
-		curSong = Song();
-		updateDiscordPresence(curSong);
+	/// @brief Whether the last poll found the player closed, see <LoopIo::polled>
+	void setPlayerClosed(bool isClosed) { isPlayerClosed_ = isClosed; }
 
-		std::lock_guard<std::mutex> lock(currentSongMutex);
-		currentStatus = "Disabled";
-	  }
+  private:
+	ProcessWatcher watcher_{TIDAL_PROCESS_NAMES};
+	bool isPlayerClosed_ = false;
+};
+#endif
 
-	  enum EDiscordResult result = app.core->run_callbacks(app.core);
-	  if (result != DiscordResult_Ok) {
-		std::clog << "Bad result " << result << "\n";
-	  }
+/**
+ * @brief Spreads concurrent queries over <size> connections of their own, an httplib client
+ * can't be shared between threads
+ */
+static ApiQuery pooledApi(size_t size) {
+  struct Pool {
+	std::mutex mutex;
+	std::condition_variable released;
+	std::vector<ApiQuery> idle;
+  };
+  auto pool = std::make_shared<Pool>();
+  for (size_t i = 0; i < size; i++) pool->idle.push_back(tidalApi());
+
+  return [pool](const std::string &path, const httplib::Headers &headers) {
+	ApiQuery api;
+	{
+	  std::unique_lock<std::mutex> lock(pool->mutex);
+	  pool->released.wait(lock, [&pool]() { return !pool->idle.empty(); });
+	  api = std::move(pool->idle.back());
+	  pool->idle.pop_back();
+	}
+	auto res = api(path, headers);
+	{
+	  std::lock_guard<std::mutex> lock(pool->mutex);
+	  pool->idle.push_back(std::move(api));
+	}
+	pool->released.notify_one();
+	return res;
+  };
+}
 
-	  if (!kill_discord) {
-		kill_timeout = 0;
-	  }
-	  else if (kill_timeout++ >= RPC_IDLE_TIMEOUT_SECONDS) {
-		struct IDiscordActivityManager* manager = app.core->get_activity_manager(app.core);
-		manager->clear_activity(manager, nullptr, nullptr);
-		app.core->destroy(app.core);
-		app.core = nullptr;
-		app.isDiscordOK = false;
-		kill_timeout = 0;
+/**
+ * @brief Lets at most <perSecond> queries through <api>, evenly spaced
+ */
+static ApiQuery rateLimited(ApiQuery api, double perSecond) {
+  struct Limit {
+	std::mutex mutex;
+	std::chrono::steady_clock::time_point next;
+  };
+  auto limit = std::make_shared<Limit>();
+  auto spacing = std::chrono::duration_cast<std::chrono::steady_clock::duration>(
+	  std::chrono::duration<double>(1.0 / perSecond));
+
+  return [api, limit, spacing](const std::string &path, const httplib::Headers &headers) {
+	std::chrono::steady_clock::time_point slot;
+	{
+	  std::lock_guard<std::mutex> lock(limit->mutex);
+	  slot = std::max(limit->next, std::chrono::steady_clock::now());
+	  limit->next = slot + spacing;
+	}
+	std::this_thread::sleep_until(slot);
+	return api(path, headers);
+  };
+}
+
+/**
+ * @brief Tracks listed in <path>: a journal (--record) gives what was played, any other file is
+ * read as lines of "title<tab>artist" or "title - artist". Duplicates are dropped.
+ */
+static bool readTrackList(const std::string &path, std::vector<std::pair<std::string, std::string>> &tracks) {
+  std::set<std::pair<std::string, std::string>> seen;
+  auto add = [&](std::string title, std::string artist) {
+	if (!title.empty() && !artist.empty() && seen.emplace(title, artist).second) {
+	  tracks.emplace_back(std::move(title), std::move(artist));
+	}
+  };
+
+  JournalReader journal;
+  if (journal.open(path)) {
+	JournalRecord record;
+	while (journal.next(record)) {
+	  if (record.type == JournalRecord::observation && record.strings.size() == 2) {
+		add(record.strings[0], record.strings[1]);
 	  }
 	}
+	return true;
+  }
 
-	std::this_thread::sleep_for(std::chrono::milliseconds(1000));
+  std::ifstream in(path);
+  if (!in) return false;
+  std::string line;
+  while (std::getline(in, line)) {
+	if (!line.empty() && line.back() == '\r') line.pop_back();
+	if (line.empty() || line[0] == '#') continue;
+
+	auto tab = line.find('\t');
+	auto dash = line.rfind(" - ");
+	if (tab != std::string::npos) {
+	  add(line.substr(0, tab), line.substr(tab + 1));
+	} else if (dash != std::string::npos) {
+	  add(line.substr(0, dash), line.substr(dash + 3));
+	}
   }
+  return true;
+}
+
+/**
+ * @brief Resolves every track of <listPath> into <cache> (--warm-cache), with <parallelism>
+ * lookups at a time and at most <rate> api queries per second. Tracks of the <seeds> index aren't
+ * queried for.
+ */
+static int warmCache(const std::string &listPath, TrackCache &cache, const SeedIndex &seeds, ApiQuery api,
+					 int parallelism, double rate) {
+  std::vector<std::pair<std::string, std::string>> tracks;
+  if (!readTrackList(listPath, tracks)) {
+	std::cerr << "Could not read " << listPath << std::endl;
+	return -1;
+  }
+
+  SystemClock clock;
+  auto cachedBefore = cache.size();
+  TrackResolver resolver(rate > 0 ? rateLimited(api, rate) : api, clock, countryCode ? countryCode : "US", &cache,
+						 &seeds);
+  // one reading after the other, the next one only if needed, for the fewest queries
+  resolver.setParallelism(1);
+
+  std::atomic<size_t> next{0}, found{0};
+  auto start = std::chrono::steady_clock::now();
+  std::vector<std::thread> workers;
+  for (int i = 0; i < parallelism; i++) {
+	workers.emplace_back([&]() {
+	  for (size_t track; (track = next++) < tracks.size();) {
+		if (resolver.resolve(tracks[track].first, tracks[track].second).isFound) found++;
+	  }
+	});
+  }
+  for (auto &worker : workers) worker.join();
+  auto seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+
+  std::cout << tracks.size() << " tracks, " << found << " resolved (" << cache.size() - cachedBefore
+			<< " new), " << resolver.upstreamCalls() << " api queries in " << std::fixed << std::setprecision(2)
+			<< seconds << " s, " << std::setprecision(1) << tracks.size() / std::max(seconds, 1e-3)
+			<< " tracks/s with " << parallelism << " at a time" << std::endl;
+  Logger::instance().flush();
+  return 0;
+}
+
+/**
+ * @brief Checks GitHub for a newer release and notifies through the tray.
+ * Runs asynchronously on the Qt event loop and gives up after UPDATE_CHECK_TIMEOUT_MS.
+ * The endpoint can be overridden with TIDAL_RPC_RELEASES_URL (e.g. a local stand-in).
+ */
+static void checkForUpdates(QSystemTrayIcon &tray) {
+  auto releasesUrl = qEnvironmentVariable("TIDAL_RPC_RELEASES_URL", LATEST_RELEASE_URL);
+
+  auto manager = new QNetworkAccessManager(&tray);
+  QNetworkRequest request;
+
+  QSslConfiguration config = QSslConfiguration::defaultConfiguration();
+  config.setProtocol(QSsl::TlsV1_2);
+  request.setSslConfiguration(config);
+  request.setUrl(QUrl(releasesUrl));
+  request.setHeader(QNetworkRequest::ServerHeader, "application/json");
+  request.setTransferTimeout(UPDATE_CHECK_TIMEOUT_MS);
+
+  QNetworkReply *reply = manager->get(request);
+  QObject::connect(reply, &QNetworkReply::finished, &tray, [reply, manager, &tray]() {
+	reply->deleteLater();
+	manager->deleteLater();
+	logStartupMilestone("update check finished");
+
+	if (reply->error() != QNetworkReply::NoError) return;
+
+	try {
+	  auto j = nlohmann::json::parse(reply->readAll().toStdString());
+
+	  if (j["tag_name"].get<std::string>() > (VERSION)) {
+		tray.showMessage("Tidal Discord RPC", "New Version Available!\nClick to download");
+		QObject::connect(&tray, &QSystemTrayIcon::messageClicked, &tray, []() {
+		  QDesktopServices::openUrl(QUrl("https://github.com/purpl3F0x/TIDAL-Discord-Rich-Presence-UNOFFICIAL/releases/latest",
+										 QUrl::TolerantMode));
+		});
+	  }
+	} catch (...) {
+	  //
+	}
+  });
 }
 
 int main(int argc, char **argv) {
+  startupTime = std::chrono::steady_clock::now();
+
+  const char *app_id = nullptr;
+  int localApiPort = 0;
+  std::string recordPath, replayPath;
+  double replaySpeed = 0;
+  static bool isAllClients = false;
+  std::string cachePath = TrackCache::defaultPath(), warmPath, exportPath, importPath, seedPath, buildSeedPath;
+  int warmParallelism = 4;
+  double warmRate = 10;
+
+  for (int i = 1; i < argc; i++) {
+	std::string arg = argv[i];
+	if (arg == "--local-api") {
+	  localApiPort = LOCAL_API_DEFAULT_PORT;
+	} else if (arg.rfind("--local-api=", 0) == 0) {
+	  localApiPort = std::atoi(arg.c_str() + 12);
+	  if (localApiPort <= 0 || localApiPort > 65535) {
+		std::cerr << "Invalid port for --local-api." << std::endl;
+		return -1;
+	  }
+	} else if (arg.rfind("--record=", 0) == 0) {
+	  recordPath = arg.substr(9);
+	} else if (arg.rfind("--replay=", 0) == 0) {
+	  replayPath = arg.substr(9);
+	} else if (arg.rfind("--replay-speed=", 0) == 0) {
+	  replaySpeed = std::atof(arg.c_str() + 15);
+	} else if (arg == "--all-clients") {
+	  isAllClients = true;
+	} else if (arg.rfind("--cache=", 0) == 0) {
+	  cachePath = arg.substr(8);
+	} else if (arg.rfind("--warm-cache=", 0) == 0) {
+	  warmPath = arg.substr(13);
+	} else if (arg == "--warm-cache" && i + 1 < argc) {
+	  warmPath = argv[++i];
+	} else if (arg.rfind("--export-cache=", 0) == 0) {
+	  exportPath = arg.substr(15);
+	} else if (arg.rfind("--import-cache=", 0) == 0) {
+	  importPath = arg.substr(15);
+	} else if (arg.rfind("--seed-index=", 0) == 0) {
+	  seedPath = arg.substr(13);
+	} else if (arg.rfind("--build-seed-index=", 0) == 0) {
+	  buildSeedPath = arg.substr(19);
+	} else if (arg.rfind("--warm-parallelism=", 0) == 0) {
+	  warmParallelism = std::max(1, std::atoi(arg.c_str() + 19));
+	} else if (arg.rfind("--warm-rate=", 0) == 0) {
+	  warmRate = std::atof(arg.c_str() + 12);
+	} else if (!app_id) {
+	  app_id = argv[i];
+	} else {
+	  std::cerr << "Too many arguments." << std::endl;
+	  return -1;
+	}
+  }
 
   // allow passing a custom application id (for custom "game" title)
-  if (argc == 2) {
-	const char* app_id = argv[1];
+  if (app_id) {
 	try {
 	  APPLICATION_ID = std::stoll(app_id);
 	}
@@ -412,15 +530,85 @@ int main(int argc, char **argv) {
 	  return -1;
 	}
   }
-  else if (argc > 2) {
-	std::cerr << "Too many arguments." << std::endl;
-	return -1;
-  }
 
   // get country code for TIDAL api queries
   countryCode = getLocale();
   isPresenceActive = true;
 
+  // headless, against a journal instead of TIDAL, the api and discord
+  if (!replayPath.empty()) {
+	SessionReplay replay;
+	if (!replay.load(replayPath)) {
+	  std::cerr << "Could not read journal " << replayPath << std::endl;
+	  return -1;
+	}
+	// with --record too the replay is journaled, to compare with the original
+	JournalWriter journal;
+	if (!recordPath.empty() && !journal.open(recordPath, replay.unixStart())) {
+	  std::cerr << "Could not create journal " << recordPath << std::endl;
+	  return -1;
+	}
+	replay.run(replaySpeed, countryCode ? countryCode : "US", &journal);
+	return 0;
+  }
+
+  // recordings have to show every request, so the cache is only used without one
+  static TrackCache trackCache;
+  if (recordPath.empty() && !trackCache.open(cachePath)) {
+	LOG_WARNING("Could not open the track cache ", cachePath);
+  }
+
+  // looked up before the api, next to the cache unless given
+  static SeedIndex seedIndex;
+  if (recordPath.empty()) {
+	std::error_code fsError;
+	auto path = seedPath.empty()
+				? std::filesystem::path(cachePath).replace_filename("seed.index").string() : seedPath;
+	std::string error;
+	if ((!seedPath.empty() || std::filesystem::exists(path, fsError)) && !seedIndex.open(path, error)) {
+	  LOG_WARNING("Ignoring the seed index ", path, ": ", error);
+	}
+  }
+
+  if (!warmPath.empty()) {
+	return warmCache(warmPath, trackCache, seedIndex, pooledApi(warmParallelism), warmParallelism, warmRate);
+  }
+
+  // snapshots of the cache, to seed it on other machines
+  if (!importPath.empty()) {
+	std::string error;
+	if (!trackCache.importSnapshot(importPath, error)) {
+	  std::cerr << "Could not import " << importPath << ": " << error << std::endl;
+	  return -1;
+	}
+	std::cout << "Imported " << importPath << ", " << trackCache.size() << " tracks cached" << std::endl;
+	return 0;
+  }
+  if (!exportPath.empty()) {
+	if (!trackCache.exportSnapshot(exportPath)) {
+	  std::cerr << "Could not export the track cache to " << exportPath << std::endl;
+	  return -1;
+	}
+	std::cout << "Exported the track cache to " << exportPath << std::endl;
+	return 0;
+  }
+  if (!buildSeedPath.empty()) {
+	std::string error;
+	auto tracks = trackCache.tracks();
+	if (!SeedIndex::build(buildSeedPath, tracks, error)) {
+	  std::cerr << "Could not build the seed index " << buildSeedPath << ": " << error << std::endl;
+	  return -1;
+	}
+	std::cout << "Built the seed index " << buildSeedPath << " of " << tracks.size() << " tracks" << std::endl;
+	return 0;
+  }
+
+  static JournalWriter journal;
+  if (!recordPath.empty() && !journal.open(recordPath, std::time(nullptr))) {
+	std::cerr << "Could not create journal " << recordPath << std::endl;
+	return -1;
+  }
+
   // Qt main app setup
   QApplication app(argc, argv);
   auto appIcon = QIcon(":assets/icon.ico");
@@ -441,9 +629,14 @@ int main(int argc, char **argv) {
 					 changePresenceStatusAction.setText(isPresenceActive ? "Running" : "Disabled (click to re-enable)");
 				   });
 
+  // the loop's presence, let go of on exit. Never destroyed, the loop's thread outlives main()
+  auto presence = new QuittablePresence(isAllClients ? static_cast<PresenceSink &>(*new DiscordIpcSink())
+													 : *new DiscordSink());
+  QObject::connect(&app, &QApplication::aboutToQuit, [presence]() { presence->quit(); });
+
   QAction quitAction("Exit", nullptr);
-  QObject::connect(&quitAction, &QAction::triggered, [&app]() {
-	updateDiscordPresence(Song());
+  QObject::connect(&quitAction, &QAction::triggered, [&app, presence]() {
+	presence->quit();
 	app.quit();
   });
 
@@ -460,38 +653,7 @@ int main(int argc, char **argv) {
   tray.setContextMenu(&trayMenu);
 
   tray.show();
-
-  // Check for new App version
-  try {
-
-	QNetworkAccessManager *manager = new QNetworkAccessManager();
-	QNetworkRequest request;
-	QNetworkReply *reply = nullptr;
-
-	QSslConfiguration config = QSslConfiguration::defaultConfiguration();
-	config.setProtocol(QSsl::TlsV1_2);
-	request.setSslConfiguration(config);
-	request.setUrl(QUrl("https://api.github.com/repos/purpl3F0x/TIDAL-Discord-Rich-Presence-UNOFFICIAL/releases/latest"));
-	request.setHeader(QNetworkRequest::ServerHeader, "application/json");
-
-	reply = manager->get(request);
-	QEventLoop loop;
-	QObject::connect(reply, &QIODevice::readyRead, &loop, &QEventLoop::quit);
-	loop.exec();
-	nlohmann::json j;
-	j = nlohmann::json::parse(reply->readAll().toStdString());
-
-	if (j["tag_name"].get<std::string>() > (VERSION)) {
-	  tray.showMessage("Tidal Discord RPC", "New Version Available!\nClick to download");
-	  QObject::connect(&tray, &QSystemTrayIcon::messageClicked, &app, []() {
-		QDesktopServices::openUrl(QUrl("https://github.com/purpl3F0x/TIDAL-Discord-Rich-Presence-UNOFFICIAL/releases/latest",
-									   QUrl::TolerantMode));
-	  });
-	}
-
-  } catch (...) {
-	//
-  }
+  logStartupMilestone("tray shown");
 
 #if defined(__APPLE__) or defined(__MACH__)
   if (!macPerms())
@@ -500,22 +662,59 @@ int main(int argc, char **argv) {
   }
 #endif
 
-  QTimer timer(&app);
-  QObject::connect(&timer, &QTimer::timeout, &app, [&currentlyPlayingAction]() {
-	std::lock_guard<std::mutex> lock(currentSongMutex);
-	currentlyPlayingAction.setText("Status: " + QString(currentStatus.c_str()));
-  });
-  timer.start(1000);
-
+  statusAction = &currentlyPlayingAction;
   QObject::connect(&app, &QApplication::aboutToQuit,
-				   [&timer]() { timer.stop(); });
+				   []() { statusAction = nullptr; });
 
   // discordInit();
   // std::clog << "Discord Initialized\n";
 
+  // Loopback now-playing api for stream overlays
+  if (localApiPort) {
+	localApi = new LocalApi();
+	if (localApi->start("127.0.0.1", localApiPort)) {
+	  LOG_INFO("Local api listening on http://127.0.0.1:", localApiPort, "/now-playing");
+	  QObject::connect(&app, &QApplication::aboutToQuit, []() { localApi->stop(); });
+	} else {
+	  std::cerr << "Could not start the local api on port " << localApiPort << "\n";
+	  delete localApi;
+	  localApi = nullptr;
+	}
+  }
+
   // RPC loop call
-  std::thread t1(rpcLoop);
+  std::thread t1([presence]() {
+#ifdef __linux__
+	// wakes the loop up when TIDAL starts or exits, instead of polling for it
+	TidalProcessClock clock;
+#else
+	SystemClock clock;
+#endif
+	LoopIo io;
+	// readings of an ambiguous title are searched for at once, unless each request is recorded
+	io.queryApi = journal.isOpen() ? tidalApi() : pooledApi(TrackResolver::MAX_VARIANTS);
+	io.presence = presence;
+	io.isFinished = [presence]() { return presence->isQuit(); };
+	io.showStatus = setStatus;
+	io.published = publishNowPlaying;
+#ifdef __linux__
+	io.polled = [&clock](PollScheduler::State state) { clock.setPlayerClosed(state == PollScheduler::State::closed); };
+#endif
+
+	SessionRecorder recorder(journal, clock);
+	if (journal.isOpen()) recorder.attach(io);
+	// after attaching, so the recorder sees the requests
+	TrackResolver resolver(io.queryApi, clock, countryCode ? countryCode : "US",
+						   journal.isOpen() ? nullptr : &trackCache, journal.isOpen() ? nullptr : &seedIndex);
+	if (!journal.isOpen()) resolver.setParallelism(TrackResolver::MAX_VARIANTS);
+	io.resolver = &resolver;
+
+	rpcLoop(clock, io);
+  });
   t1.detach();
 
+  // Check for new App version, once the event loop is up
+  QTimer::singleShot(0, &tray, [&tray]() { checkForUpdates(tray); });
+
   return app.exec();
 }
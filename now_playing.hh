@@ -0,0 +1,142 @@
+/**
+ * @file    now_playing.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <cstring>
+#include <string>
+#include <type_traits>
+#include <thread>
+
+
+/**
+ * @brief Single writer / many readers publication of a trivially copyable value (seqlock).
+ * The writer never waits for readers, readers never block each other and retry
+ * if a write happened while they were copying. The value is kept in atomic words
+ * so that racing copies are well defined.
+ */
+template<typename T>
+class SeqLock {
+    static_assert(std::is_trivially_copyable<T>::value, "SeqLock needs a trivially copyable type");
+
+  public:
+    SeqLock() noexcept {
+        for (auto &word : words_)
+            word.store(0, std::memory_order_relaxed);
+    }
+
+    /**
+     * @brief Publishes a new value, must only be called from a single thread
+     */
+    void store(const T &value) noexcept {
+        uint64_t buffer[WORDS] = {};
+        std::memcpy(buffer, &value, sizeof(T));
+
+        auto seq = seq_.load(std::memory_order_relaxed);
+        seq_.store(seq + 1, std::memory_order_relaxed);
+        std::atomic_thread_fence(std::memory_order_release);
+
+        for (size_t i = 0; i < WORDS; i++)
+            words_[i].store(buffer[i], std::memory_order_relaxed);
+
+        seq_.store(seq + 2, std::memory_order_release);
+    }
+
+    /**
+     * @brief Copies out the latest value
+     * @param version Set to the version of the returned value
+     */
+    T load(uint64_t &version) const noexcept {
+        uint64_t buffer[WORDS];
+
+        for (;;) {
+            auto seq = seq_.load(std::memory_order_acquire);
+            if (seq & 1u) {
+                std::this_thread::yield();
+                continue;
+            }
+
+            for (size_t i = 0; i < WORDS; i++)
+                buffer[i] = words_[i].load(std::memory_order_relaxed);
+
+            std::atomic_thread_fence(std::memory_order_acquire);
+            if (seq_.load(std::memory_order_relaxed) == seq) {
+                version = seq / 2;
+                break;
+            }
+        }
+
+        T value;
+        std::memcpy(&value, buffer, sizeof(T));
+        return value;
+    }
+
+    T load() const noexcept {
+        uint64_t version;
+        return load(version);
+    }
+
+    /**
+     * @brief Copies out the value only if it changed since <seen>
+     * @return false (and no copy) when nothing was published in between
+     */
+    bool loadIfNewer(uint64_t &seen, T &value) const noexcept {
+        if (version() == seen)
+            return false;
+        value = load(seen);
+        return true;
+    }
+
+    /// @brief Number of values published so far
+    uint64_t version() const noexcept { return seq_.load(std::memory_order_acquire) / 2; }
+
+  private:
+    static constexpr size_t WORDS = (sizeof(T) + sizeof(uint64_t) - 1) / sizeof(uint64_t);
+
+    alignas(64) std::atomic<uint64_t> seq_{0};
+    std::atomic<uint64_t> words_[WORDS];
+};
+
+
+/**
+ * @brief Compact, fixed size copy of the current track state that can be read from any thread
+ */
+struct NowPlaying {
+    enum State : uint8_t { stopped, playing, paused };
+
+    char title[128];
+    char artist[128];
+    char album[128];
+    char coverId[48];
+    char id[16];
+    int64_t startTime;  ///< unix time
+    int64_t endTime;    ///< unix time, 0 if unknown
+    int64_t runtime;    ///< seconds
+    uint64_t repeatCount;
+    uint8_t trackNumber;
+    uint8_t volumeNumber;
+    State state;
+    bool isHighRes;
+};
+
+
+/**
+ * @brief Copies a std::string into a fixed size buffer, truncating on a utf-8 character boundary
+ */
+template<size_t N>
+inline void copyString(char (&dest)[N], const std::string &src) noexcept {
+    auto len = src.size() < N - 1 ? src.size() : N - 1;
+    if (len < src.size())
+        while (len > 0 && (static_cast<unsigned char>(src[len]) & 0xC0u) == 0x80u)
+            len--;
+
+    std::memcpy(dest, src.data(), len);
+    std::memset(dest + len, 0, N - len);
+}
@@ -0,0 +1,95 @@
+/**
+ * @file    playback_tracker.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+
+
+/**
+ * @brief Position within the current track, based on a monotonic clock.
+ *
+ * Only state transitions are recorded, with the time they were observed at, so the position stays
+ * exact however rarely it is sampled. Time points are passed in rather than read, which keeps the
+ * tracker deterministic under a virtual clock.
+ */
+class PlaybackTracker {
+  public:
+    using clock = std::chrono::steady_clock;
+    using duration = std::chrono::milliseconds;
+
+    /// @brief A new track started playing from the beginning at <now>
+    void start(clock::time_point now) noexcept {
+        origin_ = now;
+        pausedAt_ = now;
+        isPaused_ = false;
+        slack_ = duration::zero();
+    }
+
+    void pause(clock::time_point now) noexcept {
+        if (isPaused_)
+            return;
+        pausedAt_ = now;
+        isPaused_ = true;
+    }
+
+    /**
+     * @brief A pause noticed at <now> that may have happened any time after <playingAt>, when it
+     * was last seen playing. The position may be ahead by that much until the next track.
+     */
+    void pause(clock::time_point now, clock::time_point playingAt) noexcept {
+        if (isPaused_)
+            return;
+        slack_ += std::chrono::duration_cast<duration>(now - std::min(playingAt, now));
+        pause(now);
+    }
+
+    void resume(clock::time_point now) noexcept {
+        if (!isPaused_)
+            return;
+        // the pause shifts the whole timeline
+        origin_ += now - pausedAt_;
+        isPaused_ = false;
+    }
+
+    /// @brief Jumps to <position>, e.g. when the player reports a seek
+    void seek(duration position, clock::time_point now) noexcept {
+        origin_ = (isPaused_ ? pausedAt_ : now) - position;
+    }
+
+    duration position(clock::time_point now) const noexcept {
+        return std::chrono::duration_cast<duration>((isPaused_ ? pausedAt_ : now) - origin_);
+    }
+
+    /**
+     * @brief Wraps around to the start if the track of length <runtime> ended (repeat), for sure:
+     * the position has to be past the end by the <slack> of pauses as well
+     * @return how many times it ended since the last call. The time played past the end is kept,
+     * however late this is called
+     */
+    int64_t wrap(duration runtime, clock::time_point now) noexcept {
+        auto played = position(now) - slack_;
+        if (runtime.count() <= 0 || played < runtime)
+            return 0;
+        auto loops = played / runtime;
+        origin_ += runtime * loops;
+        return loops;
+    }
+
+    /// @brief How far <position> may be ahead, because pauses were noticed late
+    duration slack() const noexcept { return slack_; }
+
+    bool isPaused() const noexcept { return isPaused_; }
+
+  private:
+    clock::time_point origin_{};    ///< when the track was (virtually) at position 0
+    clock::time_point pausedAt_{};  ///< valid while <isPaused_>
+    bool isPaused_ = false;
+    duration slack_{0};
+};
@@ -0,0 +1,86 @@
+/**
+ * @file    poll_scheduler.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <chrono>
+
+
+/**
+ * @brief Picks how long the rpc loop sleeps between two polls of the player.
+ *
+ * Right after something changed the player is polled every second, since more changes (skipping
+ * through tracks, pause/resume) tend to follow. Once things settle the interval grows with the
+ * state: closed or paused for a while polls rarely, playing moderately but always wakes up at the
+ * predicted end of the track so repeats are noticed on time.
+ * Like <PlaybackTracker> time points are passed in.
+ */
+class PollScheduler {
+  public:
+    using clock = std::chrono::steady_clock;
+    using duration = std::chrono::milliseconds;
+
+    enum class State { unknown, closed, paused, playing };
+
+    static constexpr duration ACTIVE_INTERVAL{1000};
+    static constexpr duration PLAYING_INTERVAL{2000};
+    static constexpr duration IDLE_INTERVAL{5000};
+    /// after a change polls stay at <ACTIVE_INTERVAL> for this long
+    static constexpr duration SETTLE_TIME{15000};
+    /// paused for longer than this counts as idle
+    static constexpr duration PAUSED_IDLE_TIME{60000};
+    /// wake up this much after the predicted end, so the player has moved on for sure
+    static constexpr duration END_MARGIN{250};
+
+    /**
+     * @brief Records the result of a poll
+     * @param trackChanged A different track showed up without the state changing
+     */
+    void observe(State state, bool trackChanged, clock::time_point now) noexcept {
+        if (state != state_ || trackChanged)
+            changedAt_ = now;
+        state_ = state;
+    }
+
+    /// @brief What the last poll found
+    State state() const noexcept { return state_; }
+
+    /**
+     * @brief How long to sleep before the next poll
+     * @param untilTrackEnd Time left of the playing track, duration::max() if unknown
+     */
+    duration next(clock::time_point now, duration untilTrackEnd = duration::max()) const noexcept {
+        auto sinceChange = std::chrono::duration_cast<duration>(now - changedAt_);
+
+        duration interval;
+        switch (state_) {
+            case State::closed:
+                interval = IDLE_INTERVAL;
+                break;
+            case State::paused:
+                interval = sinceChange < PAUSED_IDLE_TIME ? ACTIVE_INTERVAL : IDLE_INTERVAL;
+                break;
+            case State::playing:
+                interval = PLAYING_INTERVAL;
+                break;
+            default:
+                return ACTIVE_INTERVAL;
+        }
+
+        if (sinceChange < SETTLE_TIME)
+            interval = ACTIVE_INTERVAL;
+
+        if (state_ == State::playing && untilTrackEnd != duration::max())
+            interval = std::min(interval, std::max(untilTrackEnd, duration::zero()) + END_MARGIN);
+        return interval;
+    }
+
+  private:
+    State state_ = State::unknown;
+    clock::time_point changedAt_{};
+};
@@ -0,0 +1,260 @@
+/**
+ * @file    process_watcher.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+#ifdef __linux__
+
+// cpp libs
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <chrono>
+#include <cstdlib>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <vector>
+// linux
+#include <dirent.h>
+#include <linux/cn_proc.h>
+#include <linux/connector.h>
+#include <linux/netlink.h>
+#include <poll.h>
+#include <signal.h>
+#include <sys/socket.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+#ifndef SYS_pidfd_open
+#define SYS_pidfd_open 434
+#endif
+
+
+/**
+ * @brief Tracks the processes of the player on linux, without periodic work.
+ *
+ * Starts are reported by the kernel proc connector (exec and comm changes), exits through a
+ * pidfd per process. Listening to the proc connector needs CAP_NET_ADMIN, without it (and for
+ * kernels without pidfd_open, < 5.3) /proc is rescanned every <RESCAN_INTERVAL> instead.
+ * procfs doesn't generate inotify events, so there is no cheaper fallback.
+ */
+class ProcessWatcher {
+  public:
+    static constexpr std::chrono::milliseconds RESCAN_INTERVAL{3000};
+
+    /**
+     * @param names Process names (/proc/<pid>/comm) of the player, matched exactly. Our own process
+     *  never counts, whatever it is called.
+     */
+    explicit ProcessWatcher(std::vector<std::string> names) : names_(std::move(names)), self_(getpid()) {
+        // subscribe before the first scan, so a start in between isn't missed
+        listen();
+        scan();
+    }
+
+    ~ProcessWatcher() {
+        for (auto &process : processes_)
+            if (process.fd >= 0)
+                close(process.fd);
+        if (netlink_ >= 0)
+            close(netlink_);
+    }
+
+    ProcessWatcher(const ProcessWatcher &) = delete;
+    ProcessWatcher &operator=(const ProcessWatcher &) = delete;
+
+    bool isRunning() const noexcept { return !processes_.empty(); }
+
+    /// @brief true if starts are reported by the kernel rather than found by rescanning
+    bool isEventDriven() const noexcept { return netlink_ >= 0; }
+
+    /**
+     * @brief Sleeps up to <timeout>, returning as soon as the player starts or exits
+     * @return true if <isRunning> changed
+     */
+    bool waitForChange(std::chrono::milliseconds timeout) {
+        auto wasRunning = isRunning();
+        auto deadline = std::chrono::steady_clock::now() + timeout;
+
+        for (;;) {
+            auto now = std::chrono::steady_clock::now();
+            if (now >= deadline)
+                return false;
+
+            auto wait = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - now);
+            if (needsPolling())
+                wait = std::min(wait, RESCAN_INTERVAL);
+
+            std::vector<pollfd> fds;
+            if (netlink_ >= 0)
+                fds.push_back({netlink_, POLLIN, 0});
+            for (auto &process : processes_)
+                if (process.fd >= 0)
+                    fds.push_back({process.fd, POLLIN, 0});
+
+            poll(fds.data(), fds.size(), static_cast<int>(wait.count()));
+
+            if (netlink_ >= 0)
+                receive();
+            reap();
+            if (netlink_ < 0 && !isRunning())
+                scan();
+
+            if (isRunning() != wasRunning)
+                return true;
+        }
+    }
+
+  private:
+    struct Process {
+        pid_t pid;
+        int fd;  ///< pidfd, -1 if not supported
+    };
+
+    bool matches(pid_t pid) const {
+        if (pid == self_)
+            return false;
+        std::ifstream comm("/proc/" + std::to_string(pid) + "/comm");
+        std::string name;
+        return std::getline(comm, name) && std::find(names_.begin(), names_.end(), name) != names_.end();
+    }
+
+    /// @brief Whether starts or exits can only be noticed by looking again
+    bool needsPolling() const noexcept {
+        if (netlink_ < 0 && !isRunning())
+            return true;
+        return std::any_of(processes_.begin(), processes_.end(), [](const Process &p) { return p.fd < 0; });
+    }
+
+    void add(pid_t pid) {
+        for (auto &process : processes_)
+            if (process.pid == pid)
+                return;
+
+        auto fd = static_cast<int>(syscall(SYS_pidfd_open, pid, 0));
+        processes_.push_back({pid, fd});
+    }
+
+    /// @brief Drops processes that exited
+    void reap() {
+        processes_.erase(std::remove_if(processes_.begin(), processes_.end(), [](const Process &process) {
+            if (process.fd >= 0) {
+                pollfd fd{process.fd, POLLIN, 0};
+                if (poll(&fd, 1, 0) <= 0)
+                    return false;
+                close(process.fd);
+                return true;
+            }
+            return kill(process.pid, 0) != 0 && errno == ESRCH;
+        }), processes_.end());
+    }
+
+    void scan() {
+        auto dir = opendir("/proc");
+        if (!dir)
+            return;
+
+        while (auto entry = readdir(dir)) {
+            if (!std::isdigit(static_cast<unsigned char>(entry->d_name[0])))
+                continue;
+            auto pid = static_cast<pid_t>(std::atoi(entry->d_name));
+            if (matches(pid))
+                add(pid);
+        }
+        closedir(dir);
+        reap();
+    }
+
+    void listen() {
+        netlink_ = socket(PF_NETLINK, SOCK_DGRAM | SOCK_NONBLOCK | SOCK_CLOEXEC, NETLINK_CONNECTOR);
+        if (netlink_ < 0)
+            return;
+
+        sockaddr_nl addr;
+        memset(&addr, 0, sizeof(addr));
+        addr.nl_family = AF_NETLINK;
+        addr.nl_groups = CN_IDX_PROC;
+        addr.nl_pid = 0;
+
+        alignas(nlmsghdr) char request[NLMSG_SPACE(sizeof(cn_msg) + sizeof(proc_cn_mcast_op))];
+        memset(request, 0, sizeof(request));
+        auto header = reinterpret_cast<nlmsghdr *>(request);
+        header->nlmsg_len = NLMSG_LENGTH(sizeof(cn_msg) + sizeof(proc_cn_mcast_op));
+        header->nlmsg_type = NLMSG_DONE;
+        auto message = reinterpret_cast<cn_msg *>(NLMSG_DATA(header));
+        message->id.idx = CN_IDX_PROC;
+        message->id.val = CN_VAL_PROC;
+        message->len = sizeof(proc_cn_mcast_op);
+        auto op = PROC_CN_MCAST_LISTEN;
+        memcpy(message->data, &op, sizeof(op));
+
+        if (bind(netlink_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) < 0
+            || send(netlink_, request, header->nlmsg_len, 0) < 0) {
+            close(netlink_);
+            netlink_ = -1;
+            return;
+        }
+
+        // the kernel acks the subscription, with EPERM if we lack CAP_NET_ADMIN
+        pollfd fd{netlink_, POLLIN, 0};
+        alignas(nlmsghdr) char buffer[4096];
+        if (poll(&fd, 1, 100) <= 0)
+            return;
+        auto len = recv(netlink_, buffer, sizeof(buffer), 0);
+        auto reply = reinterpret_cast<nlmsghdr *>(buffer);
+        if (len <= 0 || !NLMSG_OK(reply, static_cast<size_t>(len)))
+            return;
+
+        auto event = reinterpret_cast<proc_event *>(reinterpret_cast<cn_msg *>(NLMSG_DATA(reply))->data);
+        if (reply->nlmsg_type == NLMSG_ERROR
+            || (event->what == proc_event::PROC_EVENT_NONE && event->event_data.ack.err != 0)) {
+            close(netlink_);
+            netlink_ = -1;
+        }
+    }
+
+    /// @brief Handles the queued proc connector events
+    void receive() {
+        alignas(nlmsghdr) char buffer[8192];
+
+        for (;;) {
+            auto len = recv(netlink_, buffer, sizeof(buffer), 0);
+            if (len < 0) {
+                // events were dropped, find out what we missed
+                if (errno == ENOBUFS)
+                    scan();
+                return;
+            }
+
+            for (auto header = reinterpret_cast<nlmsghdr *>(buffer); NLMSG_OK(header, static_cast<size_t>(len));
+                 header = NLMSG_NEXT(header, len)) {
+                if (header->nlmsg_type != NLMSG_DONE)
+                    continue;
+
+                auto message = reinterpret_cast<cn_msg *>(NLMSG_DATA(header));
+                auto event = reinterpret_cast<proc_event *>(message->data);
+
+                // wine and electron may rename themselves after exec
+                if (event->what == proc_event::PROC_EVENT_EXEC) {
+                    if (matches(event->event_data.exec.process_tgid))
+                        add(event->event_data.exec.process_tgid);
+                } else if (event->what == proc_event::PROC_EVENT_COMM) {
+                    auto pid = event->event_data.comm.process_tgid;
+                    if (pid == event->event_data.comm.process_pid && matches(pid))
+                        add(pid);
+                }
+            }
+        }
+    }
+
+    std::vector<std::string> names_;
+    pid_t self_;
+    int netlink_ = -1;
+    std::vector<Process> processes_;
+};
+
+#endif
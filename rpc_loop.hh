@@ -0,0 +1,711 @@
+/**
+ * @file    rpc_loop.hh
+ * @authors Stavros Avramidis
+ *
+ * The rpc loop and what it shows, free of Qt so that it runs headless (replays, tests).
+ * Include after the api hook of the platform.
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <codecvt>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <functional>
+#include <iomanip>
+#include <iostream>
+#include <locale>
+#include <memory>
+#include <mutex>
+#include <ostream>
+#include <string>
+#include <vector>
+// local libs
+#include "clock.hh"
+#include "discord_ipc.hh"
+#include "journal.hh"
+#include "json.hh"
+#include "logger.hh"
+#include "playback_tracker.hh"
+#include "poll_scheduler.hh"
+#include "track_resolver.hh"
+
+#include "discord_game_sdk.h"
+
+
+// TIDAL logo from the official TIDAL "artist" page: https://tidal.com/browse/artist/6712922
+static const std::string TIDAL_LOGO_URL = "https://resources.tidal.com/images/d156d3e0/a5cd/4066/8c36/b13edab7bbcc/750x750.jpg";
+
+inline long long APPLICATION_ID = 584458858731405315;
+static const int RPC_IDLE_TIMEOUT_SECONDS = 5;
+
+inline std::atomic<bool> isPresenceActive;
+
+
+struct Song {
+    enum AudioQualityEnum {
+        master, hifi, normal
+    };
+    std::string title;
+    std::string artist;
+    std::string album;
+    std::string url;
+    std::string cover_id;
+    char id[10];
+    PlaybackTracker playback;
+    int64_t starttime;  ///< unix time the track would have started at, had it never been paused
+    int64_t runtime;
+    uint64_t repeatCount;
+    uint_fast8_t trackNumber;
+    uint_fast8_t volumeNumber;
+    AudioQualityEnum quality;
+    bool loaded = false;
+    uint64_t revision = 0;  ///< identifies the metadata shown in the presence, 0 until resolved
+
+    void setQuality(const std::string &q) {
+        if (q == "HI_RES") {
+            quality = master;
+        } else {
+            quality = hifi;
+        }
+    }
+
+    inline bool isHighRes() const noexcept { return quality == master; }
+
+    inline bool isPaused() const noexcept { return playback.isPaused(); }
+
+    inline int64_t endtime() const noexcept { return runtime ? starttime + runtime : 0; }
+
+    /**
+     * @brief Anchors <starttime> to the wall clock, after <playback> changed
+     */
+    void updateStarttime(const Clock &clock) {
+        auto position = playback.position(clock.now());
+        starttime = clock.unixTime() - std::chrono::duration_cast<std::chrono::seconds>(position).count();
+    }
+
+    friend std::ostream &operator<<(std::ostream &out, const Song &song) {
+        out << song.title << " of " << song.album << " from " << song.artist << "(" << song.runtime << ")";
+        return out;
+    }
+};
+
+/**
+ * @brief Formats everything of <song>'s activity but the timestamps
+ */
+inline void buildActivity(const Song &song, DiscordActivity &activity) {
+    memset(&activity, 0, sizeof(activity));
+    activity.type = DiscordActivityType_Listening;
+    activity.application_id = APPLICATION_ID;
+    snprintf(activity.details, 128, "%s - %s", song.title.c_str(), song.artist.c_str());
+    // state stays empty, so that the text box isn't taller than the cover image
+
+    // Get url of album picture
+    auto cover_id_url = song.cover_id;
+    std::replace(cover_id_url.begin(), cover_id_url.end(), '-', '/');
+    auto cover_url = "https://resources.tidal.com/images/" + cover_id_url + "/1280x1280.jpg";
+    LOG_DEBUG("Cover: ", cover_url);
+
+    snprintf(activity.assets.large_image, 128, "%s", cover_url.c_str());
+    snprintf(activity.assets.large_text, 128, "Album: %s", song.album.c_str());
+
+    snprintf(activity.assets.small_image, 128, "%s", TIDAL_LOGO_URL.c_str());
+    snprintf(activity.assets.small_text, 128, "%s", "Streaming on TIDAL");
+
+    if (song.id[0] != '\0') {
+        snprintf(activity.secrets.join, 128, "%s", song.id);
+    }
+
+    activity.instance = false;
+}
+
+/**
+ * @brief The activity to show for <song>, idle unless it is playing
+ */
+inline const DiscordActivity &presenceActivity(const Song &song) {
+    if (isPresenceActive && song.loaded && !song.isPaused()) {
+        // only the rpc thread sends tracks, the tray only ever sends the idle activity.
+        // Repeats and resumes of the same track just patch the timestamps
+        static struct DiscordActivity activity;
+        static uint64_t activityRevision = 0;
+        if (!song.revision || song.revision != activityRevision) {
+            buildActivity(song, activity);
+            activityRevision = song.revision;
+        }
+        activity.timestamps.start = song.starttime;
+        activity.timestamps.end = song.endtime();
+        return activity;
+    } else {
+        // manager->clear_activity(manager, nullptr, nullptr);
+        static struct DiscordActivity idle = []() {
+            struct DiscordActivity activity;
+            memset(&activity, 0, sizeof(activity));
+            activity.type = DiscordActivityType_Listening;
+            activity.application_id = APPLICATION_ID;
+            snprintf(activity.details, 128, "Idle");
+            snprintf(activity.assets.large_image, 128, "%s", TIDAL_LOGO_URL.c_str());
+            snprintf(activity.assets.large_text, 128, "%s", "TIDAL");
+            activity.instance = false;
+            return activity;
+        }();
+        return idle;
+    }
+}
+
+/**
+ * @brief <activity> as the json of a SET_ACTIVITY rpc command, empty fields are left out since
+ * discord refuses them
+ */
+inline std::string activityJson(const DiscordActivity &activity) {
+    nlohmann::json json{{"type", activity.type}, {"instance", activity.instance}};
+    auto setText = [](nlohmann::json &object, const char *key, const char *text) {
+        if (text[0] != '\0') object[key] = text;
+    };
+
+    setText(json, "details", activity.details);
+    setText(json, "state", activity.state);
+    if (activity.timestamps.start) json["timestamps"]["start"] = activity.timestamps.start;
+    if (activity.timestamps.end) json["timestamps"]["end"] = activity.timestamps.end;
+
+    auto &assets = json["assets"];
+    setText(assets, "large_image", activity.assets.large_image);
+    setText(assets, "large_text", activity.assets.large_text);
+    setText(assets, "small_image", activity.assets.small_image);
+    setText(assets, "small_text", activity.assets.small_text);
+    // join secrets need a party, which there is none of
+    return json.dump();
+}
+
+/**
+ * @brief Receiver of presence updates, discord or a stand-in when replaying
+ */
+class PresenceSink {
+  public:
+    virtual ~PresenceSink() = default;
+
+    virtual bool isConnected() const = 0;
+
+    /// @return false if there is nothing to connect to right now
+    virtual bool connect() = 0;
+
+    virtual void update(const Song &song) = 0;
+
+    virtual void runCallbacks() = 0;
+
+    /// @brief Clears the presence and lets go of the connection
+    virtual void release() = 0;
+};
+
+/**
+ * @brief Presence on every running discord client at once, over their ipc pipes instead of the
+ * game SDK, which only ever talks to one of them (--all-clients)
+ */
+class DiscordIpcSink : public PresenceSink {
+  public:
+    bool isConnected() const override { return fanout_ && fanout_->readyCount() > 0; }
+
+    bool connect() override {
+        if (!fanout_)
+            fanout_.reset(new DiscordIpcFanout(std::to_string(APPLICATION_ID)));
+        return fanout_->waitReady(std::chrono::seconds(1));
+    }
+
+    void update(const Song &song) override {
+        if (fanout_)
+            fanout_->send(activityJson(presenceActivity(song)));
+    }
+
+    // every connection pumps its own pipe
+    void runCallbacks() override {}
+
+    void release() override {
+        if (!fanout_)
+            return;
+        for (auto &metrics : fanout_->metrics()) {
+            if (metrics.connects)
+                LOG_INFO("discord-ipc-", metrics.index, ": ", metrics.sent, " sent, ", metrics.acknowledged,
+                         " acknowledged, ", metrics.failed, " failed");
+        }
+        // clears the presence on all of them
+        fanout_.reset();
+    }
+
+  private:
+    std::unique_ptr<DiscordIpcFanout> fanout_;
+};
+
+/**
+ * @brief Hands the loop's calls on to <inner> until <quit>, which clears the presence and lets go
+ * of it from another thread (the tray's exit). The loop's calls do nothing from then on.
+ */
+class QuittablePresence : public PresenceSink {
+  public:
+    explicit QuittablePresence(PresenceSink &inner) : inner_(inner) {}
+
+    bool isConnected() const override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !isQuit_ && inner_.isConnected();
+    }
+
+    bool connect() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return !isQuit_ && inner_.connect();
+    }
+
+    void update(const Song &song) override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isQuit_)
+            inner_.update(song);
+    }
+
+    void runCallbacks() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isQuit_)
+            inner_.runCallbacks();
+    }
+
+    void release() override {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (!isQuit_)
+            inner_.release();
+    }
+
+    /// @brief Clears the presence and lets go of it for good, waits for a call of the loop under way
+    void quit() {
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (isQuit_)
+            return;
+        isQuit_ = true;
+        if (inner_.isConnected()) {
+            inner_.update(Song());
+            inner_.release();
+        }
+    }
+
+    bool isQuit() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return isQuit_;
+    }
+
+  private:
+    PresenceSink &inner_;
+    mutable std::mutex mutex_;
+    bool isQuit_ = false;
+};
+
+/**
+ * @brief What rpcLoop() reads from and reports to, swapped out for recording and replaying
+ */
+struct LoopIo {
+    std::function<status(std::wstring &, std::wstring &)> readPlayer = tidalInfo;
+    ApiQuery queryApi;  ///< GET from api.tidal.com, nullptr without an answer
+    TrackResolver *resolver = nullptr;  ///< looks tracks up through <queryApi>
+    PresenceSink *presence = nullptr;
+    std::function<bool()> isFinished;  ///< ends the loop once true, checked after every sleep
+    std::function<void(PollScheduler::State)> polled;  ///< told what each poll found, before the loop sleeps
+    std::function<void(const std::string &)> showStatus = [](const std::string &) {};  ///< on the tray
+    std::function<void(const Song &)> published = [](const Song &) {};  ///< after every poll, for the local api
+};
+
+
+/**
+ * @brief Polls the player and keeps the presence in step with it, until <LoopIo::isFinished>
+ */
+inline void rpcLoop(Clock &clock, LoopIo &io) {
+    static Song curSong;
+    PollScheduler scheduler;
+    auto idleSince = clock.now();
+    auto lastPoll = clock.now();
+
+    while (!io.isFinished || !io.isFinished()) {
+        bool kill_discord = false;
+        bool isNewTrack = false;
+        auto pollState = PollScheduler::State::unknown;
+        auto now = clock.now();
+
+        if (isPresenceActive) {
+            std::wstring tmpTrack, tmpArtist;
+            auto localStatus = io.readPlayer(tmpTrack, tmpArtist);
+
+            // If song is playing
+            if (localStatus == playing) {
+                // only init if something is playing
+                if (!io.presence->isConnected()) {
+                    if (!io.presence->connect()) {
+                        clock.sleepFor(std::chrono::seconds(2));
+                        continue;
+                    }
+                }
+
+                // if new song is playing
+                if (rawWstringToString(tmpTrack) != curSong.title || rawWstringToString(tmpArtist) != curSong.artist) {
+                    // assign new info to current track
+                    curSong.title = rawWstringToString(tmpTrack);
+                    curSong.artist = rawWstringToString(tmpArtist);
+
+                    curSong.playback.start(now);
+                    isNewTrack = true;
+                    curSong.runtime = 0;
+                    curSong.repeatCount = 0;
+                    curSong.setQuality("");
+                    curSong.id[0] = '\0';
+                    curSong.loaded = true;
+
+                    io.showStatus("Playing " + curSong.title);
+
+                    // get info form TIDAL api
+                    auto info = io.resolver->resolve(curSong.title, curSong.artist);
+                    if (info.isFound) {
+                        curSong.setQuality(info.quality);
+                        curSong.trackNumber = info.trackNumber;
+                        curSong.volumeNumber = info.volumeNumber;
+                        curSong.runtime = info.runtime;
+                        sprintf(curSong.id, "%u", info.id);
+                        curSong.cover_id = info.coverId;
+                        curSong.album = info.album;
+                    }
+
+                    LOG_DEBUG(curSong.title, "\tFrom: ", curSong.artist);
+
+                    static uint64_t songRevisions = 0;
+                    curSong.revision = ++songRevisions;
+
+                    // the track started when its title showed up, the api query doesn't delay it
+                    curSong.updateStarttime(clock);
+                    io.presence->update(curSong);
+                } else {
+                    if (curSong.isPaused()) {
+                        curSong.playback.resume(now);
+                        curSong.updateStarttime(clock);
+                        io.presence->update(curSong);
+
+                        io.showStatus("Playing " + curSong.title);
+                    }
+                    if (auto repeats = curSong.playback.wrap(std::chrono::seconds(curSong.runtime), now)) {
+                        curSong.updateStarttime(clock);
+                        curSong.repeatCount += repeats;
+                        io.presence->update(curSong);
+                    }
+                }
+                pollState = PollScheduler::State::playing;
+
+            } else if (localStatus == opened) {
+                curSong.playback.pause(now, lastPoll);
+                pollState = PollScheduler::State::paused;
+                io.presence->update(curSong);
+                kill_discord = true;
+
+                io.showStatus("Paused " + curSong.title);
+            } else {
+                curSong = Song();
+                io.presence->update(curSong);
+                kill_discord = true;
+                pollState = PollScheduler::State::closed;
+
+                io.showStatus("Waiting for Tidal");
+            }
+        }
+
+        if (io.presence->isConnected()) {
+            if (!isPresenceActive) {
+                kill_discord = true;
+                curSong = Song();
+                io.presence->update(curSong);
+
+                io.showStatus("Disabled");
+            }
+
+            io.presence->runCallbacks();
+
+            if (!kill_discord) {
+                idleSince = now;
+            }
+            else if (now - idleSince >= std::chrono::seconds(RPC_IDLE_TIMEOUT_SECONDS)) {
+                io.presence->release();
+            }
+        }
+
+        io.published(curSong);
+
+        scheduler.observe(pollState, isNewTrack, now);
+        if (io.polled) io.polled(scheduler.state());
+        auto untilTrackEnd = PollScheduler::duration::max();
+        if (curSong.loaded && curSong.runtime && !curSong.isPaused()) {
+            auto &playback = curSong.playback;
+            untilTrackEnd = std::chrono::seconds(curSong.runtime) + playback.slack() - playback.position(now);
+        }
+        auto interval = scheduler.next(now, untilTrackEnd);
+        lastPoll = now;
+
+        clock.sleepFor(interval);
+    }
+}
+
+inline JournalRecord presenceRecord(const Song &song) {
+    JournalRecord record{JournalRecord::presence};
+    record.numbers = {song.loaded, song.isPaused(), static_cast<uint64_t>(song.loaded ? song.starttime : 0),
+                      static_cast<uint64_t>(song.loaded ? song.endtime() : 0), song.repeatCount};
+    record.strings = {song.title, song.artist, song.album, song.cover_id, song.id};
+    return record;
+}
+
+/**
+ * @brief Journals what flows through a <LoopIo> (--record=<file>): player observations and
+ * presence updates when they change, and every api request with its response
+ */
+class SessionRecorder : public PresenceSink {
+  public:
+    SessionRecorder(JournalWriter &journal, const Clock &clock)
+        : journal_(journal), clock_(clock), start_(clock.now()) {}
+
+    /// @brief Routes <io> through the recorder
+    void attach(LoopIo &io) {
+        inner_ = io.presence;
+        io.presence = this;
+
+        auto readPlayer = io.readPlayer;
+        io.readPlayer = [this, readPlayer](std::wstring &track, std::wstring &artist) {
+            auto result = readPlayer(track, artist);
+            JournalRecord record{JournalRecord::observation};
+            record.numbers = {static_cast<uint64_t>(result)};
+            record.strings = {rawWstringToString(track), rawWstringToString(artist)};
+            writeIfChanged(record, lastObservation_);
+            return result;
+        };
+
+        auto queryApi = io.queryApi;
+        io.queryApi = [this, queryApi](const std::string &path, const httplib::Headers &headers) {
+            write(JournalRecord{JournalRecord::apiRequest, 0, {}, {path}});
+            auto res = queryApi(path, headers);
+            write(JournalRecord{JournalRecord::apiResponse, 0, {res ? static_cast<uint64_t>(res->status) : 0u},
+                                {res ? res->body : std::string()}});
+            return res;
+        };
+    }
+
+    bool isConnected() const override { return inner_->isConnected(); }
+
+    bool connect() override { return inner_->connect(); }
+
+    void update(const Song &song) override {
+        writeIfChanged(presenceRecord(song), lastPresence_);
+        inner_->update(song);
+    }
+
+    void runCallbacks() override { inner_->runCallbacks(); }
+
+    void release() override { inner_->release(); }
+
+  private:
+    void write(JournalRecord record) {
+        record.time = std::chrono::duration_cast<std::chrono::milliseconds>(clock_.now() - start_).count();
+        journal_.write(record);
+    }
+
+    void writeIfChanged(const JournalRecord &record, JournalRecord &last) {
+        if (record.numbers == last.numbers && record.strings == last.strings) return;
+        last = record;
+        write(record);
+    }
+
+    JournalWriter &journal_;
+    const Clock &clock_;
+    Clock::time_point start_;
+    PresenceSink *inner_ = nullptr;
+    JournalRecord lastObservation_{JournalRecord::observation};
+    JournalRecord lastPresence_{JournalRecord::presence};
+};
+
+/**
+ * @brief Plays a journal back through rpcLoop() (--replay=<file>).
+ * The player reports what was observed at the same session time, the api answers with the
+ * recorded responses in order and presence updates only get timed. At the end every player change
+ * is listed with how long it took to reach the presence, as recorded and as replayed.
+ * Given a journal, the replay is recorded again, and should come out the same as the original.
+ */
+class SessionReplay : public PresenceSink {
+  public:
+    /// @return false if <path> isn't a readable journal
+    bool load(const std::string &path) {
+        JournalReader reader;
+        if (!reader.open(path)) return false;
+        unixStart_ = reader.unixStart();
+
+        JournalRecord record;
+        while (reader.next(record)) {
+            if (record.type == JournalRecord::observation && record.numbers.size() == 1 && record.strings.size() == 2) {
+                observations_.push_back(record);
+            } else if (record.type == JournalRecord::apiResponse && record.numbers.size() == 1 && record.strings.size() == 1) {
+                responses_.push_back(record);
+            } else if (record.type == JournalRecord::presence) {
+                presenceTimes_.push_back(record.time);
+            }
+            end_ = record.time;
+        }
+        return true;
+    }
+
+    /// @brief The unix time the journal started at, for recording the replay
+    int64_t unixStart() const noexcept { return unixStart_; }
+
+    /**
+     * @param speed How much faster than real time to replay, 0 for as fast as possible
+     * @param journal Where to record the replay, if open
+     */
+    void run(double speed, const std::string &countryCode = "US", JournalWriter *journal = nullptr) {
+        std::unique_ptr<Clock> clock;
+        if (speed > 0) {
+            clock.reset(new ScaledClock(speed, unixStart_));
+        } else {
+            clock.reset(new VirtualClock(unixStart_));
+        }
+        clock_ = clock.get();
+        start_ = clock->now();
+
+        LoopIo io;
+        io.presence = this;
+        io.readPlayer = [this](std::wstring &track, std::wstring &artist) { return readPlayer(track, artist); };
+        io.queryApi = [this](const std::string &, const httplib::Headers &) { return queryApi(); };
+        std::unique_ptr<SessionRecorder> recorder;
+        if (journal && journal->isOpen()) {
+            recorder.reset(new SessionRecorder(*journal, *clock));
+            recorder->attach(io);
+        }
+        // after attaching, so the recorder sees the requests
+        TrackResolver resolver(io.queryApi, *clock, countryCode);
+        io.resolver = &resolver;
+        // leave time for whatever the last observation set off
+        io.isFinished = [this]() { return sessionTime() > end_ + 10000; };
+
+        auto realStart = std::chrono::steady_clock::now();
+        rpcLoop(*clock, io);
+        Logger::instance().flush();
+        auto realTime =
+            std::chrono::duration_cast<std::chrono::milliseconds>(std::chrono::steady_clock::now() - realStart);
+
+        report(realTime);
+    }
+
+    bool isConnected() const override { return isConnected_; }
+
+    bool connect() override { return isConnected_ = true; }
+
+    void update(const Song &song) override {
+        auto record = presenceRecord(song);
+        if (record.numbers == lastPresence_.numbers && record.strings == lastPresence_.strings) return;
+        lastPresence_ = record;
+
+        if (pending_ < events_.size() && !events_[pending_].isAnswered) {
+            events_[pending_].replayed = sessionTime() - observations_[events_[pending_].observation].time;
+            events_[pending_].isAnswered = true;
+        }
+    }
+
+    void runCallbacks() override {}
+
+    void release() override { isConnected_ = false; }
+
+  private:
+    struct Event {
+        size_t observation;
+        uint64_t replayed = 0;
+        bool isAnswered = false;
+    };
+
+    uint64_t sessionTime() const {
+        return std::chrono::duration_cast<std::chrono::milliseconds>(clock_->now() - start_).count();
+    }
+
+    status readPlayer(std::wstring &track, std::wstring &artist) {
+        auto now = sessionTime();
+        while (next_ < observations_.size() && observations_[next_].time <= now) next_++;
+
+        track.clear();
+        artist.clear();
+        if (next_ == 0) return closed;
+
+        auto current = next_ - 1;
+        if (events_.empty() || events_.back().observation != current) {
+            events_.push_back(Event{current});
+            pending_ = events_.size() - 1;
+        }
+
+        auto &observation = observations_[current];
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        track = converter.from_bytes(observation.strings[0]);
+        artist = converter.from_bytes(observation.strings[1]);
+        return static_cast<status>(observation.numbers[0]);
+    }
+
+    std::shared_ptr<httplib::Response> queryApi() {
+        if (nextResponse_ >= responses_.size()) return nullptr;
+        auto &record = responses_[nextResponse_++];
+        if (!record.numbers[0]) return nullptr;
+
+        auto res = std::make_shared<httplib::Response>();
+        res->status = static_cast<int>(record.numbers[0]);
+        res->body = record.strings[0];
+        return res;
+    }
+
+    /// @brief Time from observation <index> to the first presence change after it in the journal
+    std::string recordedLatency(size_t index) const {
+        auto from = observations_[index].time;
+        auto until = index + 1 < observations_.size() ? observations_[index + 1].time : UINT64_MAX;
+        auto it = std::lower_bound(presenceTimes_.begin(), presenceTimes_.end(), from);
+        if (it == presenceTimes_.end() || *it >= until) return "-";
+        return std::to_string(*it - from) + " ms";
+    }
+
+    void report(std::chrono::milliseconds realTime) const {
+        static const char *states[] = {"error", "closed", "opened", "playing"};
+        uint64_t total = 0, worst = 0, answered = 0;
+
+        std::cout << std::setw(10) << "time" << "  " << std::left << std::setw(48) << "player" << std::right
+                  << std::setw(10) << "recorded" << std::setw(10) << "replayed" << "\n";
+        for (auto &event : events_) {
+            auto &observation = observations_[event.observation];
+            auto state = observation.numbers[0] < 4 ? states[observation.numbers[0]] : "?";
+            auto player = std::string(state) + " " + observation.strings[0];
+            if (!observation.strings[1].empty()) player += " - " + observation.strings[1];
+            if (player.size() > 46) player = player.substr(0, 43) + "...";
+
+            std::cout << std::setw(9) << std::fixed << std::setprecision(3) << observation.time / 1000.0 << "s  "
+                      << std::left << std::setw(48) << player << std::right << std::setw(10)
+                      << recordedLatency(event.observation) << std::setw(10)
+                      << (event.isAnswered ? std::to_string(event.replayed) + " ms" : "-") << "\n";
+
+            if (event.isAnswered) {
+                answered++;
+                total += event.replayed;
+                worst = std::max(worst, event.replayed);
+            }
+        }
+
+        std::cout << observations_.size() << " observations, " << events_.size() << " replayed, "
+                  << answered << " reached the presence";
+        if (answered) std::cout << " (mean " << total / answered << " ms, max " << worst << " ms)";
+        std::cout << "\n" << end_ / 1000 << " s of session replayed in " << realTime.count() << " ms\n";
+    }
+
+    int64_t unixStart_ = 0;
+    uint64_t end_ = 0;
+    std::vector<JournalRecord> observations_;
+    std::vector<JournalRecord> responses_;
+    std::vector<uint64_t> presenceTimes_;
+
+    Clock *clock_ = nullptr;
+    Clock::time_point start_;
+    size_t next_ = 0;
+    size_t nextResponse_ = 0;
+    std::vector<Event> events_;
+    size_t pending_ = 0;
+    JournalRecord lastPresence_{JournalRecord::presence};
+    bool isConnected_ = false;
+};
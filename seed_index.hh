@@ -0,0 +1,388 @@
+/**
+ * @file    seed_index.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <cstdint>
+#include <cstring>
+#include <fstream>
+#include <string>
+#include <string_view>
+#include <vector>
+// local libs
+#include "cache_snapshot.hh"
+
+
+/**
+ * @brief Immutable index of popular tracks, shipped or handed out to a fleet, looked up in place
+ * from a memory map before asking the api.
+ *
+ * Keys are the normalized title and artist. A minimal perfect hash (hash and displace, one pilot
+ * per bucket of about <BUCKET_SIZE> keys) maps every key to its own record, so a lookup touches
+ * one pilot, one record and the key in the string pool, without allocating.
+ *   header:  "TRPCSEED" version recordSize count bucketCount seed stringsSize
+ *   pilots:  u32 per bucket, padded to 8 bytes
+ *   records: <Record> in hash slot order
+ *   strings: keys and texts of all records back to back
+ * Integers are little endian.
+ */
+class SeedIndex {
+  public:
+    static const uint32_t FORMAT_VERSION = 1;
+    /// longest normalized key that can be looked up
+    static const size_t MAX_KEY = 1024;
+
+    struct Record {
+        uint64_t keyHash;
+        uint32_t keyOffset;
+        uint32_t albumOffset;
+        uint32_t coverOffset;
+        uint32_t qualityOffset;
+        uint32_t id;
+        uint32_t runtime;
+        uint16_t keyLength;
+        uint16_t albumLength;
+        uint8_t coverLength;
+        uint8_t qualityLength;
+        uint8_t trackNumber;
+        uint8_t volumeNumber;
+    };
+
+    /**
+     * @brief Lower case ascii, whitespace trimmed and collapsed into <out>
+     * @return Length written, more than <capacity> if it didn't fit
+     */
+    static size_t normalize(std::string_view text, char *out, size_t capacity) {
+        size_t length = 0;
+        for (unsigned char c : text) {
+            // not isspace() and tolower(), they go through the locale
+            if (c == ' ' || (c >= '\t' && c <= '\r')) {
+                if (length == 0 || out[length - 1] == ' ')
+                    continue;
+                c = ' ';
+            } else if (c >= 'A' && c <= 'Z') {
+                c = static_cast<unsigned char>(c + ('a' - 'A'));
+            }
+            if (length == capacity)
+                return capacity + 1;
+            out[length++] = static_cast<char>(c);
+        }
+        if (length && out[length - 1] == ' ')
+            length--;
+        return length;
+    }
+
+    /**
+     * @brief Writes an index of <tracks> to <path>, later duplicates of a key are dropped
+     * @return false with the reason in <error>
+     */
+    static bool build(const std::string &path, const std::vector<CacheSnapshot::Track> &tracks, std::string &error) {
+        std::vector<uint64_t> hashes;
+        std::vector<uint32_t> order;  // track of each unique key
+        std::string strings;
+
+        // keys first, so duplicates are found by hash before any text is stored
+        char buffer[MAX_KEY];
+        std::vector<std::pair<uint64_t, uint32_t>> byHash;
+        byHash.reserve(tracks.size());
+        for (uint32_t i = 0; i < tracks.size(); i++) {
+            auto length = key(tracks[i].title, tracks[i].artist, buffer);
+            if (length <= MAX_KEY)
+                byHash.emplace_back(hash(std::string_view(buffer, length), 0), i);
+        }
+        std::stable_sort(byHash.begin(), byHash.end(),
+                         [](const std::pair<uint64_t, uint32_t> &a, const std::pair<uint64_t, uint32_t> &b) {
+                             return a.first < b.first;
+                         });
+        for (size_t i = 0; i < byHash.size(); i++) {
+            // equal hashes are the same key, unless 64 bits collided, which the seed retry can't fix
+            if (i && byHash[i].first == byHash[i - 1].first) {
+                auto &a = tracks[byHash[i].second], &b = tracks[order.back()];
+                char other[MAX_KEY];
+                if (std::string_view(buffer, key(a.title, a.artist, buffer))
+                    != std::string_view(other, key(b.title, b.artist, other))) {
+                    error = "hash collision between two keys";
+                    return false;
+                }
+                continue;
+            }
+            order.push_back(byHash[i].second);
+        }
+        std::vector<std::pair<uint64_t, uint32_t>>().swap(byHash);
+
+        auto count = order.size();
+        if (count == 0) {
+            error = "no tracks";
+            return false;
+        }
+        auto bucketCount = std::max<uint64_t>(1, (count + BUCKET_SIZE - 1) / BUCKET_SIZE);
+        std::vector<uint32_t> pilots(bucketCount), slots(count);
+        uint64_t seed = 0;
+        for (;; seed++) {
+            if (seed == MAX_SEEDS) {
+                error = "no perfect hash found";
+                return false;
+            }
+            hashes.resize(count);
+            for (size_t i = 0; i < count; i++) {
+                auto length = key(tracks[order[i]].title, tracks[order[i]].artist, buffer);
+                hashes[i] = hash(std::string_view(buffer, length), seed);
+            }
+            if (place(hashes, bucketCount, pilots, slots))
+                break;
+        }
+
+        std::vector<Record> records(count);
+        for (size_t i = 0; i < count; i++) {
+            auto &track = tracks[order[i]];
+            auto &record = records[slots[i]];
+            record.keyHash = hashes[i];
+            record.keyLength = static_cast<uint16_t>(key(track.title, track.artist, buffer));
+            record.keyOffset = append(strings, std::string_view(buffer, record.keyLength), UINT16_MAX, nullptr);
+            record.albumOffset = append(strings, track.album, UINT16_MAX, &record.albumLength);
+            uint16_t length;
+            record.coverOffset = append(strings, track.coverId, UINT8_MAX, &length);
+            record.coverLength = static_cast<uint8_t>(length);
+            record.qualityOffset = append(strings, track.quality, UINT8_MAX, &length);
+            record.qualityLength = static_cast<uint8_t>(length);
+            record.id = track.id;
+            record.runtime = static_cast<uint32_t>(track.runtime);
+            record.trackNumber = track.trackNumber;
+            record.volumeNumber = track.volumeNumber;
+            if (strings.size() > UINT32_MAX) {
+                error = "strings don't fit 32 bit offsets";
+                return false;
+            }
+        }
+
+        Header header{};
+        memcpy(header.magic, MAGIC, sizeof(MAGIC));
+        header.version = FORMAT_VERSION;
+        header.recordSize = sizeof(Record);
+        header.count = count;
+        header.bucketCount = bucketCount;
+        header.seed = seed;
+        header.stringsSize = strings.size();
+        if (pilots.size() % 2)
+            pilots.push_back(0);
+
+        std::ofstream out(path, std::ios::binary | std::ios::trunc);
+        out.write(reinterpret_cast<const char *>(&header), sizeof(header));
+        out.write(reinterpret_cast<const char *>(pilots.data()), pilots.size() * sizeof(uint32_t));
+        out.write(reinterpret_cast<const char *>(records.data()), records.size() * sizeof(Record));
+        out.write(strings.data(), strings.size());
+        out.flush();
+        if (!out)
+            error = "could not write " + path;
+        return static_cast<bool>(out);
+    }
+
+    /**
+     * @return false with the reason in <error> if <path> isn't a valid index
+     */
+    bool open(const std::string &path, std::string &error) {
+        close();
+        if (!file_.open(path)) {
+            error = "can't be read";
+            return false;
+        }
+
+        Header header;
+        if (file_.size() < sizeof(header)) {
+            error = "too short";
+        } else if (memcpy(&header, file_.data(), sizeof(header)), memcmp(header.magic, MAGIC, sizeof(MAGIC)) != 0) {
+            error = "not a seed index";
+        } else if (header.version != FORMAT_VERSION || header.recordSize != sizeof(Record)) {
+            error = "unsupported version " + std::to_string(header.version);
+        } else if (header.count == 0 || header.bucketCount == 0 || header.count > file_.size()
+                   || header.bucketCount > file_.size() || header.stringsSize > file_.size()
+                   || file_.size() != sizeof(header) + (header.bucketCount + header.bucketCount % 2) * sizeof(uint32_t)
+                                          + header.count * sizeof(Record) + header.stringsSize) {
+            error = "truncated";
+        } else {
+            count_ = header.count;
+            bucketCount_ = header.bucketCount;
+            seed_ = header.seed;
+            pilots_ = reinterpret_cast<const uint32_t *>(file_.data() + sizeof(header));
+            records_ = reinterpret_cast<const Record *>(pilots_ + bucketCount_ + bucketCount_ % 2);
+            strings_ = reinterpret_cast<const char *>(records_ + count_);
+            stringsSize_ = header.stringsSize;
+            return true;
+        }
+
+        close();
+        return false;
+    }
+
+    void close() {
+        file_.close();
+        records_ = nullptr;
+        count_ = 0;
+    }
+
+    bool isOpen() const noexcept { return records_ != nullptr; }
+
+    size_t size() const noexcept { return count_; }
+
+    /**
+     * @return The record of <title> by <artist>, nullptr if the index doesn't have it
+     */
+    const Record *find(std::string_view title, std::string_view artist) const {
+        if (!records_)
+            return nullptr;
+        char buffer[MAX_KEY];
+        auto length = key(title, artist, buffer);
+        if (length > MAX_KEY)
+            return nullptr;
+
+        std::string_view key(buffer, length);
+        auto keyHash = hash(key, seed_);
+        auto &record = records_[slot(keyHash, pilots_[bucket(keyHash, bucketCount_)], count_)];
+        if (record.keyHash != keyHash || text(record.keyOffset, record.keyLength) != key)
+            return nullptr;
+        return &record;
+    }
+
+    std::string_view album(const Record &record) const { return text(record.albumOffset, record.albumLength); }
+
+    std::string_view coverId(const Record &record) const { return text(record.coverOffset, record.coverLength); }
+
+    std::string_view quality(const Record &record) const { return text(record.qualityOffset, record.qualityLength); }
+
+  private:
+    static constexpr char MAGIC[8] = {'T', 'R', 'P', 'C', 'S', 'E', 'E', 'D'};
+    static const uint64_t BUCKET_SIZE = 5;
+    static const uint64_t MAX_SEEDS = 16;
+
+    struct Header {
+        char magic[8];
+        uint32_t version;
+        uint32_t recordSize;
+        uint64_t count;
+        uint64_t bucketCount;
+        uint64_t seed;
+        uint64_t stringsSize;
+    };
+    static_assert(sizeof(Header) == 48 && sizeof(Record) == 40, "index layout has no padding");
+
+    /// @brief Normalized title, a unit separator and normalized artist into <out>
+    static size_t key(std::string_view title, std::string_view artist, char (&out)[MAX_KEY]) {
+        auto length = normalize(title, out, MAX_KEY);
+        if (length >= MAX_KEY)
+            return MAX_KEY + 1;
+        out[length++] = '\x1f';
+        auto artistLength = normalize(artist, out + length, MAX_KEY - length);
+        return artistLength > MAX_KEY - length ? MAX_KEY + 1 : length + artistLength;
+    }
+
+    /// @brief FNV-1a with a final mix, so all bits are usable for buckets and slots
+    static uint64_t hash(std::string_view key, uint64_t seed) {
+        uint64_t hash = 0xcbf29ce484222325u ^ (seed * 0x9e3779b97f4a7c15u);
+        for (unsigned char c : key)
+            hash = (hash ^ c) * 0x100000001b3u;
+        return mix(hash);
+    }
+
+    static uint64_t mix(uint64_t x) {
+        x ^= x >> 33u;
+        x *= 0xff51afd7ed558ccdu;
+        x ^= x >> 33u;
+        x *= 0xc4ceb9fe1a85ec53u;
+        return x ^ (x >> 33u);
+    }
+
+    static uint64_t bucket(uint64_t keyHash, uint64_t bucketCount) {
+        return (keyHash >> 32u) % bucketCount;
+    }
+
+    static uint64_t slot(uint64_t keyHash, uint32_t pilot, uint64_t count) {
+        return (keyHash ^ mix(pilot + 1)) % count;
+    }
+
+    /**
+     * @brief Finds a pilot for every bucket, biggest buckets first, such that all keys land in
+     * distinct slots
+     * @return false if some bucket found none, then another seed has to be tried
+     */
+    static bool place(const std::vector<uint64_t> &hashes, uint64_t bucketCount, std::vector<uint32_t> &pilots,
+                      std::vector<uint32_t> &slots) {
+        auto count = hashes.size();
+        std::vector<uint32_t> start(bucketCount + 1), members(count);
+        for (auto keyHash : hashes)
+            start[bucket(keyHash, bucketCount) + 1]++;
+        for (uint64_t b = 0; b < bucketCount; b++)
+            start[b + 1] += start[b];
+        {
+            auto fill = start;
+            for (uint32_t i = 0; i < count; i++)
+                members[fill[bucket(hashes[i], bucketCount)]++] = i;
+        }
+
+        std::vector<uint32_t> buckets(bucketCount);
+        for (uint32_t b = 0; b < bucketCount; b++)
+            buckets[b] = b;
+        std::stable_sort(buckets.begin(), buckets.end(), [&start](uint32_t a, uint32_t b) {
+            return start[a + 1] - start[a] > start[b + 1] - start[b];
+        });
+
+        std::vector<bool> taken(count);
+        std::vector<uint64_t> candidate;
+        for (auto b : buckets) {
+            auto first = members.begin() + start[b], last = members.begin() + start[b + 1];
+            if (first == last)
+                continue;
+
+            // the last few keys look for one of few free slots, so the budget grows with the table
+            uint64_t pilot = 0, maxPilot = std::max<uint64_t>(1u << 16u, count * 32);
+            for (; pilot < maxPilot && pilot <= UINT32_MAX; pilot++) {
+                candidate.clear();
+                bool isFree = true;
+                for (auto it = first; it != last && isFree; ++it) {
+                    auto s = slot(hashes[*it], static_cast<uint32_t>(pilot), count);
+                    isFree = !taken[s] && std::find(candidate.begin(), candidate.end(), s) == candidate.end();
+                    candidate.push_back(s);
+                }
+                if (isFree)
+                    break;
+            }
+            if (pilot == maxPilot || pilot > UINT32_MAX)
+                return false;
+
+            pilots[b] = static_cast<uint32_t>(pilot);
+            for (size_t i = 0; i < candidate.size(); i++) {
+                taken[candidate[i]] = true;
+                slots[first[i]] = static_cast<uint32_t>(candidate[i]);
+            }
+        }
+        return true;
+    }
+
+    static uint32_t append(std::string &strings, std::string_view text, size_t maxLength, uint16_t *length) {
+        auto offset = static_cast<uint32_t>(strings.size());
+        text = text.substr(0, maxLength);
+        strings.append(text.data(), text.size());
+        if (length)
+            *length = static_cast<uint16_t>(text.size());
+        return offset;
+    }
+
+    std::string_view text(uint32_t offset, uint32_t length) const {
+        if (static_cast<uint64_t>(offset) + length > stringsSize_)
+            return {};
+        return std::string_view(strings_ + offset, length);
+    }
+
+    MappedFile file_;
+    const uint32_t *pilots_ = nullptr;
+    const Record *records_ = nullptr;
+    const char *strings_ = nullptr;
+    uint64_t count_ = 0;
+    uint64_t bucketCount_ = 0;
+    uint64_t seed_ = 0;
+    uint64_t stringsSize_ = 0;
+};
@@ -0,0 +1,110 @@
+/**
+ * @file    single_flight.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <chrono>
+#include <cstdint>
+#include <functional>
+#include <future>
+#include <map>
+#include <mutex>
+#include <string>
+
+
+/**
+ * @brief Collapses identical concurrent calls into one.
+ *
+ * The first caller for a key runs the fetch. Whoever asks for the same key while it is in flight,
+ * or after it finished but within <linger> of it starting, waits for and gets that same result.
+ * Nothing is kept for longer than that, caching is up to the fetch. Failures, thrown or a default
+ * constructed <Value>, aren't kept at all. Like <PollScheduler> time points are passed in.
+ */
+template<typename Value>
+class SingleFlight {
+  public:
+    using clock = std::chrono::steady_clock;
+
+    explicit SingleFlight(std::chrono::milliseconds linger) : linger_(linger) {}
+
+    Value run(const std::string &key, clock::time_point now, const std::function<Value()> &fetch) {
+        std::unique_lock<std::mutex> lock(mutex_);
+        prune(now);
+
+        auto it = flights_.find(key);
+        if (it != flights_.end()) {
+            shared_++;
+            auto result = it->second.result;
+            lock.unlock();
+            return result.get();
+        }
+
+        calls_++;
+        std::promise<Value> promise;
+        flights_[key] = Flight{promise.get_future().share(), false, now};
+        lock.unlock();
+
+        try {
+            auto value = fetch();
+            promise.set_value(value);
+            // callers in flight share it either way, but an empty result (a null response) is a
+            // failure and not kept for later ones
+            finish(key, !(value == Value()));
+            return value;
+        } catch (...) {
+            promise.set_exception(std::current_exception());
+            // a failure isn't worth sharing with later callers
+            finish(key, false);
+            throw;
+        }
+    }
+
+    /// @brief Fetches that actually ran
+    uint64_t calls() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return calls_;
+    }
+
+    /// @brief Callers that got the result of someone else's fetch
+    uint64_t shared() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return shared_;
+    }
+
+  private:
+    struct Flight {
+        std::shared_future<Value> result;
+        bool isDone;
+        clock::time_point startedAt;
+    };
+
+    void finish(const std::string &key, bool keep) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = flights_.find(key);
+        if (keep && linger_.count() > 0) {
+            it->second.isDone = true;
+        } else {
+            flights_.erase(it);
+        }
+    }
+
+    /// @brief Called with <mutex_> held
+    void prune(clock::time_point now) {
+        for (auto it = flights_.begin(); it != flights_.end();) {
+            if (it->second.isDone && now - it->second.startedAt >= linger_)
+                it = flights_.erase(it);
+            else
+                ++it;
+        }
+    }
+
+    const std::chrono::milliseconds linger_;
+    mutable std::mutex mutex_;
+    std::map<std::string, Flight> flights_;
+    uint64_t calls_ = 0;
+    uint64_t shared_ = 0;
+};
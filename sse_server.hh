@@ -0,0 +1,427 @@
+/**
+ * @file    sse_server.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+#ifdef __linux__
+
+// cpp libs
+#include <atomic>
+#include <chrono>
+#include <cstring>
+#include <memory>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <unordered_map>
+// linux api
+#include <fcntl.h>
+#include <sys/epoll.h>
+#include <sys/eventfd.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// local libs
+#include "httplib.hh"
+
+
+/**
+ * @brief epoll driven server fanning out Server-Sent Events to many mostly idle subscribers.
+ *
+ * All sockets are served by a single event loop thread, so an idle subscriber costs a file
+ * descriptor and a few bytes of bookkeeping instead of a thread. Only two resources exist:
+ * a snapshot (plain GET, connection closed after the response) and the event stream.
+ *
+ * Published payloads are shared by every connection, nothing is formatted per client. A
+ * subscriber that can't keep up only ever holds the event being written plus the newest one,
+ * intermediate events are dropped since every event carries the full state.
+ *
+ * A connection that hasn't sent its whole request head within <REQUEST_TIMEOUT> of being
+ * accepted is closed, so clients trickling bytes (or none) can't pile up descriptors.
+ */
+class SseServer {
+  public:
+    SseServer(std::string snapshotPath, std::string eventsPath)
+        : snapshotPath_(std::move(snapshotPath)), eventsPath_(std::move(eventsPath)),
+          snapshot_(std::make_shared<const std::string>(response("200 OK", "application/json", ""))),
+          event_(std::make_shared<const std::string>()),
+          heartbeat_(std::make_shared<const std::string>(": heartbeat\n\n")) {}
+
+    ~SseServer() { stop(); }
+
+    SseServer(const SseServer &) = delete;
+    SseServer &operator=(const SseServer &) = delete;
+
+    /**
+     * @brief Binds the listening socket, port 0 picks a free one
+     * @return the bound port or -1
+     */
+    int bind(const char *host, int port) {
+        // every subscriber is a descriptor, allow as many as the hard limit does
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NOFILE, &limit) == 0 && limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+
+        listenFd_ = httplib::detail::create_socket(host, port, [](socket_t sock, struct addrinfo &ai) {
+            return ::bind(sock, ai.ai_addr, static_cast<socklen_t>(ai.ai_addrlen)) == 0
+                && ::listen(sock, SOMAXCONN) == 0;
+        });
+        if (listenFd_ == INVALID_SOCKET)
+            return -1;
+
+        sockaddr_storage address{};
+        socklen_t len = sizeof(address);
+        if (getsockname(listenFd_, reinterpret_cast<sockaddr *>(&address), &len) != 0)
+            return -1;
+        if (address.ss_family == AF_INET6)
+            return ntohs(reinterpret_cast<sockaddr_in6 *>(&address)->sin6_port);
+        return ntohs(reinterpret_cast<sockaddr_in *>(&address)->sin_port);
+    }
+
+    /**
+     * @brief Starts the event loop thread on the bound socket
+     */
+    bool start() {
+        if (listenFd_ == INVALID_SOCKET)
+            return false;
+
+        epollFd_ = epoll_create1(EPOLL_CLOEXEC);
+        wakeFd_ = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+        if (epollFd_ < 0 || wakeFd_ < 0)
+            return false;
+
+        httplib::detail::set_nonblocking(listenFd_, true);
+        watch(listenFd_, EPOLLIN);
+        watch(wakeFd_, EPOLLIN);
+
+        isRunning_ = true;
+        thread_ = std::thread([this]() { loop(); });
+        return true;
+    }
+
+    void stop() {
+        if (isRunning_.exchange(false)) {
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                wake();
+            }
+            thread_.join();
+        }
+
+        for (auto &entry : connections_)
+            ::close(entry.first);
+        connections_.clear();
+
+        for (auto fd : {listenFd_, epollFd_})
+            if (fd >= 0)
+                ::close(fd);
+        listenFd_ = epollFd_ = -1;
+
+        // publishers write to it from other threads, only ever with <mutex_> held
+        std::lock_guard<std::mutex> lock(mutex_);
+        if (wakeFd_ >= 0)
+            ::close(wakeFd_);
+        wakeFd_ = -1;
+    }
+
+    /**
+     * @brief Replaces the snapshot and pushes <event> to every subscriber. Thread safe.
+     * @param snapshot Body served on the snapshot path (json)
+     * @param event Complete SSE event, including the trailing blank line
+     */
+    void publish(const std::string &snapshot, std::string event) {
+        auto snapshotResponse = std::make_shared<const std::string>(response("200 OK", "application/json", snapshot));
+        auto eventPayload = std::make_shared<const std::string>(std::move(event));
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            snapshot_ = std::move(snapshotResponse);
+            event_ = std::move(eventPayload);
+            version_++;
+            wake();
+        }
+    }
+
+    size_t subscriberCount() const noexcept { return subscribers_; }
+
+  private:
+    typedef std::shared_ptr<const std::string> Payload;
+
+    struct Connection {
+        std::chrono::steady_clock::time_point acceptedAt;
+        std::string request;      ///< request head, until it's complete
+        Payload out;              ///< payload being written
+        size_t outOffset = 0;
+        Payload next;             ///< newest payload queued behind <out>
+        bool isSubscriber = false;
+        bool closeWhenFlushed = false;
+        bool isWriteWatched = false;
+    };
+
+    static constexpr size_t MAX_REQUEST_SIZE = 4096;
+    static constexpr std::chrono::seconds HEARTBEAT_INTERVAL{15};
+    static constexpr std::chrono::seconds REQUEST_TIMEOUT{5};
+
+    static std::string response(const char *status, const char *type, const std::string &body) {
+        return std::string("HTTP/1.1 ") + status + "\r\n"
+            + "Content-Type: " + type + "\r\n"
+            + "Content-Length: " + std::to_string(body.size()) + "\r\n"
+            + "Access-Control-Allow-Origin: *\r\n"
+            + "Connection: close\r\n\r\n" + body;
+    }
+
+    void watch(int fd, uint32_t events) {
+        epoll_event ev{};
+        ev.events = events;
+        ev.data.fd = fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_ADD, fd, &ev);
+    }
+
+    /// @brief Interrupts epoll_wait, called with <mutex_> held so <stop> can't close the descriptor meanwhile
+    void wake() {
+        uint64_t one = 1;
+        if (wakeFd_ >= 0)
+            (void) !::write(wakeFd_, &one, sizeof(one));
+    }
+
+    void loop() {
+        epoll_event events[256];
+        uint64_t sentVersion = 0;
+        auto lastBroadcast = std::chrono::steady_clock::now();
+        auto lastSweep = lastBroadcast;
+
+        while (isRunning_) {
+            auto n = epoll_wait(epollFd_, events, 256, 1000);
+
+            for (int i = 0; i < n; i++) {
+                auto fd = events[i].data.fd;
+                if (fd == listenFd_) {
+                    acceptAll();
+                } else if (fd == wakeFd_) {
+                    uint64_t count;
+                    (void) !::read(fd, &count, sizeof(count));
+                } else {
+                    auto it = connections_.find(fd);
+                    if (it == connections_.end())
+                        continue;
+
+                    bool keep = true;
+                    if (events[i].events & (EPOLLERR | EPOLLHUP))
+                        keep = false;
+                    if (keep && (events[i].events & EPOLLIN))
+                        keep = onReadable(fd, *it->second);
+                    if (keep && (events[i].events & EPOLLOUT))
+                        keep = flush(fd, *it->second);
+                    if (!keep)
+                        close(it);
+                }
+            }
+
+            Payload event;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                if (version_ != sentVersion) {
+                    sentVersion = version_;
+                    event = event_;
+                }
+            }
+
+            auto now = std::chrono::steady_clock::now();
+            if (event) {
+                broadcast(event, false);
+                lastBroadcast = now;
+            } else if (now - lastBroadcast >= HEARTBEAT_INTERVAL) {
+                broadcast(heartbeat_, true);
+                lastBroadcast = now;
+            }
+
+            // epoll_wait times out every second, so this runs at least that often
+            if (now - lastSweep >= std::chrono::seconds(1)) {
+                dropStalled(now);
+                lastSweep = now;
+            }
+        }
+    }
+
+    void acceptAll() {
+        for (;;) {
+            auto fd = accept4(listenFd_, nullptr, nullptr, SOCK_NONBLOCK | SOCK_CLOEXEC);
+            if (fd < 0)
+                return;
+
+            std::unique_ptr<Connection> conn(new Connection());
+            conn->acceptedAt = std::chrono::steady_clock::now();
+            connections_.emplace(fd, std::move(conn));
+            watch(fd, EPOLLIN | EPOLLRDHUP);
+        }
+    }
+
+    /// @brief Closes the connections still without a complete request head after <REQUEST_TIMEOUT>
+    void dropStalled(std::chrono::steady_clock::time_point now) {
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            auto &conn = *it->second;
+            if (!conn.isSubscriber && !conn.closeWhenFlushed && now - conn.acceptedAt >= REQUEST_TIMEOUT)
+                it = close(it);
+            else
+                ++it;
+        }
+    }
+
+    /**
+     * @return false if the connection should be closed
+     */
+    bool onReadable(int fd, Connection &conn) {
+        char buffer[1024];
+        for (;;) {
+            auto n = ::recv(fd, buffer, sizeof(buffer), 0);
+            if (n == 0)
+                return false;
+            if (n < 0)
+                return errno == EAGAIN || errno == EWOULDBLOCK;
+
+            // subscribers have nothing more to say, anything they send is ignored
+            if (conn.isSubscriber || conn.closeWhenFlushed)
+                continue;
+
+            conn.request.append(buffer, static_cast<size_t>(n));
+            if (conn.request.find("\r\n\r\n") != std::string::npos)
+                return route(fd, conn);
+            if (conn.request.size() > MAX_REQUEST_SIZE)
+                return false;
+        }
+    }
+
+    bool route(int fd, Connection &conn) {
+        // "GET /path?query HTTP/1.1"
+        auto pathBegin = conn.request.find(' ') + 1;
+        auto pathEnd = conn.request.find_first_of(" ?", pathBegin);
+        auto method = conn.request.substr(0, pathBegin - 1);
+        auto path = conn.request.substr(pathBegin, pathEnd - pathBegin);
+        std::string().swap(conn.request);
+
+        Payload snapshot, event;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            snapshot = snapshot_;
+            event = event_;
+        }
+
+        if (method == "GET" && path == eventsPath_) {
+            static const Payload headers = std::make_shared<const std::string>(
+                "HTTP/1.1 200 OK\r\n"
+                "Content-Type: text/event-stream\r\n"
+                "Cache-Control: no-cache\r\n"
+                "Access-Control-Allow-Origin: *\r\n"
+                "Connection: keep-alive\r\n\r\n");
+
+            conn.isSubscriber = true;
+            subscribers_++;
+            queue(conn, headers);
+            if (!event->empty())
+                queue(conn, event);
+        } else {
+            static const Payload notFound = std::make_shared<const std::string>(response("404 Not Found", "text/plain", ""));
+            conn.closeWhenFlushed = true;
+            queue(conn, method == "GET" && path == snapshotPath_ ? snapshot : notFound);
+        }
+        return flush(fd, conn);
+    }
+
+    /**
+     * @param isHeartbeat only queued if nothing else is, it must not replace an event waiting in <next>
+     */
+    void queue(Connection &conn, const Payload &payload, bool isHeartbeat = false) {
+        if (!conn.out) {
+            conn.out = payload;
+            conn.outOffset = 0;
+        } else if (!isHeartbeat || !conn.next) {
+            conn.next = payload;
+        }
+    }
+
+    /**
+     * @brief Writes as much of the pending output as the socket takes
+     * @return false if the connection should be closed
+     */
+    bool flush(int fd, Connection &conn) {
+        while (conn.out) {
+            auto &data = *conn.out;
+            auto n = ::send(fd, data.data() + conn.outOffset, data.size() - conn.outOffset, MSG_NOSIGNAL);
+            if (n < 0) {
+                if (errno != EAGAIN && errno != EWOULDBLOCK)
+                    return false;
+                setWriteWatched(fd, conn, true);
+                return true;
+            }
+
+            conn.outOffset += static_cast<size_t>(n);
+            if (conn.outOffset == data.size()) {
+                conn.out = std::move(conn.next);
+                conn.next.reset();
+                conn.outOffset = 0;
+            }
+        }
+
+        setWriteWatched(fd, conn, false);
+        return !conn.closeWhenFlushed;
+    }
+
+    void setWriteWatched(int fd, Connection &conn, bool watched) {
+        if (conn.isWriteWatched == watched)
+            return;
+        conn.isWriteWatched = watched;
+
+        epoll_event ev{};
+        ev.events = EPOLLIN | EPOLLRDHUP | (watched ? EPOLLOUT : 0u);
+        ev.data.fd = fd;
+        epoll_ctl(epollFd_, EPOLL_CTL_MOD, fd, &ev);
+    }
+
+    void broadcast(const Payload &event, bool isHeartbeat) {
+        for (auto it = connections_.begin(); it != connections_.end();) {
+            auto &conn = *it->second;
+            if (conn.isSubscriber) {
+                queue(conn, event, isHeartbeat);
+                if (!conn.isWriteWatched && !flush(it->first, conn)) {
+                    it = close(it);
+                    continue;
+                }
+            }
+            ++it;
+        }
+    }
+
+    std::unordered_map<int, std::unique_ptr<Connection>>::iterator
+    close(std::unordered_map<int, std::unique_ptr<Connection>>::iterator it) {
+        if (it->second->isSubscriber)
+            subscribers_--;
+        ::close(it->first);  // also drops it from the epoll set
+        return connections_.erase(it);
+    }
+
+    const std::string snapshotPath_;
+    const std::string eventsPath_;
+
+    int listenFd_ = -1;
+    int epollFd_ = -1;
+    std::atomic<int> wakeFd_{-1};  ///< closed by <stop> with <mutex_> held
+    std::thread thread_;
+    std::atomic<bool> isRunning_{false};
+
+    // owned by the loop thread
+    std::unordered_map<int, std::unique_ptr<Connection>> connections_;
+    std::atomic<size_t> subscribers_{0};
+
+    // latest publication, guarded by <mutex_>
+    std::mutex mutex_;
+    Payload snapshot_;
+    Payload event_;
+    const Payload heartbeat_;
+    uint64_t version_ = 0;
+};
+
+#endif
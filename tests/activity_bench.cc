@@ -0,0 +1,110 @@
+/**
+ * @file    activity_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Microbenchmark of what a presence update costs before it reaches discord:
+ *
+ *  activity_bench [--sends=<n>]
+ *
+ * Times building the whole DiscordActivity of a track on every send, as the loop used to, against
+ * presenceActivity() sending the same track again (a repeat or a resume, only the timestamps
+ * patched) and a new track every time (the cache missing). The json the --all-clients presence
+ * sends is timed for comparison. Exits with 1 if the patched activity isn't the one built anew.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <string>
+// local libs
+#include "linux_api_hook.hh"
+#include "rpc_loop.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+
+/// @brief Keeps the compiler from dropping what is timed
+static volatile int64_t sink;
+
+/// @brief ns a call of <send>(i), over <count> calls
+template <class Send>
+static double measure(size_t count, Send send) {
+    auto start = clock_type::now();
+    for (size_t i = 0; i < count; i++)
+        send(i);
+    return std::chrono::duration<double, std::nano>(clock_type::now() - start).count() / count;
+}
+
+int main(int argc, char **argv) {
+    size_t count = 1000000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--sends=", 0) == 0 && std::stoul(arg.substr(8)) > 0) {
+            count = std::stoul(arg.substr(8));
+        } else {
+            fprintf(stderr, "usage: %s [--sends=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+    isPresenceActive = true;
+
+    Song song;
+    song.title = "Bohemian Rhapsody - Remastered 2011";
+    song.artist = "Queen";
+    song.album = "A Night At The Opera (2011 Remaster)";
+    song.cover_id = "d156d3e0-a5cd-4066-8c36-b13edab7bbcc";
+    snprintf(song.id, sizeof(song.id), "%u", 36737274u);
+    song.runtime = 355;
+    song.starttime = 1600000000;
+    song.loaded = true;
+    song.revision = 1;
+
+    auto rebuilt = measure(count, [&song](size_t i) {
+        DiscordActivity activity;
+        buildActivity(song, activity);
+        activity.timestamps.start = song.starttime + static_cast<int64_t>(i);
+        activity.timestamps.end = song.endtime() + static_cast<int64_t>(i);
+        sink = activity.timestamps.start + activity.details[0];
+    });
+
+    auto patched = measure(count, [&song](size_t i) {
+        song.starttime = 1600000000 + static_cast<int64_t>(i);
+        auto &activity = presenceActivity(song);
+        sink = activity.timestamps.start + activity.details[0];
+    });
+
+    auto missed = measure(count, [&song](size_t i) {
+        song.revision = 2 + i;
+        auto &activity = presenceActivity(song);
+        sink = activity.timestamps.start + activity.details[0];
+    });
+
+    auto json = measure(count / 10, [&song](size_t) {
+        sink = static_cast<int64_t>(activityJson(presenceActivity(song)).size());
+    });
+
+    printf("%zu sends each, ns a send\n", count);
+    printf("%-48s %8.1f\n", "whole activity built every send", rebuilt);
+    printf("%-48s %8.1f\n", "presenceActivity(), same track (patched)", patched);
+    printf("%-48s %8.1f\n", "presenceActivity(), new track every send", missed);
+    printf("%-48s %8.1f\n", "activityJson() of it (--all-clients)", json);
+    if (patched > 0)
+        printf("patching is %.0fx as fast as building\n", rebuilt / patched);
+
+    // the patched activity has to be what building it anew gives
+    song.revision = 7;
+    song.starttime = 1600000123;
+    presenceActivity(song);
+    song.starttime = 1600000456;
+    auto &cached = presenceActivity(song);
+    DiscordActivity fresh;
+    buildActivity(song, fresh);
+    fresh.timestamps.start = song.starttime;
+    fresh.timestamps.end = song.endtime();
+    if (memcmp(&cached, &fresh, sizeof(fresh)) != 0) {
+        printf("the patched activity differs from one built anew\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,178 @@
+/**
+ * @file    by_id_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Benchmark of what a lookup costs when the track id is known, /v1/tracks/{id} against the
+ * /v1/search with limit=50 it replaces:
+ *
+ *  by_id_bench [--lookups=<n>]
+ *
+ * Both responses are canned in the shape of the v1 api, every field a real track object has
+ * included; the search answers 50 tracks, the one looked for first. Prints the payload
+ * bytes (gzip'd as well when built with zlib), the time to parse each response alone and to
+ * resolve through <TrackResolver> answered by it, which adds matching and extracting the fields.
+ * Exits with 1 if the two paths resolve to different tracks or the by-id one searched.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <memory>
+#include <string>
+// local libs
+#include "clock.hh"
+#include "httplib.hh"
+#include "json.hh"
+#include "track_resolver.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+
+/// @brief Keeps the compiler from dropping what is timed
+static volatile size_t sink;
+
+/// @brief A track object as the v1 api sends it, by id and in searches
+static nlohmann::json track(unsigned id, const std::string &title, const std::string &artist, unsigned artistId) {
+    nlohmann::json artistJson = {{"id", artistId}, {"name", artist}, {"handle", nullptr}, {"type", "MAIN"},
+                                 {"picture", "0b4f8f86-7a2e-4b52-b3b5-6a2fd43e" + std::to_string(1000 + artistId % 9000)}};
+    return {{"id", id},
+            {"title", title},
+            {"duration", 180 + id % 200},
+            {"replayGain", -8.74},
+            {"peak", 0.988312},
+            {"allowStreaming", true},
+            {"streamReady", true},
+            {"adSupportedStreamReady", true},
+            {"djReady", true},
+            {"stemReady", false},
+            {"streamStartDate", "2011-01-01T00:00:00.000+0000"},
+            {"premiumStreamingOnly", false},
+            {"trackNumber", 1 + id % 12},
+            {"volumeNumber", 1},
+            {"version", nullptr},
+            {"popularity", 40 + id % 60},
+            {"copyright", "(P) 2011 " + artist + " Records Ltd, under exclusive licence to Some Label Ltd"},
+            {"bpm", 72 + id % 80},
+            {"url", "http://www.tidal.com/track/" + std::to_string(id)},
+            {"isrc", "GBUM7" + std::to_string(1000000 + id)},
+            {"editable", false},
+            {"explicit", false},
+            {"audioQuality", id % 3 ? "LOSSLESS" : "HI_RES"},
+            {"audioModes", {"STEREO"}},
+            {"mediaMetadata", {{"tags", {"LOSSLESS", "HIRES_LOSSLESS"}}}},
+            {"upload", false},
+            {"accessType", "PUBLIC"},
+            {"spotlighted", false},
+            {"artist", artistJson},
+            {"artists", {artistJson}},
+            {"album",
+             {{"id", id / 10 + 100000},
+              {"title", title + " (Deluxe Edition)"},
+              {"cover", "d156d3e0-a5cd-4066-8c36-" + std::to_string(100000000000 + id)},
+              {"vibrantColor", "#f2d869"},
+              {"videoCover", nullptr},
+              {"releaseDate", "2011-01-01"}}},
+            {"mixes", {{"TRACK_MIX", "0019d0b9e5f5b0b4c7e5a6d81b6c8f" + std::to_string(id % 100)}}}};
+}
+
+static std::string gzipped(std::string content) {
+#ifdef CPPHTTPLIB_ZLIB_SUPPORT
+    httplib::detail::compress(content);
+    return content;
+#else
+    return std::string();
+#endif
+}
+
+/// @brief µs a call of <work>, over <count> calls
+template <class Work>
+static double measure(size_t count, Work work) {
+    auto start = clock_type::now();
+    for (size_t i = 0; i < count; i++)
+        work();
+    return std::chrono::duration<double, std::micro>(clock_type::now() - start).count() / count;
+}
+
+int main(int argc, char **argv) {
+    size_t count = 2000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--lookups=", 0) == 0 && std::stoul(arg.substr(10)) > 0) {
+            count = std::stoul(arg.substr(10));
+        } else {
+            fprintf(stderr, "usage: %s [--lookups=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    // a search finds covers and live versions of the track by other artists as well, ranked below it
+    const unsigned ID = 36737274;
+    const std::string TITLE = "Bohemian Rhapsody", ARTIST = "Queen";
+    nlohmann::json items = nlohmann::json::array();
+    for (unsigned i = 0; i < 50; i++) {
+        if (i == 0)
+            items.push_back(track(ID, TITLE, ARTIST, 8992));
+        else
+            items.push_back(track(ID + 1 + i, i % 2 ? TITLE + " - Live Aid" : TITLE, "Cover Band " + std::to_string(i),
+                                  20000 + i));
+    }
+    auto searchResponse = std::make_shared<httplib::Response>();
+    searchResponse->status = 200;
+    searchResponse->body = nlohmann::json{{"tracks",
+                                           {{"limit", 50},
+                                            {"offset", 0},
+                                            {"totalNumberOfItems", 300},
+                                            {"items", items}}}}.dump();
+    auto byIdResponse = std::make_shared<httplib::Response>();
+    byIdResponse->status = 200;
+    byIdResponse->body = track(ID, TITLE, ARTIST, 8992).dump();
+
+    uint64_t searches = 0, byId = 0;
+    ApiQuery query = [&](const std::string &path, const httplib::Headers &) {
+        if (path.rfind("/v1/search", 0) == 0) {
+            searches++;
+            return searchResponse;
+        }
+        byId++;
+        return byIdResponse;
+    };
+    SystemClock clock;
+
+    // a resolver a lookup, the responses would be shared for <TrackResolver::LINGER> otherwise
+    TrackInfo searched, looked;
+    auto parseSearch = measure(count, [&]() { sink = nlohmann::json::parse(searchResponse->body).size(); });
+    auto parseById = measure(count, [&]() { sink = nlohmann::json::parse(byIdResponse->body).size(); });
+    auto resolveSearch = measure(count, [&]() {
+        TrackResolver resolver(query, clock);
+        searched = resolver.resolve(TITLE, ARTIST);
+    });
+    auto searchesBefore = searches;
+    auto resolveById = measure(count, [&]() {
+        TrackResolver resolver(query, clock);
+        looked = resolver.resolve(TITLE, ARTIST, ID);
+    });
+    Logger::instance().flush();
+
+    printf("%zu lookups each\n", count);
+    printf("%-22s %12s %12s %12s %12s\n", "", "bytes", "gzip'd", "parse us", "resolve us");
+    printf("%-22s %12zu %12zu %12.1f %12.1f\n", "/v1/search limit=50", searchResponse->body.size(),
+           gzipped(searchResponse->body).size(), parseSearch, resolveSearch);
+    printf("%-22s %12zu %12zu %12.1f %12.1f\n", "/v1/tracks/{id}", byIdResponse->body.size(),
+           gzipped(byIdResponse->body).size(), parseById, resolveById);
+    if (resolveById > 0)
+        printf("by id: %.0fx fewer bytes, resolved %.0fx as fast\n",
+               static_cast<double>(searchResponse->body.size()) / byIdResponse->body.size(),
+               resolveSearch / resolveById);
+
+    if (searches != searchesBefore || byId != count) {
+        printf("the by-id path searched\n");
+        return 1;
+    }
+    if (!searched.isFound || !looked.isFound || searched.id != ID || looked.id != ID ||
+        searched.album != looked.album || searched.coverId != looked.coverId || searched.quality != looked.quality ||
+        searched.runtime != looked.runtime) {
+        printf("the search and the by-id lookup resolved different tracks\n");
+        return 1;
+    }
+    return 0;
+}
@@ -0,0 +1,34 @@
+/**
+ * @file    checks.hh
+ * @authors Stavros Avramidis
+ *
+ * CHECK() of the tests: reports a failed condition and carries on, main() returns checkResult().
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <cstdio>
+
+
+inline int &checkFailures() {
+    static int failures = 0;
+    return failures;
+}
+
+#define CHECK(condition)                                                                \
+    do {                                                                                \
+        if (!(condition)) {                                                             \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition);      \
+            checkFailures()++;                                                          \
+        }                                                                               \
+    } while (0)
+
+/// @brief Exit code of a test, prints PASS if no check failed
+inline int checkResult() {
+    if (checkFailures())
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
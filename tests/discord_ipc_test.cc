@@ -0,0 +1,266 @@
+/**
+ * @file    discord_ipc_test.cc
+ * @authors Stavros Avramidis
+ *
+ * The --all-clients presence against stand-ins of discord clients: unix sockets named
+ * discord-ipc-N in a temporary $XDG_RUNTIME_DIR that answer the handshake and every
+ * SET_ACTIVITY. Checks that a <DiscordIpcFanout> reaches all of them, that a slow one doesn't
+ * hold up the others, and that quitting clears the presence and closes every pipe.
+ */
+
+// cpp libs
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <filesystem>
+#include <functional>
+#include <memory>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+// linux api
+#include <poll.h>
+#include <sys/socket.h>
+#include <sys/un.h>
+#include <unistd.h>
+// local libs
+#include "checks.hh"
+#include "linux_api_hook.hh"
+#include "rpc_loop.hh"
+
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+
+/**
+ * @brief A discord client listening on <path>: answers the handshake with READY and every
+ * SET_ACTIVITY after <replyDelay>, and keeps the activities it got
+ */
+class FakeClient {
+  public:
+    FakeClient(const std::string &path, std::chrono::milliseconds replyDelay) : replyDelay_(replyDelay) {
+        listener_ = socket(AF_UNIX, SOCK_STREAM, 0);
+        sockaddr_un addr{};
+        addr.sun_family = AF_UNIX;
+        snprintf(addr.sun_path, sizeof(addr.sun_path), "%s", path.c_str());
+        if (bind(listener_, reinterpret_cast<sockaddr *>(&addr), sizeof(addr)) != 0 || listen(listener_, 4) != 0)
+            fprintf(stderr, "Could not listen on %s\n", path.c_str());
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~FakeClient() {
+        isStopping_ = true;
+        thread_.join();
+        close(listener_);
+    }
+
+    /// @brief The activities of the SET_ACTIVITY commands so far, as json, "null" for a clear
+    std::vector<std::string> activities() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return activities_;
+    }
+
+    bool isHandshaken() const { return isHandshaken_; }
+
+    /// @brief Whether the last connection ended with a close frame
+    bool isClosed() const { return isClosed_; }
+
+    /// @brief Whether a SET_ACTIVITY came with another pid than this process's
+    bool isPidWrong() const { return isPidWrong_; }
+
+  private:
+    void run() {
+        while (!isStopping_) {
+            pollfd pfd{listener_, POLLIN, 0};
+            if (poll(&pfd, 1, 20) <= 0)
+                continue;
+            auto fd = accept(listener_, nullptr, nullptr);
+            if (fd >= 0) {
+                serve(fd);
+                close(fd);
+            }
+        }
+    }
+
+    void serve(int fd) {
+        uint32_t opcode;
+        std::string payload;
+        while (!isStopping_ && readFrame(fd, opcode, payload)) {
+            if (opcode == discord_ipc::close) {
+                isClosed_ = true;
+                return;
+            }
+            if (opcode == discord_ipc::handshake) {
+                isHandshaken_ = true;
+                writeFrame(fd, discord_ipc::frame, R"({"cmd":"DISPATCH","evt":"READY","data":{"v":1}})");
+                continue;
+            }
+
+            auto command = nlohmann::json::parse(payload, nullptr, false);
+            if (command.is_discarded() || command.value("cmd", "") != "SET_ACTIVITY")
+                continue;
+            {
+                std::lock_guard<std::mutex> lock(mutex_);
+                activities_.push_back(command["args"]["activity"].dump());
+            }
+            if (command["args"]["pid"] != static_cast<unsigned long>(getpid()))
+                isPidWrong_ = true;
+            std::this_thread::sleep_for(replyDelay_);
+            nlohmann::json reply = {{"cmd", "SET_ACTIVITY"}, {"evt", nullptr}, {"nonce", command["nonce"]},
+                                    {"data", nlohmann::json::object()}};
+            writeFrame(fd, discord_ipc::frame, reply.dump());
+        }
+    }
+
+    /// @brief Waits for a whole frame, false once the connection is gone or the client stops
+    bool readFrame(int fd, uint32_t &opcode, std::string &payload) {
+        char header[8];
+        if (!readAll(fd, header, sizeof(header)))
+            return false;
+        opcode = getU32(header);
+        payload.resize(getU32(header + 4));
+        return payload.empty() || readAll(fd, &payload[0], payload.size());
+    }
+
+    bool readAll(int fd, char *data, size_t size) {
+        while (size) {
+            pollfd pfd{fd, POLLIN, 0};
+            if (isStopping_)
+                return false;
+            if (poll(&pfd, 1, 20) <= 0)
+                continue;
+            auto got = recv(fd, data, size, 0);
+            if (got <= 0)
+                return false;
+            data += got;
+            size -= got;
+        }
+        return true;
+    }
+
+    static void writeFrame(int fd, uint32_t opcode, const std::string &payload) {
+        std::string frame(8, '\0');
+        putU32(&frame[0], opcode);
+        putU32(&frame[4], static_cast<uint32_t>(payload.size()));
+        frame += payload;
+        send(fd, frame.data(), frame.size(), MSG_NOSIGNAL);
+    }
+
+    static void putU32(char *out, uint32_t value) {
+        for (int i = 0; i < 4; i++)
+            out[i] = static_cast<char>(value >> (8 * i));
+    }
+
+    static uint32_t getU32(const char *in) {
+        uint32_t value = 0;
+        for (int i = 0; i < 4; i++)
+            value |= static_cast<uint32_t>(static_cast<unsigned char>(in[i])) << (8 * i);
+        return value;
+    }
+
+    int listener_ = -1;
+    std::chrono::milliseconds replyDelay_;
+    std::thread thread_;
+    std::atomic<bool> isStopping_{false};
+    std::atomic<bool> isHandshaken_{false};
+    std::atomic<bool> isClosed_{false};
+    std::atomic<bool> isPidWrong_{false};
+    mutable std::mutex mutex_;
+    std::vector<std::string> activities_;
+};
+
+/// @brief Waits up to <timeout> for <condition>
+static bool waitFor(const std::function<bool()> &condition, std::chrono::milliseconds timeout) {
+    auto deadline = clock_type::now() + timeout;
+    while (!condition()) {
+        if (clock_type::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(5ms);
+    }
+    return true;
+}
+
+static bool hasLast(const FakeClient &client, const std::string &text) {
+    auto activities = client.activities();
+    return !activities.empty() && activities.back().find(text) != std::string::npos;
+}
+
+int main() {
+    std::error_code error;
+    auto dir = std::filesystem::temp_directory_path(error) /
+               ("discord_ipc_test." + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(dir, error);
+    setenv("XDG_RUNTIME_DIR", dir.c_str(), 1);
+    isPresenceActive = true;
+
+    {
+        // two clients, and one that is slow to answer on a pipe after a free one
+        std::vector<std::unique_ptr<FakeClient>> clients;
+        clients.emplace_back(new FakeClient((dir / "discord-ipc-0").string(), 0ms));
+        clients.emplace_back(new FakeClient((dir / "discord-ipc-1").string(), 0ms));
+        clients.emplace_back(new FakeClient((dir / "discord-ipc-3").string(), 800ms));
+
+        DiscordIpcSink allClients;
+        QuittablePresence presence(allClients);
+        CHECK(presence.connect());
+        CHECK(waitFor([&clients]() {
+            for (auto &client : clients)
+                if (!client->isHandshaken())
+                    return false;
+            return true;
+        }, 2s));
+        CHECK(presence.isConnected());
+
+        Song song;
+        song.title = "First Song";
+        song.artist = "First Artist";
+        song.cover_id = "aa-bb";
+        song.id[0] = '\0';
+        song.runtime = 200;
+        song.starttime = 1600000000;
+        song.loaded = true;
+        song.revision = 1;
+
+        // the slow client holds up only itself
+        presence.update(song);
+        CHECK(waitFor([&clients]() { return hasLast(*clients[0], "First Song") && hasLast(*clients[1], "First Song"); },
+                      200ms));
+        CHECK(waitFor([&clients]() { return hasLast(*clients[2], "First Song"); }, 200ms));
+        song.title = "Second Song";
+        song.revision = 2;
+        presence.update(song);
+        CHECK(waitFor([&clients]() { return hasLast(*clients[0], "Second Song") && hasLast(*clients[1], "Second Song"); },
+                      200ms));
+        CHECK(waitFor([&clients]() { return hasLast(*clients[2], "Second Song"); }, 2s));
+
+        // quitting clears the presence on all of them and closes the pipes, then the loop's
+        // calls do nothing
+        auto started = clock_type::now();
+        presence.quit();
+        printf("quit in %lld ms\n", static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                        clock_type::now() - started).count()));
+        for (auto &client : clients) {
+            CHECK(waitFor([&client]() { return client->isClosed(); }, 2s));
+            auto activities = client->activities();
+            CHECK(!activities.empty() && activities.back() == "null");
+            CHECK(!client->isPidWrong());
+        }
+        CHECK(presence.isQuit());
+        CHECK(!presence.isConnected());
+        CHECK(!presence.connect());
+        auto count = clients[0]->activities().size();
+        presence.update(song);
+        std::this_thread::sleep_for(100ms);
+        CHECK(clients[0]->activities().size() == count);
+        for (auto &client : clients)
+            printf("%zu activities, the last one %s\n", client->activities().size(),
+                   client->activities().back().c_str());
+    }
+
+    std::filesystem::remove_all(dir, error);
+    Logger::instance().flush();
+    return checkResult();
+}
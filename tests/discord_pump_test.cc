@@ -0,0 +1,261 @@
+/**
+ * @file    discord_pump_test.cc
+ * @authors Stavros Avramidis
+ *
+ * The <DiscordPump> against a stub of the discord SDK core that answers every update_activity
+ * as scripted, late, out of order or with an error. Checks that completions are matched to the
+ * updates they belong to, that a completion from a core that was replaced is ignored, that failed
+ * updates are retried with a doubling backoff and that a newer update supersedes a retry.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <deque>
+#include <functional>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// local libs
+#include "checks.hh"
+#include "discord_pump.hh"
+
+using namespace std::chrono_literals;
+using clock_type = DiscordPump::clock;
+
+
+/**
+ * @brief A discord core whose activity manager queues every update_activity until
+ * run_callbacks is due to answer it as scripted
+ */
+class StubSdk {
+  public:
+    struct Reply {
+        EDiscordResult result;
+        std::chrono::milliseconds delay;
+    };
+
+    struct Sent {
+        std::string details;
+        clock_type::time_point at;
+    };
+
+    StubSdk() {
+        memset(&sdk_, 0, sizeof(sdk_));
+        sdk_.owner = this;
+        sdk_.core.run_callbacks = [](IDiscordCore *core) {
+            reinterpret_cast<Sdk *>(core)->owner->answerDue();
+            return DiscordResult_Ok;
+        };
+        sdk_.core.get_activity_manager = [](IDiscordCore *core) { return &reinterpret_cast<Sdk *>(core)->manager; };
+        sdk_.manager.update_activity = [](IDiscordActivityManager *manager, DiscordActivity *activity, void *data,
+                                          void (*callback)(void *, EDiscordResult)) {
+            auto sdk = reinterpret_cast<Sdk *>(reinterpret_cast<char *>(manager) - offsetof(Sdk, manager));
+            sdk->owner->queue(*activity, data, callback);
+        };
+    }
+
+    IDiscordCore *core() { return &sdk_.core; }
+
+    /// @brief How the next updates are answered, Ok right away after the script ran out
+    void script(std::vector<Reply> replies) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        script_.assign(replies.begin(), replies.end());
+    }
+
+    std::vector<Sent> sent() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return sent_;
+    }
+
+    /// @brief The details of the updates answered so far, in the order they were
+    std::vector<std::string> answered() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return answered_;
+    }
+
+    /// @brief Answers the updates that are due, as run_callbacks does
+    void answerDue() {
+        std::vector<Pending> due;
+        {
+            std::lock_guard<std::mutex> lock(mutex_);
+            auto now = clock_type::now();
+            for (auto it = pending_.begin(); it != pending_.end();) {
+                if (it->answerAt <= now) {
+                    due.push_back(*it);
+                    answered_.push_back(it->details);
+                    it = pending_.erase(it);
+                } else {
+                    ++it;
+                }
+            }
+        }
+        for (auto &pending : due)
+            pending.callback(pending.data, pending.result);
+    }
+
+  private:
+    /// @brief What the pump gets a pointer of, the core first
+    struct Sdk {
+        IDiscordCore core;
+        IDiscordActivityManager manager;
+        StubSdk *owner;
+    };
+
+
+    struct Pending {
+        std::string details;
+        void *data;
+        void (*callback)(void *, EDiscordResult);
+        EDiscordResult result;
+        clock_type::time_point answerAt;
+    };
+
+    void queue(const DiscordActivity &activity, void *data, void (*callback)(void *, EDiscordResult)) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto now = clock_type::now();
+        Reply reply{DiscordResult_Ok, 0ms};
+        if (!script_.empty()) {
+            reply = script_.front();
+            script_.pop_front();
+        }
+        sent_.push_back({activity.details, now});
+        pending_.push_back({activity.details, data, callback, reply.result, now + reply.delay});
+    }
+
+    Sdk sdk_;
+    mutable std::mutex mutex_;
+    std::deque<Reply> script_;
+    std::deque<Pending> pending_;
+    std::vector<Sent> sent_;
+    std::vector<std::string> answered_;
+};
+
+static DiscordActivity activity(const char *details) {
+    DiscordActivity activity;
+    memset(&activity, 0, sizeof(activity));
+    snprintf(activity.details, sizeof(activity.details), "%s", details);
+    return activity;
+}
+
+/// @brief Waits up to <timeout> for <condition>
+static bool waitFor(const std::function<bool()> &condition, std::chrono::milliseconds timeout) {
+    auto deadline = clock_type::now() + timeout;
+    while (!condition()) {
+        if (clock_type::now() >= deadline)
+            return false;
+        std::this_thread::sleep_for(2ms);
+    }
+    return true;
+}
+
+static void useCore(IDiscordCore *core) {
+    auto &pump = DiscordPump::instance();
+    pump.call([&pump, core]() {
+        pump.setCore(core);
+        return 0;
+    });
+}
+
+static double ms(clock_type::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+int main() {
+    auto &pump = DiscordPump::instance();
+    StubSdk stub, replacement;
+    useCore(stub.core());
+
+    // acknowledged late: the latency is the stub's delay, to within a pump interval
+    stub.script({{DiscordResult_Ok, 120ms}});
+    auto before = pump.metrics();
+    pump.update(activity("A"));
+    CHECK(waitFor([&]() { return pump.metrics().acknowledged == before.acknowledged + 1; }, 2s));
+    auto after = pump.metrics();
+    printf("acknowledged after %llu ms\n", static_cast<unsigned long long>(after.lastAckMs));
+    CHECK(after.lastAckMs >= 120 && after.lastAckMs < 120 + 100);
+    CHECK(after.sent == before.sent + 1 && after.retried == before.retried);
+
+    // two in flight, answered the other way round: each completion is its own update's
+    stub.script({{DiscordResult_Ok, 300ms}, {DiscordResult_Ok, 50ms}});
+    before = pump.metrics();
+    pump.update(activity("B"));
+    CHECK(waitFor([&]() { return stub.sent().size() == 2; }, 1s));
+    pump.update(activity("C"));
+    CHECK(waitFor([&]() { return pump.metrics().acknowledged == before.acknowledged + 2; }, 2s));
+    after = pump.metrics();
+    auto answered = stub.answered();
+    CHECK(answered.size() == 3 && answered[1] == "C" && answered[2] == "B");
+    // B took the longer, whichever order they came in
+    CHECK(after.lastAckMs >= 300 && after.lastAckMs < 300 + 100);
+    auto total = after.totalAckMs - before.totalAckMs;
+    CHECK(total >= 300 + 50 && total < 300 + 50 + 150);
+    CHECK(after.failed == before.failed && after.superseded == before.superseded);
+
+    // the core replaced with an update in flight, its completion arriving late while an update of
+    // the new core is in flight: it is dropped, not taken for the new update's
+    stub.script({{DiscordResult_Ok, 150ms}});
+    replacement.script({{DiscordResult_Ok, 400ms}});
+    pump.update(activity("D"));
+    CHECK(waitFor([&]() { return stub.sent().size() == 4; }, 1s));
+    useCore(replacement.core());
+    before = pump.metrics();
+    pump.update(activity("E"));
+    CHECK(waitFor([&]() { return replacement.sent().size() == 1; }, 1s));
+    std::this_thread::sleep_for(200ms);
+    pump.call([&stub]() {
+        stub.answerDue();
+        return 0;
+    });
+    answered = stub.answered();
+    CHECK(answered.size() == 4 && answered[3] == "D");
+    CHECK(pump.metrics().acknowledged == before.acknowledged);
+    CHECK(waitFor([&]() { return pump.metrics().acknowledged > before.acknowledged; }, 2s));
+    after = pump.metrics();
+    CHECK(after.acknowledged == before.acknowledged + 1);
+    CHECK(after.lastAckMs >= 400 && after.lastAckMs < 400 + 100);
+
+    // failing three times: retried after 0.5, 1 and 2 s, then acknowledged
+    replacement.script({{DiscordResult_InternalError, 0ms},
+                        {DiscordResult_InternalError, 0ms},
+                        {DiscordResult_InternalError, 0ms},
+                        {DiscordResult_Ok, 0ms}});
+    before = pump.metrics();
+    auto first = replacement.sent().size();
+    pump.update(activity("F"));
+    CHECK(waitFor([&]() { return pump.metrics().acknowledged == before.acknowledged + 1; }, 6s));
+    after = pump.metrics();
+    CHECK(after.failed == before.failed + 3 && after.retried == before.retried + 3);
+    auto sent = replacement.sent();
+    CHECK(sent.size() == first + 4);
+    if (sent.size() == first + 4) {
+        auto backoff = DiscordPump::RETRY_BACKOFF;
+        for (size_t i = first + 1; i < sent.size(); i++, backoff *= 2) {
+            auto gap = ms(sent[i].at - sent[i - 1].at);
+            printf("retry %zu after %.0f ms\n", i - first, gap);
+            CHECK(sent[i].details == "F");
+            CHECK(gap >= backoff.count() && gap < backoff.count() + 150);
+        }
+    }
+
+    // a newer update before the retry is due: the failed one is never sent again
+    replacement.script({{DiscordResult_InternalError, 0ms}});
+    before = pump.metrics();
+    first = replacement.sent().size();
+    pump.update(activity("G"));
+    CHECK(waitFor([&]() { return pump.metrics().failed == before.failed + 1; }, 1s));
+    pump.update(activity("H"));
+    CHECK(waitFor([&]() { return pump.metrics().acknowledged == before.acknowledged + 1; }, 1s));
+    std::this_thread::sleep_for(DiscordPump::RETRY_BACKOFF * 3);
+    after = pump.metrics();
+    sent = replacement.sent();
+    CHECK(sent.size() == first + 2 && sent[first].details == "G" && sent[first + 1].details == "H");
+    CHECK(after.retried == before.retried && after.superseded == before.superseded + 1);
+
+    useCore(nullptr);
+    Logger::instance().flush();
+    return checkResult();
+}
@@ -0,0 +1,177 @@
+/**
+ * @file    gzip_test.cc
+ * @authors Stavros Avramidis
+ *
+ * gzip'd api responses end to end: a search body through a local httplib server compressing
+ * it, and canned responses from a raw socket (chunked, close delimited, cut short), checking
+ * what the client inflates and what it counts on the wire.
+ */
+
+// cpp libs
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+// local libs
+#include "checks.hh"
+#include "httplib.hh"
+#include "mock_api.hh"
+
+
+/**
+ * @brief Answers every connection with the same raw bytes once its request head is in, then
+ * closes it
+ */
+class CannedServer {
+  public:
+    explicit CannedServer(std::string response) : response_(std::move(response)) {
+        listener_ = httplib::detail::create_socket("127.0.0.1", 0, [](socket_t sock, struct addrinfo &ai) {
+            return ::bind(sock, ai.ai_addr, static_cast<socklen_t>(ai.ai_addrlen)) == 0 && ::listen(sock, 4) == 0;
+        });
+        sockaddr_in address{};
+        socklen_t len = sizeof(address);
+        getsockname(listener_, reinterpret_cast<sockaddr *>(&address), &len);
+        port_ = ntohs(address.sin_port);
+        thread_ = std::thread([this]() { run(); });
+    }
+
+    ~CannedServer() {
+        isStopping_ = true;
+        ::shutdown(listener_, SHUT_RDWR);
+        thread_.join();
+        ::close(listener_);
+    }
+
+    int port() const { return port_; }
+
+  private:
+    void run() {
+        while (!isStopping_) {
+            auto fd = accept(listener_, nullptr, nullptr);
+            if (fd < 0)
+                return;
+            std::string request;
+            char buffer[1024];
+            while (request.find("\r\n\r\n") == std::string::npos) {
+                auto n = recv(fd, buffer, sizeof(buffer), 0);
+                if (n <= 0)
+                    break;
+                request.append(buffer, static_cast<size_t>(n));
+            }
+            send(fd, response_.data(), response_.size(), MSG_NOSIGNAL);
+            ::close(fd);
+        }
+    }
+
+    std::string response_;
+    socket_t listener_;
+    int port_ = 0;
+    std::atomic<bool> isStopping_{false};
+    std::thread thread_;
+};
+
+static std::string gzip(std::string content) {
+    httplib::detail::compress(content);
+    return content;
+}
+
+static std::string chunked(const std::string &body, size_t chunkSize) {
+    std::string out;
+    char size[32];
+    for (size_t at = 0; at < body.size(); at += chunkSize) {
+        auto chunk = body.substr(at, chunkSize);
+        snprintf(size, sizeof(size), "%zx\r\n", chunk.size());
+        out += size + chunk + "\r\n";
+    }
+    return out + "0\r\n\r\n";
+}
+
+static std::shared_ptr<httplib::Response> get(int port, bool isDecompressing = true) {
+    httplib::Client client("127.0.0.1", port, 3);
+    client.set_decompress(isDecompressing);
+    return client.Get("/v1/search");
+}
+
+int main() {
+    // a search answer of 50 tracks, as repetitive as the api's
+    std::vector<MockTrack> tracks;
+    for (unsigned i = 0; i < 50; i++)
+        tracks.push_back({1000 + i, "Song number " + std::to_string(i), "Some Artist"});
+    auto body = searchBody(tracks);
+    auto compressed = gzip(body);
+
+    httplib::Server server;
+    server.Get("/v1/search", [&body](const httplib::Request &, httplib::Response &res) {
+        res.set_content(body, "application/json");
+    });
+    server.Get("/cover", [&body](const httplib::Request &, httplib::Response &res) {
+        res.set_content(body, "image/jpeg");
+    });
+    auto port = server.bind_to_any_port("127.0.0.1");
+    std::thread serverThread([&server]() { server.listen_after_bind(); });
+    while (!server.is_running())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // asked for and inflated, over one kept alive connection so the inflater is reused
+    {
+        httplib::Client client("127.0.0.1", port, 3);
+        client.set_keep_alive(true);
+        client.set_decompress(true);
+        size_t same = 0;
+        for (int i = 0; i < 20; i++) {
+            auto res = client.Get("/v1/search");
+            if (res && res->status == 200 && res->body == body && res->get_header_value("Content-Encoding") == "gzip")
+                same++;
+        }
+        CHECK(same == 20);
+        auto &stats = client.get_stats();
+        printf("20 searches of %zu bytes: %llu on the wire, %llu decoded\n", body.size(),
+               static_cast<unsigned long long>(stats.bytes_on_wire),
+               static_cast<unsigned long long>(stats.bytes_decoded));
+        CHECK(stats.requests == 20);
+        CHECK(stats.bytes_decoded == 20 * body.size());
+        CHECK(stats.bytes_on_wire == 20 * compressed.size());
+        CHECK(stats.bytes_on_wire * 2 < stats.bytes_decoded);
+
+        // not for types that don't compress
+        auto res = client.Get("/cover");
+        CHECK(res && res->body == body && !res->has_header("Content-Encoding"));
+        client.set_keep_alive(false);
+    }
+
+    // not asked for, not sent
+    auto plain = get(port, false);
+    CHECK(plain && plain->body == body && !plain->has_header("Content-Encoding"));
+
+    server.stop();
+    serverThread.join();
+
+    const std::string head = "HTTP/1.1 200 OK\r\nContent-Type: application/json\r\nContent-Encoding: gzip\r\n";
+    // chunked, in pieces smaller than the inflater's reads
+    {
+        CannedServer canned(head + "Transfer-Encoding: chunked\r\n\r\n" + chunked(compressed, 100));
+        auto res = get(canned.port());
+        CHECK(res && res->body == body);
+    }
+    // neither length nor chunks, the body ends with the connection
+    {
+        CannedServer canned(head + "Connection: close\r\n\r\n" + compressed);
+        auto res = get(canned.port());
+        CHECK(res && res->body == body);
+    }
+    // cut short with a matching length, and missing only the gzip trailer: failures, not half the json
+    for (auto cut : {compressed.size() / 2, compressed.size() - 8}) {
+        auto truncated = compressed.substr(0, cut);
+        CannedServer canned(head + "Content-Length: " + std::to_string(truncated.size()) + "\r\n\r\n" + truncated);
+        CHECK(!get(canned.port()));
+    }
+    // not gzip at all
+    {
+        CannedServer canned(head + "Content-Length: " + std::to_string(body.size()) + "\r\n\r\n" + body);
+        CHECK(!get(canned.port()));
+    }
+
+    return checkResult();
+}
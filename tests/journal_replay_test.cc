@@ -0,0 +1,150 @@
+/**
+ * @file    journal_replay_test.cc
+ * @authors Stavros Avramidis
+ *
+ * Records a session of the rpc loop on a <VirtualClock> (--record), against a scripted player
+ * and a mock api: tracks played, paused, repeated, one the api doesn't know and the player
+ * closed. Then replays the journal (--replay) while recording it again, the second journal has
+ * to be the first byte for byte.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+// local libs
+#include "checks.hh"
+#include "linux_api_hook.hh"
+#include "mock_api.hh"
+#include "rpc_loop.hh"
+
+using namespace std::chrono_literals;
+
+
+/// @brief What the scripted player shows from <from> on, in s of session time
+struct Segment {
+    int64_t from;
+    status state;
+    std::string title, artist;
+};
+
+/**
+ * @brief Discord, always there
+ */
+class NullSink : public PresenceSink {
+  public:
+    bool isConnected() const override { return isConnected_; }
+
+    bool connect() override { return isConnected_ = true; }
+
+    void update(const Song &) override {}
+
+    void runCallbacks() override {}
+
+    void release() override { isConnected_ = false; }
+
+  private:
+    bool isConnected_ = false;
+};
+
+static std::string contents(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void record(const std::filesystem::path &path, const std::vector<Segment> &segments, int64_t end) {
+    MockApi api;
+    api.add({101, "First Song", "First Artist", 150});
+    api.add({102, "Second Song", "Second Artist", 200, "HI_RES", "Second Album"});
+    api.add({103, "Song - Live", "Band & Friends", 180});
+
+    VirtualClock clock;
+    JournalWriter journal;
+    CHECK(journal.open(path.string(), clock.unixTime()));
+    NullSink sink;
+
+    LoopIo io;
+    io.presence = &sink;
+    io.queryApi = api.query();
+    io.readPlayer = [&](std::wstring &title, std::wstring &artist) {
+        auto now = std::chrono::duration_cast<std::chrono::seconds>(clock.now() - Clock::time_point{}).count();
+        size_t segment = 0;
+        while (segment + 1 < segments.size() && segments[segment + 1].from <= now)
+            segment++;
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        title = converter.from_bytes(segments[segment].title);
+        artist = converter.from_bytes(segments[segment].artist);
+        return segments[segment].state;
+    };
+    io.isFinished = [&]() { return clock.now() - Clock::time_point{} >= std::chrono::seconds(end); };
+
+    SessionRecorder recorder(journal, clock);
+    recorder.attach(io);
+    TrackResolver resolver(io.queryApi, clock);
+    io.resolver = &resolver;
+    rpcLoop(clock, io);
+}
+
+int main() {
+    std::error_code error;
+    auto dir = std::filesystem::temp_directory_path(error) /
+               ("journal_replay_test." + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(dir, error);
+    isPresenceActive = true;
+
+    // the first song plays twice through, the title never changing in between
+    std::vector<Segment> segments = {
+        {0, closed, "", ""},
+        {5, playing, "First Song", "First Artist"},
+        {60, opened, "", ""},
+        {95, playing, "First Song", "First Artist"},
+        {370, playing, "Second Song", "Second Artist"},
+        {450, playing, "Unknown Song", "Nobody"},
+        {520, playing, "Song - Live", "Band & Friends"},
+        {600, closed, "", ""},
+    };
+    auto recorded = dir / "recorded.journal", replayed = dir / "replayed.journal";
+    record(recorded, segments, 700);
+
+    // it has something of everything
+    JournalReader reader;
+    CHECK(reader.open(recorded.string()));
+    size_t counts[5] = {};
+    JournalRecord entry;
+    while (reader.next(entry))
+        if (entry.type < 5)
+            counts[entry.type]++;
+    printf("recorded %zu observations, %zu api requests, %zu responses, %zu presence updates, %zu bytes\n",
+           counts[JournalRecord::observation], counts[JournalRecord::apiRequest], counts[JournalRecord::apiResponse],
+           counts[JournalRecord::presence], static_cast<size_t>(std::filesystem::file_size(recorded)));
+    CHECK(counts[JournalRecord::observation] >= segments.size() - 1);
+    CHECK(counts[JournalRecord::apiRequest] >= 4);
+    CHECK(counts[JournalRecord::apiRequest] == counts[JournalRecord::apiResponse]);
+    CHECK(counts[JournalRecord::presence] >= segments.size());
+
+    SessionReplay replay;
+    CHECK(replay.load(recorded.string()));
+    JournalWriter journal;
+    CHECK(journal.open(replayed.string(), replay.unixStart()));
+    replay.run(0, "US", &journal);
+
+    auto original = contents(recorded), again = contents(replayed);
+    CHECK(!original.empty());
+    CHECK(again == original);
+    if (again != original) {
+        size_t at = 0;
+        while (at < original.size() && at < again.size() && original[at] == again[at])
+            at++;
+        printf("the replay's journal differs from byte %zu on (%zu against %zu bytes)\n", at, again.size(),
+               original.size());
+    }
+
+    std::filesystem::remove_all(dir, error);
+    Logger::instance().flush();
+    return checkResult();
+}
@@ -0,0 +1,201 @@
+/**
+ * @file    local_api_load.cc
+ * @authors Stavros Avramidis
+ *
+ * Load test client of the now-playing api (--local-api), opens many event streams at once:
+ *
+ *  local_api_load [--subscribers=<n>] [--events=<n>]
+ *      starts an api of its own, publishes <n> changes one after the other and measures how long
+ *      each takes to reach the subscribers, and how long /now-playing takes meanwhile. Exits with 1
+ *      if one of them missed a change or a /now-playing request failed.
+ *  local_api_load --port=<port> [--subscribers=<n>] [--seconds=<s>]
+ *      subscribes to a running instance for <s> seconds and reports for every change how many
+ *      subscribers got it and how far apart the first and the last did.
+ */
+
+// cpp libs
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <map>
+#include <string>
+#include <vector>
+// local libs
+#include "local_api.hh"
+#include "sse_subscribers.hh"
+
+using clock_type = SseSubscribers::clock;
+
+
+static double ms(clock_type::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+}
+
+/// @brief A port nothing listens on right now
+static int freePort() {
+    auto fd = socket(AF_INET, SOCK_STREAM, 0);
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    socklen_t len = sizeof(address);
+    ::bind(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address));
+    getsockname(fd, reinterpret_cast<sockaddr *>(&address), &len);
+    ::close(fd);
+    return ntohs(address.sin_port);
+}
+
+static int runOwn(size_t count, size_t events) {
+    LocalApi api;
+    auto port = freePort();
+    if (!api.start("127.0.0.1", port)) {
+        fprintf(stderr, "Could not start the api on port %d\n", port);
+        return 2;
+    }
+
+    auto start = clock_type::now();
+    SseSubscribers subscribers;
+    auto opened = subscribers.connect("127.0.0.1", port, "/now-playing/events", count);
+
+    // change <current> is "load <current>" in the title, 0 the stopped state sent on subscribing
+    size_t current = 0;
+    size_t reached = 0;
+    std::vector<size_t> seen(opened, SIZE_MAX);
+    clock_type::time_point publishedAt;
+    clock_type::time_point lastArrival;
+    std::vector<double> latencies;   ///< of every subscriber and change
+    std::vector<double> untilAll;    ///< of every change, until the last subscriber had it
+
+    auto onEvent = [&](size_t subscriber, const std::string &data, clock_type::time_point arrivedAt) {
+        // not parsed as json, the client must not be what is measured
+        static const std::string marker = "\"title\":\"load ";
+        auto at = data.find(marker);
+        size_t change = at == std::string::npos ? 0 : std::stoul(data.substr(at + marker.size()));
+        if (change != current || seen[subscriber] == change)
+            return;
+
+        seen[subscriber] = change;
+        reached++;
+        lastArrival = arrivedAt;
+        if (change)
+            latencies.push_back(ms(arrivedAt - publishedAt));
+    };
+
+    // every subscription has the current state, or was refused (off linux beyond LOCAL_API_MAX_SUBSCRIBERS)
+    subscribers.pump(std::chrono::seconds(10), onEvent, [&]() { return reached + subscribers.closed() >= opened; });
+    auto streaming = subscribers.streaming();
+    printf("%zu subscribers: %zu streaming, %zu refused, all subscribed after %.1f ms\n", count, streaming,
+           opened - streaming, ms(lastArrival - start));
+
+    // what an overlay polling /now-playing sees meanwhile, a connection per request
+    std::vector<double> polls;
+    size_t failedPolls = 0;
+    for (int i = 0; i < 100; i++) {
+        httplib::Client client("127.0.0.1", port, 5);
+        auto polledAt = clock_type::now();
+        auto res = client.Get("/now-playing");
+        if (res && res->status == 200)
+            polls.push_back(ms(clock_type::now() - polledAt));
+        else
+            failedPolls++;
+    }
+    printf("100 polls of /now-playing alongside: p50 %.2f ms, p99 %.2f ms, %zu failed\n", percentile(polls, 0.5),
+           percentile(polls, 0.99), failedPolls);
+
+    size_t missed = 0;
+    for (size_t change = 1; change <= events; change++) {
+        NowPlaying np;
+        memset(&np, 0, sizeof(np));
+        np.state = NowPlaying::playing;
+        copyString(np.title, "load " + std::to_string(change));
+        copyString(np.artist, "Load test");
+
+        current = change;
+        reached = 0;
+        publishedAt = clock_type::now();
+        api.publish(np);
+
+        if (subscribers.pump(std::chrono::seconds(5), onEvent, [&]() { return reached == streaming; }))
+            untilAll.push_back(ms(lastArrival - publishedAt));
+        else
+            missed += streaming - reached;
+    }
+
+    printf("%zu changes, each to one subscriber: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n", events,
+           percentile(latencies, 0.5), percentile(latencies, 0.99), percentile(latencies, 1));
+    printf("until the last subscriber had it: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+           percentile(untilAll, 0.5), percentile(untilAll, 0.99), percentile(untilAll, 1));
+    if (missed)
+        printf("%zu deliveries missed\n", missed);
+
+    api.stop();
+    return missed || failedPolls || streaming == 0 ? 1 : 0;
+}
+
+static int runAgainst(int port, size_t count, int seconds) {
+    SseSubscribers subscribers;
+    auto opened = subscribers.connect("127.0.0.1", port, "/now-playing/events", count);
+    printf("%zu of %zu subscriptions opened\n", opened, count);
+
+    struct Change {
+        size_t order;
+        size_t count = 0;
+        clock_type::time_point first, last;
+    };
+    std::map<std::string, Change> changes;
+
+    subscribers.pump(std::chrono::seconds(seconds),
+                     [&](size_t, const std::string &data, clock_type::time_point arrivedAt) {
+                         auto it = changes.find(data);
+                         if (it == changes.end())
+                             it = changes.emplace(data, Change{changes.size(), 0, arrivedAt, arrivedAt}).first;
+                         it->second.count++;
+                         it->second.last = arrivedAt;
+                     },
+                     []() { return false; });
+
+    printf("%zu streaming, %zu closed by the server\n", subscribers.streaming(), subscribers.closed());
+    std::vector<const Change *> ordered(changes.size());
+    for (auto &change : changes)
+        ordered[change.second.order] = &change.second;
+    for (auto change : ordered) {
+        // the first one is the state sent on subscribing, its spread is the time taken to connect
+        printf("change %zu: %zu subscribers within %.2f ms\n", change->order, change->count,
+               ms(change->last - change->first));
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    size_t count = 500;
+    size_t events = 100;
+    int port = 0;
+    int seconds = 30;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--subscribers=", 0) == 0) {
+            count = std::stoul(arg.substr(14));
+        } else if (arg.rfind("--events=", 0) == 0) {
+            events = std::stoul(arg.substr(9));
+        } else if (arg.rfind("--port=", 0) == 0) {
+            port = std::stoi(arg.substr(7));
+        } else if (arg.rfind("--seconds=", 0) == 0) {
+            seconds = std::stoi(arg.substr(10));
+        } else {
+            fprintf(stderr, "usage: %s [--subscribers=<n>] [--events=<n>] | --port=<port> [--subscribers=<n>] [--seconds=<s>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    if (SseSubscribers::raiseFileLimit() < count + 64)
+        fprintf(stderr, "The descriptor limit is below %zu, not every subscriber may connect\n", count + 64);
+    return port ? runAgainst(port, count, seconds) : runOwn(count, events);
+}
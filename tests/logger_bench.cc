@@ -0,0 +1,140 @@
+/**
+ * @file    logger_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Benchmark of what a log line costs the thread writing it, the ring buffer <Logger> against
+ * writing to std::clog directly and flushing every line the way the loop used to:
+ *
+ *  logger_bench [--lines=<n>]
+ *
+ * stderr goes to a temporary file, so neither side pays for a terminal. Lines carry a query path
+ * and a number, like the loop's. The logger is timed in bursts the ring has room for (flushed in
+ * between, untimed) and flat out, when lines are dropped; LOG_DEBUG is compiled out without DEBUG.
+ * The mean is of lines timed in batches, the percentiles of lines timed one by one and include
+ * reading the clock, which is about what the compiled out LOG_DEBUG shows.
+ */
+
+// cpp libs
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <iostream>
+#include <random>
+#include <string>
+#include <vector>
+// local libs
+#include "logger.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+}
+
+struct Run {
+    double mean = 0;  ///< ns a line, timed in batches
+    double p50 = 0, p99 = 0, max = 0;  ///< ns a line, each timed on its own
+};
+
+/**
+ * @brief Times <write>(i) for <count> lines, in bursts of <burst> with <between> called untimed
+ * after each
+ */
+template <class Write, class Between>
+static Run measure(size_t count, size_t burst, Write write, Between between) {
+    Run run;
+    clock_type::duration total{};
+    for (size_t done = 0; done < count; done += burst) {
+        auto start = clock_type::now();
+        for (size_t i = done; i < done + burst; i++)
+            write(i);
+        total += clock_type::now() - start;
+        between();
+    }
+    run.mean = std::chrono::duration<double, std::nano>(total).count() / count;
+
+    std::vector<double> each;
+    each.reserve(count);
+    for (size_t done = 0; done < count; done += burst) {
+        for (size_t i = done; i < done + burst; i++) {
+            auto start = clock_type::now();
+            write(i);
+            each.push_back(std::chrono::duration<double, std::nano>(clock_type::now() - start).count());
+        }
+        between();
+    }
+    run.p50 = percentile(each, 0.5);
+    run.p99 = percentile(each, 0.99);
+    run.max = percentile(each, 1);
+    return run;
+}
+
+static void print(const char *name, const Run &run) {
+    printf("%-44s %9.0f %9.0f %9.0f %11.0f\n", name, run.mean, run.p50, run.p99, run.max);
+}
+
+int main(int argc, char **argv) {
+    size_t count = 200000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--lines=", 0) == 0 && std::stoul(arg.substr(8)) > 0) {
+            count = std::stoul(arg.substr(8));
+        } else {
+            fprintf(stderr, "usage: %s [--lines=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+    const size_t BURST = Logger::CAPACITY / 2;
+    count = (count + BURST - 1) / BURST * BURST;
+
+    std::error_code error;
+    auto path = std::filesystem::temp_directory_path(error) /
+                ("logger_bench." + std::to_string(std::random_device()()) + ".log");
+    if (!freopen(path.c_str(), "w", stderr)) {
+        fprintf(stderr, "Could not redirect stderr\n");
+        return 2;
+    }
+
+    const std::string query = "/v1/search?query=some%20song%20-%20some%20artist&limit=50&offset=0&types=TRACKS";
+    auto &logger = Logger::instance();
+    auto nothing = []() {};
+
+    printf("%zu lines each, ns a line on the writing thread\n", count);
+    printf("%-44s %9s %9s %9s %11s\n", "", "mean", "p50", "p99", "max");
+
+    auto ring = measure(count, BURST, [&](size_t i) { LOG_INFO("Querying :", query, " #", i); },
+                        [&]() { logger.flush(); });
+    print("LOG_INFO, the ring has room", ring);
+
+    auto droppedBefore = logger.dropped();
+    auto overload = measure(count, BURST, [&](size_t i) { LOG_INFO("Querying :", query, " #", i); }, nothing);
+    logger.flush();
+    print("LOG_INFO flat out", overload);
+    auto dropped = logger.dropped() - droppedBefore;
+
+    auto debug = measure(count, BURST, [&](size_t i) { LOG_DEBUG("Querying :", query, " #", i); }, nothing);
+    print("LOG_DEBUG (compiled out)", debug);
+
+    auto clog = measure(count, BURST, [&](size_t i) { std::clog << "Querying :" << query << " #" << i << std::endl; },
+                        nothing);
+    print("std::clog << ... << std::endl", clog);
+
+    auto unflushed = measure(count, BURST, [&](size_t i) { std::clog << "Querying :" << query << " #" << i << '\n'; },
+                             nothing);
+    std::clog.flush();
+    print("std::clog << ... << '\\n'", unflushed);
+
+    printf("flat out, %llu of %zu lines dropped (%.1f%%)\n", static_cast<unsigned long long>(dropped), 2 * count,
+           100.0 * dropped / (2 * count));
+    if (ring.mean > 0)
+        printf("a flushed std::clog line costs %.1fx a LOG_INFO\n", clog.mean / ring.mean);
+
+    fclose(stderr);
+    std::filesystem::remove(path, error);
+    return 0;
+}
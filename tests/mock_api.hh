@@ -0,0 +1,118 @@
+/**
+ * @file    mock_api.hh
+ * @authors Stavros Avramidis
+ *
+ * Stand-ins for api.tidal.com in the tests: response bodies of its search and track endpoints,
+ * and an <ApiQuery> answering from a table in process.
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <atomic>
+#include <map>
+#include <memory>
+#include <string>
+#include <vector>
+// local libs
+#include "httplib.hh"
+#include "json.hh"
+#include "track_resolver.hh"
+
+
+struct MockTrack {
+    unsigned id;
+    std::string title;
+    std::string artist;
+    int64_t duration = 200;
+    std::string quality = "LOSSLESS";
+    std::string album = "Album";
+    std::string releaseDate = "2020-01-01";
+    std::string version;  ///< empty for none
+};
+
+/// @brief A track object as the api has them, in searches and by id
+inline nlohmann::json trackJson(const MockTrack &track) {
+    nlohmann::json item = {
+        {"id", track.id}, {"title", track.title}, {"audioQuality", track.quality}, {"trackNumber", 1},
+        {"volumeNumber", 1}, {"duration", track.duration}, {"artists", {{{"name", track.artist}}}},
+        {"album", {{"title", track.album}, {"cover", "cover-" + std::to_string(track.id)},
+                   {"releaseDate", track.releaseDate}}}};
+    if (!track.version.empty())
+        item["version"] = track.version;
+    return item;
+}
+
+inline std::string searchBody(const std::vector<MockTrack> &tracks) {
+    nlohmann::json items = nlohmann::json::array();
+    for (auto &track : tracks)
+        items.push_back(trackJson(track));
+    return nlohmann::json{{"tracks", {{"totalNumberOfItems", tracks.size()}, {"items", items}}}}.dump();
+}
+
+/// @brief The decoded value of <name> in the query string of <path>
+inline std::string queryParam(const std::string &path, const std::string &name) {
+    auto at = path.find(name + "=");
+    if (at == std::string::npos)
+        return std::string();
+    auto end = std::min(path.find('&', at), path.size());
+
+    std::string value;
+    for (auto i = at + name.size() + 1; i < end; i++) {
+        if (path[i] == '%' && i + 2 < end) {
+            value += static_cast<char>(std::stoi(path.substr(i + 1, 2), nullptr, 16));
+            i += 2;
+        } else {
+            value += path[i] == '+' ? ' ' : path[i];
+        }
+    }
+    return value;
+}
+
+/**
+ * @brief The api over a fixed catalog: a search finds the tracks whose "title - artist" is the
+ * query, as TrackResolver normalizes it, by id a track is found by its id
+ */
+class MockApi {
+  public:
+    void add(const MockTrack &track) {
+        searches_[TrackResolver::normalize(track.title + " - " + track.artist)].push_back(track);
+        byId_[track.id] = track;
+    }
+
+    /// @brief Answers the search for <query> (as sent) with <tracks>, whatever they are called
+    void answer(const std::string &query, std::vector<MockTrack> tracks) {
+        searches_[TrackResolver::normalize(query)] = std::move(tracks);
+        for (auto &track : searches_[TrackResolver::normalize(query)])
+            byId_[track.id] = track;
+    }
+
+    ApiQuery query() {
+        return [this](const std::string &path, const httplib::Headers &) {
+            requests_++;
+            auto res = std::make_shared<httplib::Response>();
+            res->status = 200;
+            if (path.rfind("/v1/search", 0) == 0) {
+                auto it = searches_.find(TrackResolver::normalize(queryParam(path, "query")));
+                res->body = searchBody(it == searches_.end() ? std::vector<MockTrack>() : it->second);
+            } else if (path.rfind("/v1/tracks/", 0) == 0) {
+                auto it = byId_.find(static_cast<unsigned>(std::stoul(path.substr(11))));
+                if (it == byId_.end())
+                    res->status = 404;
+                else
+                    res->body = trackJson(it->second).dump();
+            } else {
+                res->status = 404;
+            }
+            return res;
+        };
+    }
+
+    uint64_t requests() const { return requests_; }
+
+  private:
+    std::map<std::string, std::vector<MockTrack>> searches_;
+    std::map<unsigned, MockTrack> byId_;
+    std::atomic<uint64_t> requests_{0};
+};
@@ -0,0 +1,93 @@
+/**
+ * @file    playback_tracker_test.cc
+ * @authors Stavros Avramidis
+ *
+ * <PlaybackTracker> on a <VirtualClock>: pauses, seeks, track changes and repeats, sampled at
+ * poll intervals of any length.
+ */
+
+// cpp libs
+#include <chrono>
+// local libs
+#include "checks.hh"
+#include "clock.hh"
+#include "playback_tracker.hh"
+
+using namespace std::chrono_literals;
+
+
+int main() {
+    VirtualClock clock;
+    PlaybackTracker tracker;
+
+    // the position follows the clock however rarely it is read
+    tracker.start(clock.now());
+    clock.sleepFor(1500ms);
+    CHECK(tracker.position(clock.now()) == 1500ms);
+    clock.sleepFor(17s);
+    CHECK(tracker.position(clock.now()) == 18500ms);
+
+    // a pause stops it, a resume carries on from there, pausing twice changes nothing
+    tracker.pause(clock.now());
+    clock.sleepFor(10min);
+    tracker.pause(clock.now());
+    CHECK(tracker.isPaused());
+    CHECK(tracker.position(clock.now()) == 18500ms);
+    tracker.resume(clock.now());
+    tracker.resume(clock.now());
+    clock.sleepFor(1500ms);
+    CHECK(!tracker.isPaused());
+    CHECK(tracker.position(clock.now()) == 20s);
+
+    // seeks, playing and paused
+    tracker.seek(2min, clock.now());
+    CHECK(tracker.position(clock.now()) == 2min);
+    clock.sleepFor(5s);
+    CHECK(tracker.position(clock.now()) == 2min + 5s);
+    tracker.pause(clock.now());
+    tracker.seek(30s, clock.now());
+    clock.sleepFor(1min);
+    CHECK(tracker.position(clock.now()) == 30s);
+    tracker.resume(clock.now());
+    clock.sleepFor(1s);
+    CHECK(tracker.position(clock.now()) == 31s);
+
+    // a new track starts over, paused or not
+    tracker.pause(clock.now());
+    clock.sleepFor(3s);
+    tracker.start(clock.now());
+    CHECK(!tracker.isPaused());
+    CHECK(tracker.position(clock.now()) == 0s);
+
+    // repeats: nothing before the end, then one per runtime and the time past the end is kept
+    CHECK(tracker.wrap(200s, clock.now()) == 0);
+    clock.sleepFor(199s);
+    CHECK(tracker.wrap(200s, clock.now()) == 0);
+    clock.sleepFor(1250ms);
+    CHECK(tracker.wrap(200s, clock.now()) == 1);
+    CHECK(tracker.position(clock.now()) == 250ms);
+    clock.sleepFor(450s);
+    CHECK(tracker.wrap(200s, clock.now()) == 2);
+    CHECK(tracker.position(clock.now()) == 50250ms);
+    CHECK(tracker.wrap(0s, clock.now()) == 0);
+
+    // a pause noticed 2 s late: the position may be that much ahead, so the end doesn't count
+    // as a repeat until it has surely passed
+    tracker.start(clock.now());
+    auto playingAt = clock.now() + 60s;
+    clock.sleepFor(62s);
+    tracker.pause(clock.now(), playingAt);
+    CHECK(tracker.slack() == 2s);
+    clock.sleepFor(30s);
+    tracker.resume(clock.now());
+    clock.sleepFor(138s + 250ms);
+    CHECK(tracker.position(clock.now()) == 200s + 250ms);
+    CHECK(tracker.wrap(200s, clock.now()) == 0);
+    clock.sleepFor(2s);
+    CHECK(tracker.wrap(200s, clock.now()) == 1);
+    CHECK(tracker.slack() == 2s);
+    tracker.start(clock.now());
+    CHECK(tracker.slack() == 0s);
+
+    return checkResult();
+}
@@ -0,0 +1,156 @@
+/**
+ * @file    poll_scheduler_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Benchmark of what the rpc loop costs an hour, polling every second as it used to against the
+ * <PollScheduler>:
+ *
+ *  poll_scheduler_bench [--speed=<n>]
+ *
+ * Runs rpcLoop() for an hour of the player closed, an hour paused and an hour playing tracks
+ * back to back on a <ScaledClock> <n> times faster than real time (100 by default), so every
+ * wake-up is a real sleep of the thread. Counts the wake-ups and measures the CPU time of the
+ * loop's thread, the sleeps' and wake-ups' share in the kernel included. The player and the
+ * presence are stand-ins, reading the real player costs more per wake-up.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <ctime>
+#include <string>
+#include <vector>
+// local libs
+#include "linux_api_hook.hh"
+#include "mock_api.hh"
+#include "rpc_loop.hh"
+
+using namespace std::chrono_literals;
+
+
+/**
+ * @brief Passes the loop's sleeps on to <inner>, all of them a second long with <isFixed> as
+ * the loop had them before the scheduler, and counts them
+ */
+class PolicyClock : public Clock {
+  public:
+    PolicyClock(Clock &inner, bool isFixed) : inner_(inner), isFixed_(isFixed) {}
+
+    time_point now() const override { return inner_.now(); }
+
+    int64_t unixTime() const override { return inner_.unixTime(); }
+
+    void sleepFor(duration timeout) override {
+        wakeUps_++;
+        inner_.sleepFor(isFixed_ ? duration(1000) : timeout);
+    }
+
+    uint64_t wakeUps() const noexcept { return wakeUps_; }
+
+  private:
+    Clock &inner_;
+    bool isFixed_;
+    uint64_t wakeUps_ = 0;
+};
+
+/**
+ * @brief Discord, always there
+ */
+class NullSink : public PresenceSink {
+  public:
+    bool isConnected() const override { return isConnected_; }
+
+    bool connect() override { return isConnected_ = true; }
+
+    void update(const Song &) override {}
+
+    void runCallbacks() override {}
+
+    void release() override { isConnected_ = false; }
+
+  private:
+    bool isConnected_ = false;
+};
+
+static double threadCpuMs() {
+    timespec ts{};
+    clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts);
+    return ts.tv_sec * 1e3 + ts.tv_nsec / 1e6;
+}
+
+struct Run {
+    uint64_t wakeUps = 0;
+    double cpuMs = 0;
+};
+
+/**
+ * @brief An hour of the loop against a player showing <state>, a new track of <tracks> whenever
+ * the last one ended while playing
+ */
+static Run hour(status state, bool isFixed, double speed, const std::vector<MockTrack> &tracks) {
+    MockApi api;
+    for (auto &track : tracks)
+        api.add(track);
+
+    ScaledClock scaled(speed, 1600000000);
+    PolicyClock clock(scaled, isFixed);
+    NullSink sink;
+    TrackResolver resolver(api.query(), clock);
+
+    auto start = clock.now();
+    LoopIo io;
+    io.presence = &sink;
+    io.queryApi = api.query();
+    io.resolver = &resolver;
+    io.readPlayer = [&](std::wstring &title, std::wstring &artist) {
+        if (state == playing) {
+            auto at = std::chrono::duration_cast<std::chrono::seconds>(clock.now() - start).count();
+            size_t track = 0;
+            for (; at >= tracks[track].duration; track = (track + 1) % tracks.size())
+                at -= tracks[track].duration;
+            std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+            title = converter.from_bytes(tracks[track].title);
+            artist = converter.from_bytes(tracks[track].artist);
+        }
+        return state;
+    };
+    io.isFinished = [&]() { return clock.now() - start >= 1h; };
+
+    auto cpuStart = threadCpuMs();
+    rpcLoop(clock, io);
+    return Run{clock.wakeUps(), threadCpuMs() - cpuStart};
+}
+
+int main(int argc, char **argv) {
+    double speed = 100;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--speed=", 0) == 0 && std::stod(arg.substr(8)) > 0) {
+            speed = std::stod(arg.substr(8));
+        } else {
+            fprintf(stderr, "usage: %s [--speed=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::vector<MockTrack> tracks;
+    for (unsigned i = 0; i < 20; i++)
+        tracks.push_back({i + 1, "Track " + std::to_string(i), "Artist " + std::to_string(i % 5),
+                          150 + static_cast<int64_t>(i * 7 % 120)});
+    isPresenceActive = true;
+
+    printf("an hour of each, %.0f times real time\n", speed);
+    printf("%-8s %16s %16s %16s %16s %16s\n", "player", "1 s wake-ups", "1 s cpu (ms)", "sched wake-ups",
+           "sched cpu (ms)", "cpu per wake-up");
+    for (auto state : {closed, opened, playing}) {
+        auto fixed = hour(state, true, speed, tracks);
+        auto scheduled = hour(state, false, speed, tracks);
+        printf("%-8s %16llu %16.1f %16llu %16.1f %13.1f us\n",
+               state == closed ? "closed" : state == opened ? "paused" : "playing",
+               static_cast<unsigned long long>(fixed.wakeUps), fixed.cpuMs,
+               static_cast<unsigned long long>(scheduled.wakeUps), scheduled.cpuMs,
+               (fixed.cpuMs + scheduled.cpuMs) * 1e3 / (fixed.wakeUps + scheduled.wakeUps));
+    }
+    Logger::instance().flush();
+    return 0;
+}
@@ -0,0 +1,105 @@
+/**
+ * @file    process_watcher_test.cc
+ * @authors Stavros Avramidis
+ *
+ * Starts and kills a dummy player, a copy of sleep(1) named after it, and checks that the
+ * <ProcessWatcher> sees both, ignores names that merely contain the player's and never counts
+ * its own process.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+// linux api
+#include <sys/wait.h>
+// local libs
+#include "process_watcher.hh"
+
+
+static int failures = 0;
+
+#define CHECK(condition)                                                  \
+    do {                                                                  \
+        if (!(condition)) {                                               \
+            fprintf(stderr, "%s:%d: %s failed\n", __FILE__, __LINE__, #condition); \
+            failures++;                                                   \
+        }                                                                 \
+    } while (0)
+
+
+/// @brief Runs <executable> for a minute, its process name is the file name
+static pid_t start(const std::filesystem::path &executable) {
+    auto pid = fork();
+    if (pid == 0) {
+        execl(executable.c_str(), executable.filename().c_str(), "60", static_cast<char *>(nullptr));
+        _exit(127);
+    }
+    return pid;
+}
+
+static void stop(pid_t pid) {
+    kill(pid, SIGKILL);
+    waitpid(pid, nullptr, 0);
+}
+
+int main() {
+    std::error_code error;
+    auto dir = std::filesystem::temp_directory_path(error) /
+               ("process_watcher_test." + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(dir, error);
+    auto player = dir / "tidal-dummy";
+    auto lookalike = dir / "tidal-dummy-rpc";
+    for (auto &copy : {player, lookalike}) {
+        if (!std::filesystem::copy_file("/bin/sleep", copy, error)) {
+            fprintf(stderr, "Could not copy /bin/sleep: %s\n", error.message().c_str());
+            return 2;
+        }
+    }
+
+    // our own name, as the watcher of tidal-rpc would see it
+    std::ifstream comm("/proc/self/comm");
+    std::string self;
+    std::getline(comm, self);
+    CHECK(!ProcessWatcher({self}).isRunning());
+
+    ProcessWatcher watcher({"tidal-dummy"});
+    printf("%s\n", watcher.isEventDriven() ? "proc connector events" : "rescanning /proc");
+    CHECK(!watcher.isRunning());
+
+    auto other = start(lookalike);
+    CHECK(!watcher.waitForChange(ProcessWatcher::RESCAN_INTERVAL + std::chrono::milliseconds(500)));
+    CHECK(!watcher.isRunning());
+
+    auto started = std::chrono::steady_clock::now();
+    auto pid = start(player);
+    CHECK(watcher.waitForChange(std::chrono::seconds(10)));
+    CHECK(watcher.isRunning());
+    printf("start seen after %lld ms\n", static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                             std::chrono::steady_clock::now() - started).count()));
+
+    // a second start is no change
+    auto second = start(player);
+    CHECK(!watcher.waitForChange(std::chrono::milliseconds(500)));
+    stop(second);
+    CHECK(!watcher.waitForChange(std::chrono::milliseconds(500)));
+    CHECK(watcher.isRunning());
+
+    started = std::chrono::steady_clock::now();
+    stop(pid);
+    CHECK(watcher.waitForChange(std::chrono::seconds(10)));
+    CHECK(!watcher.isRunning());
+    printf("exit seen after %lld ms\n", static_cast<long long>(std::chrono::duration_cast<std::chrono::milliseconds>(
+                                            std::chrono::steady_clock::now() - started).count()));
+
+    stop(other);
+    std::filesystem::remove_all(dir, error);
+
+    if (failures)
+        return 1;
+    printf("PASS\n");
+    return 0;
+}
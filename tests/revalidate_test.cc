@@ -0,0 +1,177 @@
+/**
+ * @file    revalidate_test.cc
+ * @authors Stavros Avramidis
+ *
+ * Cached tracks past <TrackResolver::SOFT_TTL> revalidated against a mock of the by-id api that
+ * honours If-None-Match: the cached etag is sent, a 304 keeps the entry (only resolved again), a
+ * 200 replaces it and its etag, a failure leaves it alone.
+ */
+
+// cpp libs
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <mutex>
+#include <random>
+#include <string>
+#include <thread>
+// local libs
+#include "checks.hh"
+#include "clock.hh"
+#include "httplib.hh"
+#include "track_cache.hh"
+#include "track_resolver.hh"
+
+
+/**
+ * @brief /v1/tracks/42 as the api has it at the moment, with the If-None-Match it was sent
+ */
+struct TrackServer {
+    std::mutex mutex;
+    std::string etag = "\"v1\"";
+    std::string quality = "LOSSLESS";
+    std::string cover = "aa-bb";
+    int failWith = 0;  ///< status answered instead, 0 for none
+    std::string ifNoneMatch;
+    bool hadIfNoneMatch = false;
+    std::atomic<int> hits{0};
+};
+
+static TrackInfo cachedInfo() {
+    TrackInfo info;
+    info.isFound = true;
+    info.id = 42;
+    info.album = "Album";
+    info.coverId = "aa-bb";
+    info.quality = "LOSSLESS";
+    info.runtime = 200;
+    info.trackNumber = 1;
+    info.volumeNumber = 1;
+    return info;
+}
+
+/// @brief Looks the track up with the cache <age> s old, the background revalidation waited for
+static TrackInfo resolveAged(ApiQuery query, TrackCache &cache, int64_t age, const std::string &etag) {
+    VirtualClock clock;
+    TrackCache::Entry entry;
+    cache.get("Song A", "Artist", entry);
+    cache.put("Song A", "Artist", entry.info, clock.unixTime() - age, etag);
+    TrackResolver resolver(query, clock, "US", &cache);
+    return resolver.resolve("Song A", "Artist");
+}
+
+int main() {
+    TrackServer track;
+    httplib::Server mock;
+    mock.Get(R"(/v1/tracks/(\d+))", [&](const httplib::Request &req, httplib::Response &res) {
+        std::lock_guard<std::mutex> lock(track.mutex);
+        track.hits++;
+        track.hadIfNoneMatch = req.has_header("If-None-Match");
+        track.ifNoneMatch = req.get_header_value("If-None-Match");
+        if (track.failWith) {
+            res.status = track.failWith;
+            return;
+        }
+        res.set_header("ETag", track.etag.c_str());
+        if (track.ifNoneMatch == track.etag) {
+            res.status = 304;
+            return;
+        }
+
+        nlohmann::json body = {
+            {"id", 42}, {"title", "Song A"}, {"audioQuality", track.quality}, {"trackNumber", 1},
+            {"volumeNumber", 1}, {"duration", 200}, {"artists", {{{"name", "Artist"}}}},
+            {"album", {{"title", "Album"}, {"cover", track.cover}, {"releaseDate", "2020-01-01"}}}};
+        res.set_content(body.dump(), "application/json");
+    });
+    auto port = mock.bind_to_any_port("127.0.0.1");
+    std::thread server([&]() { mock.listen_after_bind(); });
+    while (!mock.is_running())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    ApiQuery query = [port](const std::string &path, const httplib::Headers &headers) {
+        httplib::Client client("127.0.0.1", port);
+        return client.Get(path.c_str(), headers);
+    };
+
+    std::error_code error;
+    auto dir = std::filesystem::temp_directory_path(error) /
+               ("revalidate_test." + std::to_string(std::random_device()()));
+    auto path = (dir / "tracks.cache").string();
+    TrackCache cache;
+    CHECK(cache.open(path));
+    VirtualClock clock;
+    cache.put("Song A", "Artist", cachedInfo(), clock.unixTime(), "\"v1\"");
+    auto stale = std::chrono::duration_cast<std::chrono::seconds>(TrackResolver::SOFT_TTL).count() + 3600;
+    TrackCache::Entry entry;
+
+    // still fresh: answered from the cache, nothing sent
+    auto info = resolveAged(query, cache, 60, "\"v1\"");
+    CHECK(info.isFound && info.id == 42);
+    CHECK(track.hits == 0);
+
+    // unchanged: the etag is sent, the 304 keeps the entry and makes it fresh again
+    info = resolveAged(query, cache, stale, "\"v1\"");
+    CHECK(info.quality == "LOSSLESS");
+    CHECK(track.hits == 1);
+    CHECK(track.hadIfNoneMatch && track.ifNoneMatch == "\"v1\"");
+    CHECK(cache.get("Song A", "Artist", entry));
+    CHECK(entry.etag == "\"v1\"" && entry.info.quality == "LOSSLESS" && entry.info.coverId == "aa-bb");
+    CHECK(entry.resolvedAt == clock.unixTime());
+
+    // changed upstream: the 200 replaces the entry and its etag, the stale one was answered meanwhile
+    {
+        std::lock_guard<std::mutex> lock(track.mutex);
+        track.etag = "\"v2\"";
+        track.quality = "HI_RES";
+        track.cover = "cc-dd";
+    }
+    info = resolveAged(query, cache, stale, "\"v1\"");
+    CHECK(info.quality == "LOSSLESS");
+    CHECK(track.hits == 2);
+    CHECK(track.ifNoneMatch == "\"v1\"");
+    CHECK(cache.get("Song A", "Artist", entry));
+    CHECK(entry.etag == "\"v2\"" && entry.info.quality == "HI_RES" && entry.info.coverId == "cc-dd");
+    CHECK(entry.resolvedAt == clock.unixTime());
+
+    // the new etag is what is sent next time
+    info = resolveAged(query, cache, stale, "\"v2\"");
+    CHECK(info.quality == "HI_RES");
+    CHECK(track.hits == 3);
+    CHECK(track.ifNoneMatch == "\"v2\"");
+    CHECK(cache.get("Song A", "Artist", entry) && entry.etag == "\"v2\"");
+
+    // an entry without an etag is fetched unconditionally
+    resolveAged(query, cache, stale, "");
+    CHECK(track.hits == 4);
+    CHECK(!track.hadIfNoneMatch);
+    CHECK(cache.get("Song A", "Artist", entry) && entry.etag == "\"v2\"");
+
+    // the api failing: the entry stays as it was, stale, to be revalidated on the next lookup
+    {
+        std::lock_guard<std::mutex> lock(track.mutex);
+        track.failWith = 500;
+    }
+    resolveAged(query, cache, stale, "\"v2\"");
+    CHECK(track.hits == 5);
+    CHECK(cache.get("Song A", "Artist", entry));
+    CHECK(entry.etag == "\"v2\"" && entry.info.quality == "HI_RES" && entry.resolvedAt == clock.unixTime() - stale);
+
+    // all of it made it to the file
+    {
+        std::lock_guard<std::mutex> lock(track.mutex);
+        track.failWith = 0;
+    }
+    resolveAged(query, cache, stale, "\"v2\"");
+    TrackCache reopened;
+    CHECK(reopened.open(path));
+    CHECK(reopened.get("Song A", "Artist", entry));
+    CHECK(entry.etag == "\"v2\"" && entry.info.coverId == "cc-dd" && entry.resolvedAt == clock.unixTime());
+
+    mock.stop();
+    server.join();
+    std::filesystem::remove_all(dir, error);
+    Logger::instance().flush();
+    return checkResult();
+}
@@ -0,0 +1,269 @@
+/**
+ * @file    rpc_loop_soak.cc
+ * @authors Stavros Avramidis
+ *
+ * Soak test and throughput benchmark of the rpc loop on a <VirtualClock>:
+ *
+ *  rpc_loop_soak [--days=<n>] [--seed=<n>]
+ *
+ * Plays <n> simulated days of listening (sessions of tracks with pauses, repeats and the player
+ * closed in between) through rpcLoop() against a mock api, in a fraction of a second a day. Every
+ * track has to reach the presence within one idle poll and with the timestamps of the simulated
+ * player, the presence has to be let go of after every pause and close. Reports the loop's
+ * wake-ups and how much faster than real time it ran.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <random>
+#include <string>
+#include <vector>
+// local libs
+#include "checks.hh"
+#include "linux_api_hook.hh"
+#include "mock_api.hh"
+#include "rpc_loop.hh"
+
+using namespace std::chrono_literals;
+
+
+/// @brief What the simulated player shows from <from> on, in ms of session time
+struct Segment {
+    int64_t from;
+    status state;
+    std::string title, artist;
+};
+
+/// @brief One play of a track, from its start until it ended, its pause included
+struct Play {
+    int64_t start, end;
+    size_t track;
+    bool isRepeat;
+    int64_t pauseAt = INT64_MAX;
+    int64_t pauseLength = 0;
+
+    /// @brief When it ends, as far as can be known at <now>
+    int64_t endAt(int64_t now) const { return now < pauseAt ? end - pauseLength : end; }
+};
+
+struct Day {
+    std::vector<Segment> segments;
+    std::vector<Play> plays;
+};
+
+static std::vector<MockTrack> catalog(size_t size, std::mt19937 &random) {
+    std::vector<MockTrack> tracks;
+    for (size_t i = 0; i < size; i++) {
+        tracks.push_back({static_cast<unsigned>(i + 1), "Track " + std::to_string(i),
+                          "Artist " + std::to_string(i % 40), 120 + static_cast<int64_t>(random() % 240)});
+    }
+    return tracks;
+}
+
+/**
+ * @brief Listening sessions in the morning, at noon and in the evening of <days> days, the
+ * player closed in between
+ */
+static Day simulate(const std::vector<MockTrack> &tracks, int days, std::mt19937 &random) {
+    Day day;
+    auto chance = [&random](int percent) { return static_cast<int>(random() % 100) < percent; };
+    auto between = [&random](int64_t low, int64_t high) { return low + static_cast<int64_t>(random() % (high - low)); };
+    auto add = [&day](int64_t from, status state, const MockTrack *track) {
+        day.segments.push_back({from, state, track ? track->title : "", track ? track->artist : ""});
+    };
+
+    const int64_t hour = 3600 * 1000;
+    add(0, closed, nullptr);
+    for (int d = 0; d < days; d++) {
+        for (auto session : {std::make_pair(7, 9), std::make_pair(12, 13), std::make_pair(18, 23)}) {
+            auto t = (d * 24 + session.first) * hour + between(0, hour / 2);
+            auto end = (d * 24 + session.second) * hour;
+            size_t track = random() % tracks.size();
+            bool isRepeat = false;
+
+            while (t + tracks[track].duration * 1000 < end) {
+                auto runtime = tracks[track].duration * 1000;
+                Play play{t, t + runtime, track, isRepeat};
+                if (!isRepeat)
+                    add(t, playing, &tracks[track]);
+
+                if (chance(10)) {
+                    auto at = t + between(10000, runtime - 10000);
+                    auto length = chance(50) ? between(3000, 60000) : between(60000, 20 * 60000);
+                    add(at, opened, nullptr);
+                    add(at + length, playing, &tracks[track]);
+                    play.end += length;
+                    play.pauseAt = at;
+                    play.pauseLength = length;
+                }
+                day.plays.push_back(play);
+                t = play.end;
+
+                // played again without the title changing, otherwise another one
+                isRepeat = chance(5);
+                if (!isRepeat) {
+                    auto next = random() % tracks.size();
+                    track = next == track ? (next + 1) % tracks.size() : next;
+                }
+            }
+            add(t, closed, nullptr);
+        }
+    }
+    return day;
+}
+
+/**
+ * @brief Stand-in for discord, checks every update against what the player really did
+ */
+class CheckingSink : public PresenceSink {
+  public:
+    CheckingSink(const Clock &clock, const Day &day, const std::vector<MockTrack> &tracks)
+        : clock_(clock), day_(day), tracks_(tracks), reached_(day.plays.size(), false) {}
+
+    bool isConnected() const override { return isConnected_; }
+
+    bool connect() override {
+        connects++;
+        return isConnected_ = true;
+    }
+
+    void update(const Song &song) override {
+        updates++;
+        if (!song.loaded || song.isPaused())
+            return;
+
+        // the play the player is in now, the loop may only be behind by a poll
+        auto now = sessionTime();
+        size_t play = lastPlay_;
+        while (play + 1 < day_.plays.size() && day_.plays[play + 1].start <= now)
+            play++;
+        lastPlay_ = play;
+
+        auto &expected = day_.plays[play];
+        auto &track = tracks_[expected.track];
+        CHECK(song.title == track.title && song.artist == track.artist);
+        CHECK(song.runtime == track.duration);
+        // late by what the start and the last resume were noticed late, early by a late pause
+        auto endError = song.endtime() - (unixStart() + expected.endAt(now) / 1000);
+        CHECK(endError >= -TOLERANCE_S && endError <= 2 * TOLERANCE_S);
+        if (expected.isRepeat)
+            CHECK(song.repeatCount >= 1);
+
+        if (!reached_[play]) {
+            reached_[play] = true;
+            // a repeat is noticed at the predicted end, which is as late as the end shown
+            auto latency = now - expected.start;
+            CHECK(latency >= 0 && latency <= (expected.isRepeat ? 3 : 1) * TOLERANCE_S * 1000);
+            maxLatency = std::max(maxLatency, latency);
+        }
+    }
+
+    void runCallbacks() override {}
+
+    void release() override {
+        releases.push_back(sessionTime());
+        isConnected_ = false;
+    }
+
+    size_t reached() const { return static_cast<size_t>(std::count(reached_.begin(), reached_.end(), true)); }
+
+    /// @brief How late a poll notices a change at most, and a second of rounding to unix time
+    static constexpr int64_t TOLERANCE_S = PollScheduler::IDLE_INTERVAL.count() / 1000 + 1;
+
+    uint64_t connects = 0;
+    uint64_t updates = 0;
+    int64_t maxLatency = 0;
+    std::vector<int64_t> releases;
+
+  private:
+    int64_t sessionTime() const { return std::chrono::duration_cast<std::chrono::milliseconds>(clock_.now() - Clock::time_point{}).count(); }
+
+    int64_t unixStart() const { return clock_.unixTime() - sessionTime() / 1000; }
+
+    const Clock &clock_;
+    const Day &day_;
+    const std::vector<MockTrack> &tracks_;
+    std::vector<bool> reached_;
+    size_t lastPlay_ = 0;
+    bool isConnected_ = false;
+};
+
+int main(int argc, char **argv) {
+    int days = 1;
+    unsigned seed = 1;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--days=", 0) == 0 && std::stoi(arg.substr(7)) > 0) {
+            days = std::stoi(arg.substr(7));
+        } else if (arg.rfind("--seed=", 0) == 0) {
+            seed = static_cast<unsigned>(std::stoul(arg.substr(7)));
+        } else {
+            fprintf(stderr, "usage: %s [--days=<n>] [--seed=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::mt19937 random(seed);
+    auto tracks = catalog(300, random);
+    auto day = simulate(tracks, days, random);
+    MockApi api;
+    for (auto &track : tracks)
+        api.add(track);
+
+    VirtualClock clock;
+    CheckingSink sink(clock, day, tracks);
+    TrackResolver resolver(api.query(), clock);
+
+    LoopIo io;
+    io.presence = &sink;
+    io.queryApi = api.query();
+    io.resolver = &resolver;
+    size_t segment = 0;
+    io.readPlayer = [&](std::wstring &title, std::wstring &artist) {
+        auto now = std::chrono::duration_cast<std::chrono::milliseconds>(clock.now() - Clock::time_point{}).count();
+        while (segment + 1 < day.segments.size() && day.segments[segment + 1].from <= now)
+            segment++;
+        std::wstring_convert<std::codecvt_utf8<wchar_t>> converter;
+        title = converter.from_bytes(day.segments[segment].title);
+        artist = converter.from_bytes(day.segments[segment].artist);
+        return day.segments[segment].state;
+    };
+    auto end = Clock::time_point{} + std::chrono::hours(24 * days);
+    io.isFinished = [&]() { return clock.now() >= end; };
+    isPresenceActive = true;
+
+    auto start = std::chrono::steady_clock::now();
+    rpcLoop(clock, io);
+    auto real = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+    Logger::instance().flush();
+
+    // every pause and close that lasted has the presence let go of, after the idle timeout
+    size_t idles = 0, released = 0;
+    for (size_t i = 0; i < day.segments.size(); i++) {
+        auto &idle = day.segments[i];
+        auto until = i + 1 < day.segments.size() ? day.segments[i + 1].from : end.time_since_epoch() / 1ms;
+        if (idle.state == playing || i == 0 || until - idle.from < 20000)
+            continue;
+        idles++;
+        auto limit = idle.from + (RPC_IDLE_TIMEOUT_SECONDS + CheckingSink::TOLERANCE_S) * 1000;
+        auto it = std::lower_bound(sink.releases.begin(), sink.releases.end(), idle.from);
+        if (it != sink.releases.end() && *it <= limit)
+            released++;
+    }
+
+    auto hours = 24.0 * days;
+    printf("%d day(s): %zu plays, %zu reached the presence, at most %.1f s late\n", days, day.plays.size(),
+           sink.reached(), sink.maxLatency / 1000.0);
+    printf("%zu pauses and closes, %zu let go of the presence in time, %llu connects\n", idles, released,
+           static_cast<unsigned long long>(sink.connects));
+    printf("%llu wake-ups (%.0f an hour), %llu presence updates, %llu api requests\n",
+           static_cast<unsigned long long>(clock.sleepCount()), clock.sleepCount() / hours,
+           static_cast<unsigned long long>(sink.updates), static_cast<unsigned long long>(api.requests()));
+    printf("ran in %.3f s: %.0f times real time, %.0f wake-ups a second\n", real, hours * 3600 / real,
+           clock.sleepCount() / real);
+
+    CHECK(sink.reached() == day.plays.size());
+    CHECK(released == idles);
+    return checkResult();
+}
@@ -0,0 +1,158 @@
+/**
+ * @file    seed_index_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Benchmark of building and looking up a <SeedIndex> (--build-seed-index, --seed-index):
+ *
+ *  seed_index_bench [--entries=<n>]
+ *
+ * Builds an index of <n> tracks (five million by default) in a temporary directory, opens it and
+ * looks up random tracks and tracks it doesn't have. Exits with 1 if a track is missing or found
+ * with the wrong record, a missing one is found, or an index with a damaged header is opened.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <random>
+#include <string>
+#include <vector>
+// local libs
+#include "seed_index.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+
+static double msSince(clock_type::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+static uint64_t readU64(const std::filesystem::path &path, size_t offset) {
+    uint64_t value = 0;
+    std::ifstream file(path, std::ios::binary);
+    file.seekg(static_cast<std::streamoff>(offset));
+    file.read(reinterpret_cast<char *>(&value), sizeof(value));
+    return value;
+}
+
+/// @brief Overwrites the 8 bytes at <offset> of <path> with <value>
+static void patch(const std::filesystem::path &path, size_t offset, uint64_t value) {
+    std::fstream file(path, std::ios::binary | std::ios::in | std::ios::out);
+    file.seekp(static_cast<std::streamoff>(offset));
+    file.write(reinterpret_cast<const char *>(&value), sizeof(value));
+}
+
+static int run(const std::filesystem::path &dir, size_t count) {
+    std::vector<CacheSnapshot::Track> tracks(count);
+    for (size_t i = 0; i < count; i++) {
+        auto &track = tracks[i];
+        track.title = "Song " + std::to_string(i);
+        track.artist = "Artist " + std::to_string(i % 50000);
+        track.album = "Album " + std::to_string(i / 12);
+        track.coverId = "d156d3e0-a5cd-4066-8c36-" + std::to_string(100000000000 + i);
+        track.quality = i % 3 ? "LOSSLESS" : "HI_RES";
+        track.id = static_cast<unsigned>(i + 1);
+        track.runtime = 180 + i % 100;
+        track.trackNumber = static_cast<uint8_t>(i % 20);
+        track.volumeNumber = 1;
+    }
+
+    auto path = dir / "seeds.index";
+    std::string error;
+    auto start = clock_type::now();
+    if (!SeedIndex::build(path.string(), tracks, error)) {
+        fprintf(stderr, "Could not build the index: %s\n", error.c_str());
+        return 2;
+    }
+    auto buildMs = msSince(start);
+    auto size = std::filesystem::file_size(path);
+    printf("%zu tracks, index of %ju bytes (%.1f bytes a track) built in %.0f ms (%.0f ns a track)\n", count,
+           static_cast<uintmax_t>(size), static_cast<double>(size) / count, buildMs, buildMs * 1e6 / count);
+
+    int result = 0;
+    SeedIndex index;
+    start = clock_type::now();
+    if (!index.open(path.string(), error)) {
+        fprintf(stderr, "Could not open the index: %s\n", error.c_str());
+        return 1;
+    }
+    printf("open (mapped): %.3f ms\n", msSince(start));
+
+    // the keys are made up front, so only the lookups are timed
+    std::mt19937 random(1);
+    std::vector<size_t> picks(count);
+    for (auto &pick : picks)
+        pick = random() % count;
+
+    size_t found = 0;
+    start = clock_type::now();
+    for (auto pick : picks) {
+        auto &track = tracks[pick];
+        auto record = index.find(track.title, track.artist);
+        if (record && record->id == track.id && index.coverId(*record) == track.coverId)
+            found++;
+    }
+    auto lookupMs = msSince(start);
+    printf("%zu random lookups: %.0f ms (%.0f ns a lookup), %zu found\n", count, lookupMs, lookupMs * 1e6 / count,
+           found);
+    if (found != count)
+        result = 1;
+
+    size_t wrong = 0;
+    start = clock_type::now();
+    for (size_t i = 0; i < count; i++) {
+        if (index.find("Song " + std::to_string(i), "Nobody"))
+            wrong++;
+    }
+    auto missMs = msSince(start);
+    printf("%zu lookups of tracks it doesn't have: %.0f ms (%.0f ns a lookup), %zu found\n", count, missMs,
+           missMs * 1e6 / count, wrong);
+    if (wrong)
+        result = 1;
+    index.close();
+
+    // a header whose sizes only add up to the file's by wrapping around: more records than there
+    // are, and a strings size short of 0 by as much. Opened, lookups would read past the map.
+    static const size_t COUNT_OFFSET = 16, STRINGS_SIZE_OFFSET = 40;
+    auto damaged = dir / "damaged.index";
+    std::filesystem::copy_file(path, damaged);
+    auto stringsSize = readU64(path, STRINGS_SIZE_OFFSET);
+    auto extra = stringsSize / sizeof(SeedIndex::Record) + 1;
+    patch(damaged, COUNT_OFFSET, readU64(path, COUNT_OFFSET) + extra);
+    patch(damaged, STRINGS_SIZE_OFFSET, stringsSize - extra * sizeof(SeedIndex::Record));
+    if (index.open(damaged.string(), error)) {
+        printf("an index with a wrapped around strings size was opened\n");
+        result = 1;
+    } else {
+        printf("wrapped around strings size refused: %s\n", error.c_str());
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t count = 5000000;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--entries=", 0) == 0 && std::stoul(arg.substr(10)) > 0) {
+            count = std::stoul(arg.substr(10));
+        } else {
+            fprintf(stderr, "usage: %s [--entries=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::error_code error;
+    auto dir = std::filesystem::temp_directory_path(error) /
+               ("seed_index_bench." + std::to_string(std::random_device()()));
+    if (error || !std::filesystem::create_directories(dir, error)) {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        return 2;
+    }
+    auto result = run(dir, count);
+    std::filesystem::remove_all(dir, error);
+    return result;
+}
@@ -0,0 +1,172 @@
+/**
+ * @file    seqlock_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Contention benchmark of the <SeqLock> that publishes <NowPlaying> to the tray, the local api
+ * and the metrics, against the same snapshot behind a mutex:
+ *
+ *  seqlock_bench [--readers=<n>] [--ms=<duration>]
+ *
+ * For 1, 2, 4 ... <n> reader threads (the hardware threads by default) copying the snapshot as
+ * fast as they can, while one writer publishes as fast as it can and then a thousand times a
+ * second (well above what polling publishes), measures the reads a second and the longest a
+ * publish took with either. Exits with 1 if a reader ever copied a torn snapshot.
+ */
+
+// cpp libs
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+// local libs
+#include "now_playing.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+
+/**
+ * @brief The snapshot behind a mutex, the way <currentStatus> is kept
+ */
+class LockedSnapshot {
+  public:
+    void store(const NowPlaying &value) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        value_ = value;
+    }
+
+    NowPlaying load() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return value_;
+    }
+
+  private:
+    mutable std::mutex mutex_;
+    NowPlaying value_{};
+};
+
+/// @brief The <n>th value the writer publishes, every field derived from <n>
+static NowPlaying snapshot(uint64_t n) {
+    NowPlaying np{};
+    auto text = "Song " + std::to_string(n);
+    copyString(np.title, text);
+    copyString(np.artist, text);
+    copyString(np.album, text);
+    np.startTime = static_cast<int64_t>(n);
+    np.endTime = static_cast<int64_t>(n) + 200;
+    np.runtime = 200;
+    np.repeatCount = n;
+    np.state = NowPlaying::playing;
+    return np;
+}
+
+/// @brief Whether <np> is all one published value, and not parts of two
+static bool isWhole(const NowPlaying &np) {
+    auto n = np.repeatCount;
+    if (n == 0)
+        return np.title[0] == '\0';
+    auto text = "Song " + std::to_string(n);
+    return text == np.title && text == np.artist && text == np.album && np.startTime == static_cast<int64_t>(n)
+           && np.endTime == static_cast<int64_t>(n) + 200;
+}
+
+struct Run {
+    double readsPerSecond = 0;   ///< of all readers together
+    double writesPerSecond = 0;
+    double slowestWriteUs = 0;
+    uint64_t torn = 0;
+};
+
+template <class Snapshot>
+static Run measure(Snapshot &shared, unsigned readers, std::chrono::milliseconds duration, bool isPaced) {
+    std::atomic<bool> isStopping{false};
+    std::atomic<uint64_t> reads{0}, torn{0};
+    std::vector<std::thread> threads;
+    for (unsigned i = 0; i < readers; i++) {
+        threads.emplace_back([&]() {
+            uint64_t count = 0, bad = 0;
+            while (!isStopping.load(std::memory_order_relaxed)) {
+                if (!isWhole(shared.load()))
+                    bad++;
+                count++;
+            }
+            reads += count;
+            torn += bad;
+        });
+    }
+
+    // the values are made up front, so only the publishing is timed
+    std::vector<NowPlaying> values(1024);
+    for (size_t i = 0; i < values.size(); i++)
+        values[i] = snapshot(i + 1);
+    uint64_t writes = 0;
+    clock_type::duration slowest{};
+    auto start = clock_type::now();
+    for (auto now = start; now - start < duration; now = clock_type::now()) {
+        if (isPaced) {
+            std::this_thread::sleep_until(start + writes * std::chrono::milliseconds(1));
+            now = clock_type::now();
+        }
+        shared.store(values[writes++ % values.size()]);
+        slowest = std::max(slowest, clock_type::now() - now);
+    }
+    auto seconds = std::chrono::duration<double>(clock_type::now() - start).count();
+    isStopping = true;
+    for (auto &thread : threads)
+        thread.join();
+
+    Run run;
+    run.readsPerSecond = reads / seconds;
+    run.writesPerSecond = writes / seconds;
+    run.slowestWriteUs = std::chrono::duration<double, std::micro>(slowest).count();
+    run.torn = torn;
+    return run;
+}
+
+int main(int argc, char **argv) {
+    unsigned maxReaders = std::max(1u, std::thread::hardware_concurrency());
+    long ms = 1000;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--readers=", 0) == 0 && std::stoul(arg.substr(10)) > 0) {
+            maxReaders = static_cast<unsigned>(std::stoul(arg.substr(10)));
+        } else if (arg.rfind("--ms=", 0) == 0 && std::stol(arg.substr(5)) > 0) {
+            ms = std::stol(arg.substr(5));
+        } else {
+            fprintf(stderr, "usage: %s [--readers=<n>] [--ms=<duration>]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::chrono::milliseconds duration(ms);
+
+    printf("NowPlaying of %zu bytes, %u hardware threads, %ld ms a run\n", sizeof(NowPlaying),
+           std::thread::hardware_concurrency(), ms);
+    int result = 0;
+    std::vector<unsigned> counts;
+    for (unsigned readers = 1; readers < maxReaders; readers *= 2)
+        counts.push_back(readers);
+    counts.push_back(maxReaders);
+    for (auto isPaced : {false, true}) {
+        printf("\nwriter publishing %s\n", isPaced ? "a thousand times a second" : "as fast as it can");
+        printf("%8s %16s %16s %18s %16s %16s %18s\n", "readers", "seqlock reads/s", "seqlock writes/s",
+               "slowest write (us)", "mutex reads/s", "mutex writes/s", "slowest write (us)");
+        for (auto readers : counts) {
+            SeqLock<NowPlaying> seqLock;
+            LockedSnapshot locked;
+            auto lockFree = measure(seqLock, readers, duration, isPaced);
+            auto mutex = measure(locked, readers, duration, isPaced);
+            printf("%8u %16.0f %16.0f %18.1f %16.0f %16.0f %18.1f\n", readers, lockFree.readsPerSecond,
+                   lockFree.writesPerSecond, lockFree.slowestWriteUs, mutex.readsPerSecond, mutex.writesPerSecond,
+                   mutex.slowestWriteUs);
+            if (lockFree.torn || mutex.torn) {
+                printf("%llu torn seqlock reads, %llu torn mutex reads\n",
+                       static_cast<unsigned long long>(lockFree.torn), static_cast<unsigned long long>(mutex.torn));
+                result = 1;
+            }
+        }
+    }
+    return result;
+}
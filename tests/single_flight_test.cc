@@ -0,0 +1,100 @@
+/**
+ * @file    single_flight_test.cc
+ * @authors Stavros Avramidis
+ *
+ * Drives bursts of duplicate lookups through a <TrackResolver> against a mock of the search api
+ * and checks how many requests actually reach it.
+ */
+
+// cpp libs
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+#include <vector>
+// local libs
+#include "checks.hh"
+#include "clock.hh"
+#include "httplib.hh"
+#include "track_resolver.hh"
+
+
+int main() {
+    // answers every search with one track, slowly enough for lookups to overlap. Queries
+    // containing "flaky" fail the first time.
+    std::atomic<int> hits{0};
+    std::atomic<int> flakyHits{0};
+    httplib::Server mock;
+    mock.Get("/v1/search", [&](const httplib::Request &req, httplib::Response &res) {
+        hits++;
+        std::this_thread::sleep_for(std::chrono::milliseconds(150));
+        auto query = req.get_param_value("query");
+        if (query.find("flaky") != std::string::npos && flakyHits++ == 0) {
+            res.status = 500;
+            return;
+        }
+
+        nlohmann::json track = {
+            {"id", 42}, {"title", "Song A"}, {"audioQuality", "HI_RES"}, {"trackNumber", 1}, {"volumeNumber", 1},
+            {"duration", 200}, {"artists", {{{"name", "Artist"}}}},
+            {"album", {{"title", "Album"}, {"cover", "aa-bb"}, {"releaseDate", "2020-01-01"}}}};
+        nlohmann::json body = {{"tracks", {{"totalNumberOfItems", 1}, {"items", {track}}}}};
+        res.set_content(body.dump(), "application/json");
+    });
+    auto port = mock.bind_to_any_port("127.0.0.1");
+    std::thread server([&]() { mock.listen_after_bind(); });
+    while (!mock.is_running())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    ApiQuery query = [port](const std::string &path, const httplib::Headers &headers) {
+        httplib::Client client("127.0.0.1", port);
+        return client.Get(path.c_str(), headers);
+    };
+    SystemClock clock;
+    TrackResolver resolver(query, clock);
+
+    // a burst of the same lookup while the title flickers between spellings
+    std::vector<std::thread> lookups;
+    std::atomic<int> found{0};
+    for (int i = 0; i < 16; i++) {
+        lookups.emplace_back([&, i]() {
+            auto info = resolver.resolve("Song A", i % 2 ? "Artist" : "  artist ");
+            if (info.isFound && info.id == 42)
+                found++;
+        });
+    }
+    for (auto &lookup : lookups)
+        lookup.join();
+    printf("16 duplicate lookups: %d upstream, %llu coalesced\n", hits.load(),
+           static_cast<unsigned long long>(resolver.coalesced()));
+    CHECK(hits == 1);
+    CHECK(resolver.upstreamCalls() == 1);
+    CHECK(found == 16);
+
+    // right after it finished, still within LINGER
+    resolver.resolve("Song A", "Artist");
+    CHECK(hits == 1);
+
+    // three different tracks, four lookups each
+    lookups.clear();
+    for (int i = 0; i < 12; i++)
+        lookups.emplace_back([&, i]() { resolver.resolve("Song A", "Artist " + std::to_string(i % 3)); });
+    for (auto &lookup : lookups)
+        lookup.join();
+    printf("3 tracks looked up 4 times each: %d upstream\n", hits.load() - 1);
+    CHECK(hits == 4);
+
+    // a failure is shared with whoever waits for it, but not kept for the next lookup
+    auto failed = resolver.resolve("Song A", "flaky");
+    auto retried = resolver.resolve("Song A", "flaky");
+    printf("a failed lookup and its retry: %d upstream\n", hits.load() - 4);
+    CHECK(!failed.isFound);
+    CHECK(retried.isFound);
+    CHECK(hits == 6);
+
+    mock.stop();
+    server.join();
+    Logger::instance().flush();
+    return checkResult();
+}
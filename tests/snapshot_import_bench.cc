@@ -0,0 +1,198 @@
+/**
+ * @file    snapshot_import_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Benchmark of importing a seed snapshot into the <TrackCache> (--import-cache):
+ *
+ *  snapshot_import_bench [--entries=<n>]
+ *
+ * Writes a snapshot of <n> tracks (a million by default) in a temporary directory, imports it,
+ * reopens the cache with it installed, looks up random tracks and exports it again. The same
+ * entries loaded from the append-only file are the baseline. Exits with 1 if a track is missing,
+ * the export differs from what was imported or a damaged snapshot isn't refused.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <fstream>
+#include <iterator>
+#include <random>
+#include <string>
+#include <vector>
+// local libs
+#include "track_cache.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+
+static double msSince(clock_type::time_point start) {
+    return std::chrono::duration<double, std::milli>(clock_type::now() - start).count();
+}
+
+static std::string readFile(const std::filesystem::path &path) {
+    std::ifstream in(path, std::ios::binary);
+    return std::string(std::istreambuf_iterator<char>(in), std::istreambuf_iterator<char>());
+}
+
+static void writeFile(const std::filesystem::path &path, const std::string &content) {
+    std::ofstream out(path, std::ios::binary | std::ios::trunc);
+    out.write(content.data(), content.size());
+}
+
+static int run(const std::filesystem::path &dir, size_t count) {
+    std::vector<CacheSnapshot::Track> tracks(count);
+    for (size_t i = 0; i < count; i++) {
+        auto &track = tracks[i];
+        track.title = "Track title number " + std::to_string(i);
+        track.artist = "Artist " + std::to_string(i % 5000);
+        track.album = "Some album " + std::to_string(i / 12);
+        track.coverId = "d156d3e0-a5cd-4066-8c36-" + std::to_string(100000000 + i);
+        track.quality = i % 3 ? "LOSSLESS" : "HI_RES";
+        track.id = static_cast<unsigned>(i + 1);
+        track.runtime = 180 + i % 100;
+        track.trackNumber = static_cast<uint8_t>(i % 20);
+        track.volumeNumber = 1;
+        track.resolvedAt = 1700000000 + static_cast<int64_t>(i);
+    }
+
+    auto seed = dir / "seed.snapshot";
+    auto start = clock_type::now();
+    if (!CacheSnapshot::write(seed.string(), tracks)) {
+        fprintf(stderr, "Could not write %s\n", seed.string().c_str());
+        return 2;
+    }
+    printf("%zu tracks, snapshot of %ju bytes written in %.0f ms\n", count,
+           static_cast<uintmax_t>(std::filesystem::file_size(seed)), msSince(start));
+
+    int result = 0;
+    auto cachePath = (dir / "imported" / "tracks.cache").string();
+    {
+        TrackCache cache;
+        cache.open(cachePath);
+        std::string error;
+        start = clock_type::now();
+        if (!cache.importSnapshot(seed.string(), error)) {
+            fprintf(stderr, "Import failed: %s\n", error.c_str());
+            return 1;
+        }
+        printf("import (checked, copied and mapped): %.0f ms, %zu entries\n", msSince(start), cache.size());
+    }
+
+    auto exported = dir / "exported.snapshot";
+    {
+        start = clock_type::now();
+        TrackCache cache;
+        cache.open(cachePath);
+        printf("opening the cache with the snapshot installed: %.0f ms\n", msSince(start));
+
+        std::mt19937 random(1);
+        TrackCache::Entry entry;
+        size_t found = 0;
+        start = clock_type::now();
+        for (size_t i = 0; i < count; i++) {
+            auto &track = tracks[random() % count];
+            if (cache.get(track.title, track.artist, entry) && entry.info.id == track.id)
+                found++;
+        }
+        printf("%zu random lookups: %.0f ms, %zu found\n", count, msSince(start), found);
+        if (found != count || cache.get("Not a track", "Nobody", entry))
+            result = 1;
+
+        start = clock_type::now();
+        if (!cache.exportSnapshot(exported.string()))
+            result = 1;
+        printf("export: %.0f ms\n", msSince(start));
+    }
+    {
+        // the strings are laid out in another order, so it is compared track by track
+        CacheSnapshot snapshot;
+        std::string error;
+        size_t same = 0;
+        CacheSnapshot::Track read;
+        if (snapshot.open(exported.string(), error) && snapshot.size() == count) {
+            for (auto &track : tracks) {
+                if (snapshot.find(track.title, track.artist, read) && read.album == track.album &&
+                    read.coverId == track.coverId && read.quality == track.quality && read.id == track.id &&
+                    read.runtime == track.runtime && read.trackNumber == track.trackNumber &&
+                    read.volumeNumber == track.volumeNumber && read.resolvedAt == track.resolvedAt)
+                    same++;
+            }
+        }
+        if (same != count) {
+            printf("the export differs from the imported snapshot\n");
+            result = 1;
+        }
+    }
+
+    // the baseline, the same entries in the append-only file
+    auto logPath = (dir / "log" / "tracks.cache").string();
+    {
+        TrackCache cache;
+        cache.open(logPath);
+        for (auto &track : tracks) {
+            TrackInfo info;
+            info.isFound = true;
+            info.id = track.id;
+            info.album = track.album;
+            info.coverId = track.coverId;
+            info.quality = track.quality;
+            info.runtime = track.runtime;
+            info.trackNumber = track.trackNumber;
+            info.volumeNumber = track.volumeNumber;
+            cache.put(track.title, track.artist, info, track.resolvedAt);
+        }
+    }
+    {
+        start = clock_type::now();
+        TrackCache cache;
+        cache.open(logPath);
+        printf("baseline, opening the same entries from the cache file: %.0f ms, %zu entries\n", msSince(start),
+               cache.size());
+    }
+
+    // a flipped byte and a cut off file are refused
+    auto content = readFile(seed);
+    auto damaged = content;
+    damaged[damaged.size() / 2] ^= 0x55;
+    writeFile(dir / "damaged.snapshot", damaged);
+    writeFile(dir / "short.snapshot", content.substr(0, 1000));
+    for (auto name : {"damaged.snapshot", "short.snapshot"}) {
+        CacheSnapshot snapshot;
+        std::string error;
+        if (snapshot.open((dir / name).string(), error)) {
+            printf("%s was not refused\n", name);
+            result = 1;
+        } else {
+            printf("%s refused: %s\n", name, error.c_str());
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t count = 1000000;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--entries=", 0) == 0 && std::stoul(arg.substr(10)) > 0) {
+            count = std::stoul(arg.substr(10));
+        } else {
+            fprintf(stderr, "usage: %s [--entries=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::error_code error;
+    auto dir = std::filesystem::temp_directory_path(error) /
+               ("snapshot_import_bench." + std::to_string(std::random_device()()));
+    if (error || !std::filesystem::create_directories(dir, error)) {
+        fprintf(stderr, "Could not create a temporary directory\n");
+        return 2;
+    }
+    auto result = run(dir, count);
+    std::filesystem::remove_all(dir, error);
+    Logger::instance().flush();
+    return result;
+}
@@ -0,0 +1,230 @@
+/**
+ * @file    sse_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Benchmark of the epoll <SseServer> behind the local api on linux:
+ *
+ *  sse_bench [--subscribers=<n>,<n>...] [--broadcasts=<n>]
+ *
+ * The server runs in a child process, so its resident memory only counts what it keeps per
+ * connection. For every subscriber count that many idle event streams are opened, then events
+ * are broadcast one at a time and timed from the publish call until each subscriber had it. The
+ * subscribers are all read by one poll() thread, so with many of them the latencies are an upper bound.
+ */
+
+// cpp libs
+#include <algorithm>
+#include <chrono>
+#include <cstdint>
+#include <cstdio>
+#include <fstream>
+#include <string>
+#include <vector>
+// linux api
+#include <sys/wait.h>
+// local libs
+#include "sse_server.hh"
+#include "sse_subscribers.hh"
+
+using clock_type = SseSubscribers::clock;
+
+
+static double ms(clock_type::duration duration) {
+    return std::chrono::duration<double, std::milli>(duration).count();
+}
+
+static double percentile(std::vector<double> values, double p) {
+    if (values.empty())
+        return 0;
+    std::sort(values.begin(), values.end());
+    return values[std::min(values.size() - 1, static_cast<size_t>(p * values.size()))];
+}
+
+/// @brief A "<key>: <value> kB" line of a /proc file, in kB
+static uint64_t procKb(const char *path, const char *key) {
+    std::ifstream in(path);
+    std::string line;
+    auto prefix = std::string(key) + ":";
+    while (std::getline(in, line))
+        if (line.compare(0, prefix.size(), prefix) == 0)
+            return std::stoull(line.substr(prefix.size()));
+    return 0;
+}
+
+/**
+ * @brief The server side: answers commands from <commands> on <replies>
+ *  'p' publishes an event carrying the current steady_clock time, 'm' replies the resident memory
+ *  in kB, 'c' the subscriber count, 'q' quits
+ */
+static int serve(int commands, int replies) {
+    SseServer server("/now-playing", "/now-playing/events");
+    uint64_t port = server.bind("127.0.0.1", 0);
+    if (static_cast<int64_t>(port) < 0 || !server.start())
+        port = 0;
+    if (write(replies, &port, sizeof(port)) != sizeof(port) || !port)
+        return 1;
+
+    char command;
+    while (read(commands, &command, 1) == 1) {
+        uint64_t reply = 0;
+        switch (command) {
+            case 'p': {
+                auto now = std::chrono::duration_cast<std::chrono::nanoseconds>(clock_type::now().time_since_epoch());
+                server.publish("{}", "data: " + std::to_string(now.count()) + "\n\n");
+                continue;
+            }
+            case 'm':
+                reply = procKb("/proc/self/status", "VmRSS");
+                break;
+            case 'c':
+                reply = server.subscriberCount();
+                break;
+            default:
+                return 0;
+        }
+        if (write(replies, &reply, sizeof(reply)) != sizeof(reply))
+            return 1;
+    }
+    return 0;
+}
+
+struct Server {
+    pid_t pid;
+    int commands;
+    int replies;
+
+    uint64_t ask(char command) const {
+        uint64_t reply = 0;
+        if (write(commands, &command, 1) != 1 || read(replies, &reply, sizeof(reply)) != sizeof(reply))
+            return 0;
+        return reply;
+    }
+
+    void publish() const { (void) !write(commands, "p", 1); }
+};
+
+int main(int argc, char **argv) {
+    std::vector<size_t> counts = {1000, 10000};
+    size_t broadcasts = 50;
+
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--subscribers=", 0) == 0) {
+            counts.clear();
+            for (size_t at = 14; at < arg.size() + 1;) {
+                auto end = std::min(arg.find(',', at), arg.size());
+                counts.push_back(std::stoul(arg.substr(at, end - at)));
+                at = end + 1;
+            }
+        } else if (arg.rfind("--broadcasts=", 0) == 0) {
+            broadcasts = std::stoul(arg.substr(13));
+        } else {
+            fprintf(stderr, "usage: %s [--subscribers=<n>,<n>...] [--broadcasts=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+    std::sort(counts.begin(), counts.end());
+
+    // the child inherits the raised limit
+    auto limit = SseSubscribers::raiseFileLimit();
+    if (limit < counts.back() + 64) {
+        fprintf(stderr, "The descriptor limit (%zu) is too low for %zu subscribers\n", limit, counts.back());
+        return 2;
+    }
+
+    int toServer[2], fromServer[2];
+    if (pipe(toServer) != 0 || pipe(fromServer) != 0)
+        return 2;
+    auto pid = fork();
+    if (pid == 0) {
+        ::close(toServer[1]);
+        ::close(fromServer[0]);
+        _exit(serve(toServer[0], fromServer[1]));
+    }
+    ::close(toServer[0]);
+    ::close(fromServer[1]);
+    Server server{pid, toServer[1], fromServer[0]};
+
+    uint64_t port = 0;
+    if (read(server.replies, &port, sizeof(port)) != sizeof(port) || !port) {
+        fprintf(stderr, "The server did not start\n");
+        return 2;
+    }
+
+    auto baseRss = server.ask('m');
+    auto baseSlab = procKb("/proc/meminfo", "Slab");
+    printf("server: %llu kB resident without subscribers\n", static_cast<unsigned long long>(baseRss));
+
+    SseSubscribers subscribers;
+    std::vector<int64_t> seen;  ///< per subscriber, the timestamp of the latest event it had
+    int64_t latest = 0;
+    size_t reached = 0;
+    std::vector<double> latencies;
+    clock_type::time_point lastArrival;
+
+    auto onEvent = [&](size_t subscriber, const std::string &data, clock_type::time_point arrivedAt) {
+        auto sentAt = std::stoll(data);
+        if (sentAt != latest || seen[subscriber] == sentAt)
+            return;
+        seen[subscriber] = sentAt;
+        reached++;
+        lastArrival = arrivedAt;
+        latencies.push_back(ms(arrivedAt - clock_type::time_point(std::chrono::nanoseconds(sentAt))));
+    };
+
+    int result = 0;
+    for (auto count : counts) {
+        auto start = clock_type::now();
+        subscribers.connect("127.0.0.1", static_cast<int>(port), "/now-playing/events", count - subscribers.size());
+        seen.resize(subscribers.size(), 0);
+        subscribers.pump(std::chrono::seconds(30), onEvent, [&]() {
+            return subscribers.streaming() + subscribers.closed() >= subscribers.size();
+        });
+        auto connected = ms(clock_type::now() - start);
+
+        auto serverCount = server.ask('c');
+        auto rss = server.ask('m');
+        auto slab = static_cast<int64_t>(procKb("/proc/meminfo", "Slab")) - static_cast<int64_t>(baseSlab);
+        printf("\n%zu subscribers (%llu on the server), connected in %.0f ms\n", subscribers.size(),
+               static_cast<unsigned long long>(serverCount), connected);
+        printf("  server resident: %llu kB, %.0f bytes per connection\n", static_cast<unsigned long long>(rss),
+               (static_cast<double>(rss) - baseRss) * 1024.0 / std::max<size_t>(serverCount, 1));
+        // system wide and both ends of every connection, a rough upper bound of the kernel's share
+        printf("  kernel slab: %+lld kB, %.0f bytes per connection (client and server sockets)\n",
+               static_cast<long long>(slab), slab * 1024.0 / std::max<size_t>(serverCount, 1));
+
+        std::vector<double> untilAll;
+        latencies.clear();
+        size_t missed = 0;
+        for (size_t i = 0; i < broadcasts; i++) {
+            reached = 0;
+            // the event on its way is the first one newer than the previous, it carries its own time
+            auto previous = latest;
+            latest = 0;
+            server.publish();
+            subscribers.pump(std::chrono::seconds(10),
+                             [&](size_t subscriber, const std::string &data, clock_type::time_point arrivedAt) {
+                                 if (!latest && std::stoll(data) > previous)
+                                     latest = std::stoll(data);
+                                 onEvent(subscriber, data, arrivedAt);
+                             },
+                             [&]() { return reached == subscribers.streaming(); });
+            if (reached == subscribers.streaming())
+                untilAll.push_back(ms(lastArrival - clock_type::time_point(std::chrono::nanoseconds(latest))));
+            else
+                missed += subscribers.streaming() - reached;
+        }
+        printf("  %zu broadcasts, to one subscriber: p50 %.2f ms, p99 %.2f ms\n", broadcasts,
+               percentile(latencies, 0.5), percentile(latencies, 0.99));
+        printf("  until the last subscriber had it: p50 %.2f ms, p99 %.2f ms, max %.2f ms\n",
+               percentile(untilAll, 0.5), percentile(untilAll, 0.99), percentile(untilAll, 1));
+        if (missed) {
+            printf("  %zu deliveries missed\n", missed);
+            result = 1;
+        }
+    }
+
+    server.ask('q');
+    waitpid(server.pid, nullptr, 0);
+    return result;
+}
@@ -0,0 +1,115 @@
+/**
+ * @file    sse_server_test.cc
+ * @authors Stavros Avramidis
+ *
+ * Slow clients against the epoll <SseServer>: one that connects and never sends anything and one
+ * that trickles its request a byte a second have to be dropped once the request timeout is up,
+ * while a subscriber connected all along keeps getting events.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+// posix
+#include <arpa/inet.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/socket.h>
+#include <unistd.h>
+// local libs
+#include "checks.hh"
+#include "sse_server.hh"
+
+using namespace std::chrono_literals;
+using clock_type = std::chrono::steady_clock;
+
+
+static int connectTo(int port) {
+    sockaddr_in address{};
+    address.sin_family = AF_INET;
+    address.sin_port = htons(static_cast<uint16_t>(port));
+    address.sin_addr.s_addr = htonl(INADDR_LOOPBACK);
+    auto fd = socket(AF_INET, SOCK_STREAM, 0);
+    if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0) {
+        ::close(fd);
+        return -1;
+    }
+    return fd;
+}
+
+/// @brief Whether the server closed <fd>, reading whatever it sent before
+static bool isClosed(int fd) {
+    char buffer[1024];
+    for (;;) {
+        pollfd pfd{fd, POLLIN, 0};
+        if (poll(&pfd, 1, 0) <= 0)
+            return false;
+        auto n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return true;
+    }
+}
+
+/// @brief Reads from <fd> for up to <timeout>, until what was read contains <text>
+static bool receives(int fd, const std::string &text, std::chrono::milliseconds timeout) {
+    std::string received;
+    auto deadline = clock_type::now() + timeout;
+    while (received.find(text) == std::string::npos) {
+        auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock_type::now());
+        pollfd pfd{fd, POLLIN, 0};
+        if (left.count() <= 0 || poll(&pfd, 1, static_cast<int>(left.count())) <= 0)
+            return false;
+        char buffer[1024];
+        auto n = recv(fd, buffer, sizeof(buffer), 0);
+        if (n <= 0)
+            return false;
+        received.append(buffer, static_cast<size_t>(n));
+    }
+    return true;
+}
+
+int main() {
+    SseServer server("/now-playing", "/now-playing/events");
+    auto port = server.bind("127.0.0.1", 0);
+    CHECK(port > 0 && server.start());
+
+    auto subscriber = connectTo(port);
+    std::string request = "GET /now-playing/events HTTP/1.1\r\nHost: 127.0.0.1\r\n\r\n";
+    send(subscriber, request.data(), request.size(), MSG_NOSIGNAL);
+    CHECK(receives(subscriber, "text/event-stream", 2s));
+
+    auto silent = connectTo(port);
+    auto trickling = connectTo(port);
+    auto started = clock_type::now();
+    bool isSilentDropped = false, isTricklingDropped = false;
+    size_t sent = 0;
+    while (clock_type::now() - started < 10s && !(isSilentDropped && isTricklingDropped)) {
+        if (!isTricklingDropped && sent < request.size() - 4 && clock_type::now() - started >= sent * 1s)
+            send(trickling, &request[sent++], 1, MSG_NOSIGNAL);
+        std::this_thread::sleep_for(50ms);
+
+        auto elapsed = std::chrono::duration_cast<std::chrono::milliseconds>(clock_type::now() - started);
+        for (auto client : {std::make_pair(silent, &isSilentDropped), std::make_pair(trickling, &isTricklingDropped)}) {
+            if (!*client.second && isClosed(client.first)) {
+                *client.second = true;
+                printf("%s client dropped after %lld ms\n", client.first == silent ? "silent" : "trickling",
+                       static_cast<long long>(elapsed.count()));
+                CHECK(elapsed >= 4500ms && elapsed <= 7s);
+            }
+        }
+    }
+    CHECK(isSilentDropped);
+    CHECK(isTricklingDropped);
+
+    // the subscriber was left alone
+    CHECK(server.subscriberCount() == 1);
+    server.publish("{}", "data: {\"title\":\"after the sweep\"}\n\n");
+    CHECK(receives(subscriber, "after the sweep", 2s));
+
+    for (auto fd : {subscriber, silent, trickling})
+        ::close(fd);
+    server.stop();
+    return checkResult();
+}
@@ -0,0 +1,192 @@
+/**
+ * @file    sse_subscribers.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <cerrno>
+#include <chrono>
+#include <cstring>
+#include <functional>
+#include <string>
+#include <vector>
+// posix
+#include <arpa/inet.h>
+#include <fcntl.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <sys/resource.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+
+/**
+ * @brief Many Server-Sent Events subscriptions driven from one thread with poll(), for load tests
+ * and benchmarks of the now-playing api. Every event is reported with the time it arrived.
+ */
+class SseSubscribers {
+  public:
+    using clock = std::chrono::steady_clock;
+    /// @brief Called with the data of every event, comments (heartbeats) are skipped
+    using OnEvent = std::function<void(size_t subscriber, const std::string &data, clock::time_point arrivedAt)>;
+
+    SseSubscribers() = default;
+    SseSubscribers(const SseSubscribers &) = delete;
+    SseSubscribers &operator=(const SseSubscribers &) = delete;
+
+    ~SseSubscribers() {
+        for (auto &subscriber : subscribers_)
+            if (subscriber.fd >= 0)
+                ::close(subscriber.fd);
+    }
+
+    /// @brief Raises the descriptor limit to the hard limit, every subscriber is one
+    static size_t raiseFileLimit() {
+        rlimit limit{};
+        if (getrlimit(RLIMIT_NOFILE, &limit) != 0)
+            return 0;
+        if (limit.rlim_cur < limit.rlim_max) {
+            limit.rlim_cur = limit.rlim_max;
+            setrlimit(RLIMIT_NOFILE, &limit);
+        }
+        return static_cast<size_t>(limit.rlim_cur);
+    }
+
+    /**
+     * @brief Opens <count> more subscriptions to <path> on an IPv4 <host>
+     * @return how many could be opened
+     */
+    size_t connect(const char *host, int port, const std::string &path, size_t count) {
+        sockaddr_in address{};
+        address.sin_family = AF_INET;
+        address.sin_port = htons(static_cast<uint16_t>(port));
+        if (inet_pton(AF_INET, host, &address.sin_addr) != 1)
+            return 0;
+
+        auto request = "GET " + path + " HTTP/1.1\r\nHost: " + host + "\r\nAccept: text/event-stream\r\n\r\n";
+        size_t opened = 0;
+        for (; opened < count; opened++) {
+            auto fd = socket(AF_INET, SOCK_STREAM, 0);
+            if (fd < 0)
+                break;
+            if (::connect(fd, reinterpret_cast<sockaddr *>(&address), sizeof(address)) != 0
+                || ::send(fd, request.data(), request.size(), 0) != static_cast<ssize_t>(request.size())) {
+                ::close(fd);
+                break;
+            }
+            fcntl(fd, F_SETFL, fcntl(fd, F_GETFL) | O_NONBLOCK);
+
+            Subscriber subscriber;
+            subscriber.fd = fd;
+            subscribers_.push_back(std::move(subscriber));
+            pollFds_.push_back(pollfd{fd, POLLIN, 0});
+        }
+        return opened;
+    }
+
+    /**
+     * @brief Reads and dispatches what arrives, until <isDone> or <timeout>
+     * @return false on timeout
+     */
+    bool pump(std::chrono::milliseconds timeout, const OnEvent &onEvent, const std::function<bool()> &isDone) {
+        auto deadline = clock::now() + timeout;
+        char buffer[4096];
+
+        while (!isDone()) {
+            auto left = std::chrono::duration_cast<std::chrono::milliseconds>(deadline - clock::now());
+            if (left.count() <= 0)
+                return false;
+            if (poll(pollFds_.data(), pollFds_.size(), static_cast<int>(left.count())) <= 0)
+                continue;
+
+            auto arrivedAt = clock::now();
+            for (size_t i = 0; i < pollFds_.size(); i++) {
+                if (!pollFds_[i].revents)
+                    continue;
+
+                auto &subscriber = subscribers_[i];
+                for (;;) {
+                    auto n = ::recv(subscriber.fd, buffer, sizeof(buffer), 0);
+                    if (n > 0) {
+                        subscriber.buffer.append(buffer, static_cast<size_t>(n));
+                        continue;
+                    }
+                    if (n == 0 || (errno != EAGAIN && errno != EWOULDBLOCK)) {
+                        ::close(subscriber.fd);
+                        subscriber.fd = -1;
+                        pollFds_[i].fd = -1;  // ignored by poll
+                        closed_++;
+                    }
+                    break;
+                }
+                parse(i, arrivedAt, onEvent);
+            }
+        }
+        return true;
+    }
+
+    size_t size() const noexcept { return subscribers_.size(); }
+
+    /// @brief Subscriptions that got a 200 and the event stream headers
+    size_t streaming() const noexcept { return streaming_; }
+
+    /// @brief Subscriptions the server closed or refused
+    size_t closed() const noexcept { return closed_; }
+
+  private:
+    struct Subscriber {
+        int fd = -1;
+        std::string buffer;  ///< as received
+        std::string stream;  ///< event stream, out of the chunks if <isChunked>
+        bool isStreaming = false;
+        bool isChunked = false;  ///< the pooled server (off linux) sends chunks
+    };
+
+    void parse(size_t index, clock::time_point arrivedAt, const OnEvent &onEvent) {
+        auto &subscriber = subscribers_[index];
+        auto &buffer = subscriber.buffer;
+
+        if (!subscriber.isStreaming) {
+            auto headEnd = buffer.find("\r\n\r\n");
+            if (headEnd == std::string::npos)
+                return;
+            if (buffer.compare(0, 12, "HTTP/1.1 200") != 0)
+                return;
+            subscriber.isStreaming = true;
+            subscriber.isChunked = buffer.substr(0, headEnd).find("Transfer-Encoding: chunked") != std::string::npos;
+            streaming_++;
+            buffer.erase(0, headEnd + 4);
+        }
+
+        if (!subscriber.isChunked) {
+            subscriber.stream.append(buffer);
+            buffer.clear();
+        } else {
+            // <size in hex>\r\n<data>\r\n
+            size_t lineEnd;
+            while ((lineEnd = buffer.find("\r\n")) != std::string::npos) {
+                auto size = std::stoul(buffer.substr(0, lineEnd), nullptr, 16);
+                if (buffer.size() < lineEnd + 2 + size + 2)
+                    break;
+                subscriber.stream.append(buffer, lineEnd + 2, size);
+                buffer.erase(0, lineEnd + 2 + size + 2);
+            }
+        }
+
+        auto &stream = subscriber.stream;
+        size_t eventEnd;
+        while ((eventEnd = stream.find("\n\n")) != std::string::npos) {
+            if (stream.compare(0, 6, "data: ") == 0)
+                onEvent(index, stream.substr(6, eventEnd - 6), arrivedAt);
+            stream.erase(0, eventEnd + 2);
+        }
+    }
+
+    std::vector<Subscriber> subscribers_;
+    std::vector<pollfd> pollFds_;  ///< parallel to <subscribers_>
+    size_t streaming_ = 0;
+    size_t closed_ = 0;
+};
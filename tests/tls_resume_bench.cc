@@ -0,0 +1,185 @@
+/**
+ * @file    tls_resume_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Benchmark of how api queries connect over https, against a local httplib SSLServer with a
+ * throwaway self-signed certificate:
+ *
+ *  tls_resume_bench [--requests=<n>]
+ *
+ * Times <n> requests each with a new client (a full handshake every time), with one client that
+ * reconnects for every request (the session resumed) and with one kept alive connection, the way
+ * tidalApi() queries. Exits with 1 if the handshakes weren't the kind expected.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <memory>
+#include <random>
+#include <string>
+#include <thread>
+// openssl
+#include <openssl/evp.h>
+#include <openssl/pem.h>
+#include <openssl/rsa.h>
+#include <openssl/x509.h>
+// local libs
+#include "httplib.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+
+/**
+ * @brief Writes a self-signed certificate for 127.0.0.1 and its RSA key to <certPath> and <keyPath>
+ */
+static bool writeCertificate(const std::string &certPath, const std::string &keyPath) {
+    EVP_PKEY *key = nullptr;
+    auto keyContext = EVP_PKEY_CTX_new_id(EVP_PKEY_RSA, nullptr);
+    bool isGenerated = keyContext && EVP_PKEY_keygen_init(keyContext) == 1
+                       && EVP_PKEY_CTX_set_rsa_keygen_bits(keyContext, 2048) == 1
+                       && EVP_PKEY_keygen(keyContext, &key) == 1;
+    EVP_PKEY_CTX_free(keyContext);
+    if (!isGenerated)
+        return false;
+
+    auto cert = X509_new();
+    ASN1_INTEGER_set(X509_get_serialNumber(cert), 1);
+    X509_gmtime_adj(X509_getm_notBefore(cert), 0);
+    X509_gmtime_adj(X509_getm_notAfter(cert), 24 * 60 * 60);
+    X509_set_pubkey(cert, key);
+    auto name = X509_get_subject_name(cert);
+    X509_NAME_add_entry_by_txt(name, "CN", MBSTRING_ASC, reinterpret_cast<const unsigned char *>("127.0.0.1"), -1,
+                               -1, 0);
+    X509_set_issuer_name(cert, name);
+    bool isWritten = X509_sign(cert, key, EVP_sha256()) > 0;
+
+    for (auto path : {&certPath, &keyPath}) {
+        auto file = fopen(path->c_str(), "w");
+        if (!file) {
+            isWritten = false;
+            continue;
+        }
+        if (path == &certPath)
+            isWritten = isWritten && PEM_write_X509(file, cert) == 1;
+        else
+            isWritten = isWritten && PEM_write_PrivateKey(file, key, nullptr, nullptr, 0, nullptr, nullptr) == 1;
+        fclose(file);
+    }
+    X509_free(cert);
+    EVP_PKEY_free(key);
+    return isWritten;
+}
+
+struct Run {
+    double msPerRequest = 0;
+    size_t full = 0;
+    size_t resumed = 0;
+    size_t failed = 0;
+};
+
+/**
+ * @brief <count> requests through the client <next> hands out for each of them
+ */
+template <class NextClient>
+static Run measure(size_t count, NextClient next) {
+    Run run;
+    auto start = clock_type::now();
+    for (size_t i = 0; i < count; i++) {
+        auto &client = next();
+        auto res = client.Get("/v1/ping");
+        if (!res || res->status != 200)
+            run.failed++;
+    }
+    run.msPerRequest = std::chrono::duration<double, std::milli>(clock_type::now() - start).count() / count;
+    return run;
+}
+
+static void print(const char *name, const Run &run) {
+    printf("%-42s %7.3f ms a request, %zu full and %zu resumed handshakes, %zu failed\n", name, run.msPerRequest,
+           run.full, run.resumed, run.failed);
+}
+
+int main(int argc, char **argv) {
+    size_t count = 200;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--requests=", 0) == 0 && std::stoul(arg.substr(11)) > 0) {
+            count = std::stoul(arg.substr(11));
+        } else {
+            fprintf(stderr, "usage: %s [--requests=<n>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::error_code error;
+    auto dir = std::filesystem::temp_directory_path(error) /
+               ("tls_resume_bench." + std::to_string(std::random_device()()));
+    std::filesystem::create_directories(dir, error);
+    auto certPath = (dir / "cert.pem").string(), keyPath = (dir / "key.pem").string();
+    if (!writeCertificate(certPath, keyPath)) {
+        fprintf(stderr, "Could not make a certificate\n");
+        return 2;
+    }
+
+    httplib::SSLServer server(certPath.c_str(), keyPath.c_str());
+    server.Get("/v1/ping", [](const httplib::Request &, httplib::Response &res) {
+        res.set_content(R"({"pong":true})", "application/json");
+    });
+    // the kept alive connection lasts the whole run, as it would between polls
+    server.set_keep_alive_max_count(count);
+    auto port = server.bind_to_any_port("127.0.0.1");
+    std::thread serverThread([&server]() { server.listen_after_bind(); });
+    while (!server.is_running())
+        std::this_thread::sleep_for(std::chrono::milliseconds(1));
+
+    // a new client every time, nothing to resume
+    std::unique_ptr<httplib::SSLClient> fresh;
+    size_t freshFull = 0, freshResumed = 0;
+    auto full = measure(count, [&]() -> httplib::SSLClient & {
+        if (fresh) {
+            freshFull += fresh->get_full_handshake_count();
+            freshResumed += fresh->get_resumed_handshake_count();
+        }
+        fresh.reset(new httplib::SSLClient("127.0.0.1", port, 3));
+        return *fresh;
+    });
+    full.full = freshFull + fresh->get_full_handshake_count();
+    full.resumed = freshResumed + fresh->get_resumed_handshake_count();
+
+    // one client, a connection per request: the session of the first is resumed
+    httplib::SSLClient reconnecting("127.0.0.1", port, 3);
+    auto resumed = measure(count, [&]() -> httplib::SSLClient & { return reconnecting; });
+    resumed.full = reconnecting.get_full_handshake_count();
+    resumed.resumed = reconnecting.get_resumed_handshake_count();
+
+    // one kept alive connection, as tidalApi() has
+    httplib::SSLClient keptAlive("127.0.0.1", port, 3);
+    keptAlive.set_keep_alive(true);
+    auto alive = measure(count, [&]() -> httplib::SSLClient & { return keptAlive; });
+    alive.full = keptAlive.get_full_handshake_count();
+    alive.resumed = keptAlive.get_resumed_handshake_count();
+
+    printf("%zu requests each, RSA 2048 certificate, %s\n", count, OpenSSL_version(OPENSSL_VERSION));
+    print("new client per request (full handshakes)", full);
+    print("reconnecting client (resumed sessions)", resumed);
+    print("kept alive connection", alive);
+    if (resumed.msPerRequest > 0)
+        printf("resuming is %.1fx as fast as a full handshake\n", full.msPerRequest / resumed.msPerRequest);
+
+    fresh.reset();
+    keptAlive.set_keep_alive(false);
+    server.stop();
+    serverThread.join();
+    std::filesystem::remove_all(dir, error);
+
+    int result = 0;
+    if (full.failed || resumed.failed || alive.failed)
+        result = 1;
+    // the session is only there once the first handshake gave it
+    if (full.full != count || resumed.full != 1 || resumed.resumed != count - 1 || alive.full != 1
+        || alive.resumed != 0)
+        result = 1;
+    return result;
+}
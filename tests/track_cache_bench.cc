@@ -0,0 +1,215 @@
+/**
+ * @file    track_cache_bench.cc
+ * @authors Stavros Avramidis
+ *
+ * Benchmark of the append-only <TrackCache> file and of warming it (--warm-cache):
+ *
+ *  track_cache_bench [--entries=<n>] [--tracks=<n>] [--latency=<ms>]
+ *
+ * Appends <n> entries (100k by default) from 1, 4 and 16 threads, every put flushed as in the
+ * app, reopens the file and cuts its last entry short the way a crash would. Then resolves
+ * <tracks> uncached tracks (400) through a <TrackResolver> and the cache against a mock api
+ * answering in <latency> ms (50), with 1 to 32 lookups at a time as --warm-parallelism does,
+ * and once more with all of them cached. Exits with 1 if an entry is lost or a track not found.
+ */
+
+// cpp libs
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <filesystem>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+// local libs
+#include "clock.hh"
+#include "mock_api.hh"
+#include "track_cache.hh"
+#include "track_resolver.hh"
+
+using clock_type = std::chrono::steady_clock;
+
+
+static double secondsSince(clock_type::time_point start) {
+    return std::chrono::duration<double>(clock_type::now() - start).count();
+}
+
+static TrackInfo info(unsigned id) {
+    TrackInfo info;
+    info.isFound = true;
+    info.id = id;
+    info.album = "Some album " + std::to_string(id / 12);
+    info.coverId = "d156d3e0-a5cd-4066-8c36-" + std::to_string(100000000 + id);
+    info.quality = id % 3 ? "LOSSLESS" : "HI_RES";
+    info.runtime = 180 + id % 100;
+    info.trackNumber = id % 20;
+    info.volumeNumber = 1;
+    return info;
+}
+
+/// @brief Runs <work>(i) for i in [0, <count>), <threads> at a time
+template <class Work>
+static void parallel(size_t count, int threads, Work work) {
+    std::atomic<size_t> next{0};
+    std::vector<std::thread> workers;
+    for (int i = 0; i < threads; i++)
+        workers.emplace_back([&]() {
+            for (size_t item; (item = next++) < count;)
+                work(item);
+        });
+    for (auto &worker : workers)
+        worker.join();
+}
+
+static bool hasAll(const TrackCache &cache, size_t count) {
+    TrackCache::Entry entry;
+    for (size_t i = 0; i < count; i++)
+        if (!cache.get("Track title number " + std::to_string(i), "Artist " + std::to_string(i % 5000), entry)
+            || entry.info.id != i + 1 || entry.info.coverId != info(i + 1).coverId)
+            return false;
+    return true;
+}
+
+static int appendLog(const std::filesystem::path &dir, size_t count) {
+    printf("%zu entries appended, every put flushed\n", count);
+    printf("%-8s %12s %12s %12s %14s %12s\n", "threads", "puts/s", "us a put", "file bytes", "bytes an entry",
+           "reopen ms");
+    int result = 0;
+    for (int threads : {1, 4, 16}) {
+        auto path = dir / ("append" + std::to_string(threads)) / "tracks.cache";
+        auto start = clock_type::now();
+        {
+            TrackCache cache;
+            if (!cache.open(path.string())) {
+                fprintf(stderr, "Could not create %s\n", path.string().c_str());
+                return 2;
+            }
+            start = clock_type::now();
+            parallel(count, threads, [&cache](size_t i) {
+                cache.put("Track title number " + std::to_string(i), "Artist " + std::to_string(i % 5000),
+                          info(static_cast<unsigned>(i + 1)), 1700000000 + static_cast<int64_t>(i));
+            });
+        }
+        auto seconds = secondsSince(start);
+        auto size = std::filesystem::file_size(path);
+
+        TrackCache reopened;
+        start = clock_type::now();
+        reopened.open(path.string());
+        auto reopenMs = secondsSince(start) * 1e3;
+        printf("%-8d %12.0f %12.2f %12ju %14.1f %12.1f\n", threads, count / seconds, seconds * 1e6 / count,
+               static_cast<uintmax_t>(size), static_cast<double>(size) / count, reopenMs);
+        if (reopened.size() != count || !hasAll(reopened, count)) {
+            printf("entries lost appending from %d threads\n", threads);
+            result = 1;
+        }
+    }
+
+    // a crash while appending the last entry: only that one is lost, the next one is appended
+    // behind the one before
+    auto path = dir / "append1" / "tracks.cache";
+    std::filesystem::resize_file(path, std::filesystem::file_size(path) - 3);
+    {
+        TrackCache torn;
+        torn.open(path.string());
+        if (torn.size() != count - 1 || !hasAll(torn, count - 1)) {
+            printf("a torn last entry lost more than itself\n");
+            result = 1;
+        }
+        auto last = count - 1;
+        torn.put("Track title number " + std::to_string(last), "Artist " + std::to_string(last % 5000),
+                 info(static_cast<unsigned>(last + 1)), 1700000000);
+    }
+    TrackCache repaired;
+    repaired.open(path.string());
+    if (repaired.size() != count || !hasAll(repaired, count)) {
+        printf("the entry appended after a torn one was lost\n");
+        result = 1;
+    }
+    return result;
+}
+
+static int warm(const std::filesystem::path &dir, size_t count, std::chrono::milliseconds latency) {
+    MockApi api;
+    std::vector<MockTrack> tracks;
+    for (unsigned i = 0; i < count; i++) {
+        tracks.push_back({i + 1, "Warm track " + std::to_string(i), "Artist " + std::to_string(i % 50)});
+        api.add(tracks.back());
+    }
+    auto mock = api.query();
+    ApiQuery slow = [&mock, latency](const std::string &path, const httplib::Headers &headers) {
+        std::this_thread::sleep_for(latency);
+        return mock(path, headers);
+    };
+
+    printf("\n%zu uncached tracks warmed, the api answering in %lld ms\n", count,
+           static_cast<long long>(latency.count()));
+    printf("%-12s %12s %12s %12s\n", "at a time", "tracks/s", "api queries", "cached");
+    SystemClock clock;
+    int result = 0;
+    for (int parallelism : {1, 4, 16, 32}) {
+        TrackCache cache;
+        cache.open((dir / ("warm" + std::to_string(parallelism)) / "tracks.cache").string());
+        std::atomic<size_t> found{0};
+        uint64_t queries;
+        auto start = clock_type::now();
+        {
+            TrackResolver resolver(slow, clock, "US", &cache);
+            resolver.setParallelism(1);
+            parallel(count, parallelism, [&](size_t i) {
+                if (resolver.resolve(tracks[i].title, tracks[i].artist).isFound)
+                    found++;
+            });
+            queries = resolver.upstreamCalls();
+        }
+        auto seconds = secondsSince(start);
+        printf("%-12d %12.1f %12llu %12zu\n", parallelism, count / seconds, static_cast<unsigned long long>(queries),
+               cache.size());
+        if (found != count || cache.size() != count) {
+            printf("%zu of %zu tracks found\n", found.load(), count);
+            result = 1;
+        }
+
+        if (parallelism == 32) {
+            // warming again finds everything in the cache
+            TrackResolver resolver(slow, clock, "US", &cache);
+            start = clock_type::now();
+            parallel(count, parallelism, [&](size_t i) { resolver.resolve(tracks[i].title, tracks[i].artist); });
+            printf("%-12s %12.0f %12llu %12zu\n", "32, cached", count / secondsSince(start),
+                   static_cast<unsigned long long>(resolver.upstreamCalls()), cache.size());
+            if (resolver.upstreamCalls() != 0)
+                result = 1;
+        }
+    }
+    return result;
+}
+
+int main(int argc, char **argv) {
+    size_t entries = 100000, tracks = 400;
+    long latency = 50;
+    for (int i = 1; i < argc; i++) {
+        std::string arg(argv[i]);
+        if (arg.rfind("--entries=", 0) == 0 && std::stoul(arg.substr(10)) > 1) {
+            entries = std::stoul(arg.substr(10));
+        } else if (arg.rfind("--tracks=", 0) == 0 && std::stoul(arg.substr(9)) > 0) {
+            tracks = std::stoul(arg.substr(9));
+        } else if (arg.rfind("--latency=", 0) == 0) {
+            latency = std::stol(arg.substr(10));
+        } else {
+            fprintf(stderr, "usage: %s [--entries=<n>] [--tracks=<n>] [--latency=<ms>]\n", argv[0]);
+            return 2;
+        }
+    }
+
+    std::error_code error;
+    auto dir = std::filesystem::temp_directory_path(error) /
+               ("track_cache_bench." + std::to_string(std::random_device()()));
+    auto result = appendLog(dir, entries);
+    if (result != 2)
+        result |= warm(dir, tracks, std::chrono::milliseconds(latency));
+
+    std::filesystem::remove_all(dir, error);
+    Logger::instance().flush();
+    return result;
+}
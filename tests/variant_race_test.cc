@@ -0,0 +1,99 @@
+/**
+ * @file    variant_race_test.cc
+ * @authors Stavros Avramidis
+ *
+ * Resolves a corpus of tricky window titles (versions after a dash, dashes in titles and artists,
+ * duos with "&") through a <TrackResolver> against a mock of the api that answers in random
+ * order. Whatever order the searches finish in and however many run at once, every title has to
+ * resolve to the track searching the variants one by one finds.
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <map>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+// local libs
+#include "checks.hh"
+#include "clock.hh"
+#include "mock_api.hh"
+#include "track_resolver.hh"
+
+using namespace std::chrono_literals;
+
+
+struct Case {
+    std::string title;
+    std::string artist;
+    unsigned expected;
+};
+
+int main() {
+    MockApi api;
+    // searches answered late, so that a later variant is done before them
+    std::map<std::string, std::chrono::milliseconds> slow;
+
+    std::vector<Case> corpus;
+    // the player's own reading and the version split are both confident, the player's wins
+    api.answer("Song - Part 2 - Band", {{1, "Song - Part 2", "Band"}});
+    api.answer("Song - Band", {{2, "Song", "Band", 200, "LOSSLESS", "Album", "2020-01-01", "Part 2"}});
+    slow[TrackResolver::normalize("Song - Part 2 - Band")] = 30ms;
+    corpus.push_back({"Song - Part 2", "Band", 1});
+
+    // only the version split finds it
+    api.answer("Song - Artist", {{4, "Song", "Artist", 200, "HI_RES"},
+                                 {3, "Song", "Artist", 200, "LOSSLESS", "Album", "2011-01-01", "2011 Remaster"}});
+    corpus.push_back({"Song - 2011 Remaster", "Artist", 3});
+
+    // the search for the first artist of "A & B" finds someone else's, the whole duo's theirs
+    api.answer("The Boxer - Simon", {{5, "The Boxer", "Paul Simon"}});
+    api.answer("The Boxer - Simon & Garfunkel", {{6, "The Boxer", "Simon & Garfunkel"}});
+    slow[TrackResolver::normalize("The Boxer - Simon & Garfunkel")] = 30ms;
+    corpus.push_back({"The Boxer", "Simon & Garfunkel", 6});
+
+    // nothing confident: the earliest of the matches, even if it is the last one done
+    api.answer("Intro - Outro - Nobody", {{8, "Intro - Outro", "Somebody"}});
+    api.answer("Intro - Nobody", {{9, "Intro", "Anybody", 200, "LOSSLESS", "Album", "2020-01-01", "Outro"}});
+    slow[TrackResolver::normalize("Intro - Outro - Nobody")] = 30ms;
+    corpus.push_back({"Intro - Outro", "Nobody", 8});
+
+    // a dash in the artist
+    api.answer("Track - Jay - Z", {{10, "Track", "Jay - Z"}, {11, "Track - Jay", "Z"}});
+    corpus.push_back({"Track", "Jay - Z", 10});
+
+    auto mock = api.query();
+    ApiQuery query = [&](const std::string &path, const httplib::Headers &headers) {
+        static thread_local std::mt19937 random(std::random_device{}());
+        auto it = slow.find(TrackResolver::normalize(queryParam(path, "query")));
+        std::this_thread::sleep_for(std::chrono::milliseconds(random() % 10) +
+                                    (it == slow.end() ? 0ms : it->second));
+        return mock(path, headers);
+    };
+
+    SystemClock clock;
+    for (size_t parallelism : {1, 2, 4}) {
+        size_t same = 0, total = 0;
+        for (int round = 0; round < 8; round++) {
+            for (auto &item : corpus) {
+                TrackResolver resolver(query, clock);
+                resolver.setParallelism(parallelism);
+                auto info = resolver.resolve(item.title, item.artist);
+                total++;
+                if (info.isFound && info.id == item.expected) {
+                    same++;
+                } else {
+                    fprintf(stderr, "%s - %s, %zu at a time: got %u, expected %u\n", item.title.c_str(),
+                            item.artist.c_str(), parallelism, info.id, item.expected);
+                }
+            }
+        }
+        printf("%zu at a time: %zu/%zu resolved as one by one\n", parallelism, same, total);
+        CHECK(same == total);
+    }
+
+    Logger::instance().flush();
+    return checkResult();
+}
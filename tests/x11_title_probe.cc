@@ -0,0 +1,87 @@
+/**
+ * @file    x11_title_probe.cc
+ * @authors Stavros Avramidis
+ *
+ * Helper of x11_title_test.sh, runs on the X display in $DISPLAY:
+ *
+ *  x11_title_probe window <class>  maps a window of WM_CLASS <class> titled "TIDAL", prints its id
+ *                                  and keeps it until killed
+ *  x11_title_probe watch <seconds> prints what tidalInfo() reads, "<status>|<title>|<artist>",
+ *                                  at the start and on every change, with a tidal-hifi window of
+ *                                  its own mapped that it must not see
+ */
+
+// cpp libs
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <thread>
+// local libs
+#include "linux_api_hook.hh"
+
+
+/// @brief Maps a window of WM_CLASS <className> and _NET_WM_PID of this process
+static Window map(Display *display, const char *className) {
+    auto window = XCreateSimpleWindow(display, DefaultRootWindow(display), 0, 0, 320, 240, 0, 0, 0);
+    XClassHint hint;
+    hint.res_name = const_cast<char *>(className);
+    hint.res_class = const_cast<char *>(className);
+    XSetClassHint(display, window, &hint);
+    XStoreName(display, window, "TIDAL");
+    long pid = getpid();
+    XChangeProperty(display, window, XInternAtom(display, "_NET_WM_PID", False), XA_CARDINAL, 32, PropModeReplace,
+                    reinterpret_cast<unsigned char *>(&pid), 1);
+    XMapWindow(display, window);
+    XSync(display, False);
+    return window;
+}
+
+static int window(const char *className) {
+    auto display = XOpenDisplay(nullptr);
+    if (!display)
+        return 1;
+
+    auto window = map(display, className);
+    printf("0x%lx\n", window);
+    fflush(stdout);
+    for (;;) {
+        XEvent event;
+        XNextEvent(display, &event);
+    }
+}
+
+static int watch(int seconds) {
+    static const char *names[] = {"error", "closed", "opened", "playing"};
+    auto display = XOpenDisplay(nullptr);
+    if (!display)
+        return 1;
+    XStoreName(display, map(display, "tidal-hifi"), "Own Song - Own Artist");
+    XSync(display, False);
+
+    auto end = std::chrono::steady_clock::now() + std::chrono::seconds(seconds);
+
+    std::string last;
+    while (std::chrono::steady_clock::now() < end) {
+        std::wstring song, artist;
+        auto state = tidalInfo(song, artist);
+        auto line = std::string(names[state]) + "|" + rawWstringToString(song) + "|" + rawWstringToString(artist);
+        if (line != last) {
+            printf("%s\n", line.c_str());
+            fflush(stdout);
+            last = line;
+        }
+        std::this_thread::sleep_for(std::chrono::milliseconds(20));
+    }
+    return 0;
+}
+
+int main(int argc, char **argv) {
+    std::string mode = argc == 3 ? argv[1] : "";
+    if (mode == "window")
+        return window(argv[2]);
+    if (mode == "watch")
+        return watch(std::stoi(argv[2]));
+
+    fprintf(stderr, "usage: %s window <class> | watch <seconds>\n", argv[0]);
+    return 2;
+}
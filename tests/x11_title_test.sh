@@ -0,0 +1,83 @@
+#!/bin/sh
+# The linux window title hook under Xvfb: a dummy TIDAL window appears, gets its title changed
+# by xdotool (or xprop) and disappears, and what the hook read is compared with what was set.
+# A window whose class merely contains the player's and one of the watching process itself are
+# never seen.
+#
+#   x11_title_test.sh <path to x11_title_probe>
+#
+# Exits with 77, skipped for ctest, if Xvfb or both xdotool and xprop are missing.
+set -u
+
+probe=$1
+
+command -v Xvfb >/dev/null 2>&1 || { echo "Xvfb not found, skipped"; exit 77; }
+if command -v xdotool >/dev/null 2>&1; then
+    set_title() { xdotool set_window --name "$2" "$1"; }
+elif command -v xprop >/dev/null 2>&1; then
+    set_title() { xprop -id "$1" -f _NET_WM_NAME 8u -set _NET_WM_NAME "$2"; }
+else
+    echo "Neither xdotool nor xprop found, skipped"
+    exit 77
+fi
+
+work=$(mktemp -d)
+xvfb= watch= window= lookalike=
+trap 'kill $window $lookalike $watch $xvfb 2>/dev/null; rm -rf "$work"' EXIT
+
+# waits up to 5 s for <file> to have something in it
+wait_for() {
+    for _ in $(seq 50); do
+        [ -s "$1" ] && return 0
+        sleep 0.1
+    done
+    echo "Timed out waiting for $1"
+    exit 1
+}
+
+# a free display, written to fd 3 once the server is ready
+Xvfb -displayfd 3 -nolisten tcp 3>"$work/display" >/dev/null 2>&1 &
+xvfb=$!
+wait_for "$work/display"
+DISPLAY=:$(cat "$work/display")
+export DISPLAY
+
+"$probe" watch 4 >"$work/seen" &
+watch=$!
+wait_for "$work/seen"
+
+"$probe" window tidal-hifi-rpc >"$work/lookalike" &
+lookalike=$!
+wait_for "$work/lookalike"
+sleep 0.3
+
+"$probe" window tidal-hifi >"$work/window" &
+window=$!
+wait_for "$work/window"
+id=$(cat "$work/window")
+
+sleep 0.3
+set_title "$id" "First Song - First Artist"
+sleep 0.3
+set_title "$id" "Second Song - Second Artist"
+sleep 0.3
+kill $window
+window=
+wait $watch
+watch=
+
+expected="closed||
+opened||
+playing|First Song|First Artist
+playing|Second Song|Second Artist
+closed||"
+
+if [ "$(cat "$work/seen")" = "$expected" ]; then
+    echo "PASS"
+    exit 0
+fi
+echo "Expected:"
+echo "$expected"
+echo "Got:"
+cat "$work/seen"
+exit 1
@@ -0,0 +1,297 @@
+/**
+ * @file    track_cache.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <cstdint>
+#include <cstdlib>
+#include <cstring>
+#include <filesystem>
+#include <fstream>
+#include <mutex>
+#include <string>
+#include <unordered_map>
+#include <vector>
+// local libs
+#include "cache_snapshot.hh"
+#include "journal.hh"
+#include "logger.hh"
+
+
+/**
+ * @brief What the api knows about a track, as much of it as was found
+ */
+struct TrackInfo {
+    bool isFound = false;
+    unsigned id = 0;
+    std::string album;
+    std::string coverId;
+    std::string quality;  ///< audioQuality of the api, e.g. "HI_RES"
+    int64_t runtime = 0;
+    uint_fast8_t trackNumber = 0;
+    uint_fast8_t volumeNumber = 0;
+};
+
+
+/**
+ * @brief Resolved tracks by title and artist, kept across runs in an append only file.
+ *
+ * File layout, integers are LEB128 varints like in the journal:
+ *   "TRPCCACH" version
+ *   per entry: (length bytes) of title, artist, album, coverId, quality, etag,
+ *              id runtime trackNumber volumeNumber resolvedAt
+ * A refreshed entry is appended again, the last one of a track wins. A truncated last entry
+ * (crash while appending) is ignored, files of version 1 (no etag) are rewritten on open. Under
+ * the entries of the file lies the imported <CacheSnapshot>, if any, kept next to it. Safe to
+ * share between threads.
+ */
+class TrackCache {
+  public:
+    struct Entry {
+        TrackInfo info;
+        int64_t resolvedAt;  ///< unix time of the last lookup or revalidation
+        std::string etag;    ///< validator of the last by-id response, if the api sent one
+    };
+
+    /**
+     * @brief Per user cache directory of the platform
+     */
+    static std::string defaultPath() {
+        std::string dir;
+#ifdef _WIN32
+        if (auto appData = std::getenv("LOCALAPPDATA"))
+            dir = std::string(appData) + "\\tidal-rpc";
+#elif defined(__APPLE__)
+        if (auto home = std::getenv("HOME"))
+            dir = std::string(home) + "/Library/Caches/tidal-rpc";
+#else
+        if (auto cacheHome = std::getenv("XDG_CACHE_HOME"))
+            dir = std::string(cacheHome) + "/tidal-rpc";
+        else if (auto home = std::getenv("HOME"))
+            dir = std::string(home) + "/.cache/tidal-rpc";
+#endif
+        return dir.empty() ? "tracks.cache" : (std::filesystem::path(dir) / "tracks.cache").string();
+    }
+
+    /**
+     * @brief Loads the entries of <path> and appends new ones to it
+     * @return false if <path> could not be created
+     */
+    bool open(const std::string &path) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::error_code error;
+        auto dir = std::filesystem::path(path).parent_path();
+        if (!dir.empty())
+            std::filesystem::create_directories(dir, error);
+
+        std::streamoff validSize = 0;
+        uint64_t version = 0;
+        std::ifstream in(path, std::ios::binary);
+        if (in && readHeader(in, version)) {
+            Entry entry;
+            std::string title, artist;
+            validSize = in.tellg();
+            while (readEntry(in, version, title, artist, entry)) {
+                entries_[key(title, artist)] = entry;
+                validSize = in.tellg();
+            }
+        }
+        in.close();
+
+        snapshotPath_ = std::filesystem::path(path).replace_extension(".snapshot").string();
+        std::string snapshotError;
+        if (std::filesystem::exists(snapshotPath_, error) && !snapshot_.open(snapshotPath_, snapshotError))
+            LOG_WARNING("Ignoring the cache snapshot ", snapshotPath_, ": ", snapshotError);
+
+        if (validSize == 0 || version != FORMAT_VERSION) {
+            out_.open(path, std::ios::binary | std::ios::trunc);
+            std::string header(MAGIC, sizeof(MAGIC));
+            journal_detail::putVarint(header, FORMAT_VERSION);
+            out_.write(header.data(), header.size());
+            for (auto &entry : entries_) {
+                auto separator = entry.first.find('\x1f');
+                append(entry.first.substr(0, separator), entry.first.substr(separator + 1), entry.second);
+            }
+        } else {
+            // drops a torn entry, so new ones don't end up behind it
+            std::filesystem::resize_file(path, validSize, error);
+            out_.open(path, std::ios::binary | std::ios::app);
+        }
+        out_.flush();
+        return static_cast<bool>(out_);
+    }
+
+    bool get(const std::string &title, const std::string &artist, Entry &entry) const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        auto it = entries_.find(key(title, artist));
+        if (it != entries_.end()) {
+            entry = it->second;
+            return true;
+        }
+
+        CacheSnapshot::Track track;
+        if (!snapshot_.isOpen() || !snapshot_.find(title, artist, track))
+            return false;
+        entry.info.isFound = true;
+        entry.info.id = track.id;
+        entry.info.album = std::move(track.album);
+        entry.info.coverId = std::move(track.coverId);
+        entry.info.quality = std::move(track.quality);
+        entry.info.runtime = track.runtime;
+        entry.info.trackNumber = track.trackNumber;
+        entry.info.volumeNumber = track.volumeNumber;
+        entry.resolvedAt = track.resolvedAt;
+        entry.etag.clear();
+        return true;
+    }
+
+    /// @brief Adds the entry, or replaces the one there is, and appends it to the file
+    void put(const std::string &title, const std::string &artist, const TrackInfo &info, int64_t resolvedAt,
+             const std::string &etag = {}) {
+        std::lock_guard<std::mutex> lock(mutex_);
+        Entry entry{info, resolvedAt, etag};
+        append(title, artist, entry);
+        entries_[key(title, artist)] = std::move(entry);
+        out_.flush();
+    }
+
+    /// @brief Entries, counting those the file and the snapshot both have twice
+    size_t size() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        return entries_.size() + snapshot_.size();
+    }
+
+    /**
+     * @brief Everything cached, snapshot included, entries of the file winning over the snapshot
+     */
+    std::vector<CacheSnapshot::Track> tracks() const {
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::vector<CacheSnapshot::Track> tracks;
+        tracks.reserve(entries_.size() + snapshot_.size());
+
+        for (size_t i = 0; i < snapshot_.size(); i++) {
+            tracks.emplace_back();
+            snapshot_.at(i, tracks.back());
+            if (entries_.count(key(tracks.back().title, tracks.back().artist)))
+                tracks.pop_back();
+        }
+        for (auto &entry : entries_) {
+            auto separator = entry.first.find('\x1f');
+            auto &info = entry.second.info;
+            tracks.push_back({entry.first.substr(0, separator), entry.first.substr(separator + 1), info.album,
+                              info.coverId, info.quality, info.id, info.runtime,
+                              static_cast<uint8_t>(info.trackNumber), static_cast<uint8_t>(info.volumeNumber),
+                              entry.second.resolvedAt});
+        }
+        return tracks;
+    }
+
+    /**
+     * @brief Writes everything cached, snapshot included, as a snapshot to <path>
+     */
+    bool exportSnapshot(const std::string &path) const { return CacheSnapshot::write(path, tracks()); }
+
+    /**
+     * @brief Installs the snapshot at <path> next to the cache file, replacing the one before
+     * @return false with the reason in <error> if it isn't a valid snapshot or can't be installed
+     */
+    bool importSnapshot(const std::string &path, std::string &error) {
+        CacheSnapshot check;
+        if (!check.open(path, error))
+            return false;
+        check.close();
+
+        std::lock_guard<std::mutex> lock(mutex_);
+        std::error_code fsError;
+        auto partial = snapshotPath_ + ".partial";
+        if (!std::filesystem::copy_file(path, partial, std::filesystem::copy_options::overwrite_existing, fsError)) {
+            error = fsError.message();
+            return false;
+        }
+
+        // windows can't replace a mapped file
+        snapshot_.close();
+        std::filesystem::rename(partial, snapshotPath_, fsError);
+        if (fsError) {
+            error = fsError.message();
+            std::filesystem::remove(partial, fsError);
+        }
+        // after a failed rename that's the snapshot from before, if there was one
+        std::string reopenError;
+        if (!snapshot_.open(snapshotPath_, reopenError) && error.empty())
+            error = reopenError;
+        return error.empty();
+    }
+
+  private:
+    static constexpr char MAGIC[8] = {'T', 'R', 'P', 'C', 'C', 'A', 'C', 'H'};
+    static const uint64_t FORMAT_VERSION = 2;
+    static const uint64_t MAX_STRING = 4096;
+
+    static std::string key(const std::string &title, const std::string &artist) {
+        // unit separator, can't show up in either
+        return title + '\x1f' + artist;
+    }
+
+    static bool readHeader(std::istream &in, uint64_t &version) {
+        char magic[sizeof(MAGIC)];
+        return in.read(magic, sizeof(magic)) && memcmp(magic, MAGIC, sizeof(magic)) == 0
+               && journal_detail::getVarint(in, version) && version >= 1 && version <= FORMAT_VERSION;
+    }
+
+    static bool readEntry(std::istream &in, uint64_t version, std::string &title, std::string &artist,
+                          Entry &entry) {
+        auto &info = entry.info;
+        entry.etag.clear();
+        for (auto str : {&title, &artist, &info.album, &info.coverId, &info.quality, &entry.etag}) {
+            // version 1 had no etag
+            if (str == &entry.etag && version == 1)
+                break;
+            uint64_t size;
+            if (!journal_detail::getVarint(in, size) || size > MAX_STRING)
+                return false;
+            str->resize(size);
+            if (size && !in.read(&(*str)[0], size))
+                return false;
+        }
+
+        uint64_t numbers[5];
+        for (auto &number : numbers)
+            if (!journal_detail::getVarint(in, number))
+                return false;
+        info.isFound = true;
+        info.id = static_cast<unsigned>(numbers[0]);
+        info.runtime = static_cast<int64_t>(numbers[1]);
+        info.trackNumber = static_cast<uint_fast8_t>(numbers[2]);
+        info.volumeNumber = static_cast<uint_fast8_t>(numbers[3]);
+        entry.resolvedAt = static_cast<int64_t>(numbers[4]);
+        return true;
+    }
+
+    /// @brief Called with <mutex_> held, the caller flushes
+    void append(const std::string &title, const std::string &artist, const Entry &entry) {
+        if (!out_.is_open())
+            return;
+        auto &info = entry.info;
+        std::string buffer;
+        for (auto str : {&title, &artist, &info.album, &info.coverId, &info.quality, &entry.etag}) {
+            journal_detail::putVarint(buffer, str->size());
+            buffer += *str;
+        }
+        for (uint64_t number : {static_cast<uint64_t>(info.id), static_cast<uint64_t>(info.runtime),
+                                static_cast<uint64_t>(info.trackNumber), static_cast<uint64_t>(info.volumeNumber),
+                                static_cast<uint64_t>(entry.resolvedAt)})
+            journal_detail::putVarint(buffer, number);
+        out_.write(buffer.data(), buffer.size());
+    }
+
+    mutable std::mutex mutex_;
+    std::unordered_map<std::string, Entry> entries_;
+    std::ofstream out_;
+    CacheSnapshot snapshot_;
+    std::string snapshotPath_;
+};
@@ -0,0 +1,534 @@
+/**
+ * @file    track_resolver.hh
+ * @authors Stavros Avramidis
+ */
+
+
+#pragma once
+
+// cpp libs
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <condition_variable>
+#include <cstdint>
+#include <cstdio>
+#include <functional>
+#include <future>
+#include <iomanip>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <set>
+#include <sstream>
+#include <string>
+#include <vector>
+// local libs
+#include "clock.hh"
+#include "httplib.hh"
+#include "json.hh"
+#include "logger.hh"
+#include "seed_index.hh"
+#include "single_flight.hh"
+#include "track_cache.hh"
+
+
+/// GET <path> with some extra request <headers>
+using ApiQuery =
+    std::function<std::shared_ptr<httplib::Response>(const std::string &path, const httplib::Headers &headers)>;
+
+
+inline std::string urlEncode(const std::string &value) {
+    std::ostringstream escaped;
+    escaped.fill('0');
+    escaped << std::hex;
+
+    for (std::string::value_type c : value) {
+        if (isalnum((unsigned char) c) || c == '-' || c == '_' || c == '.' || c == '~')
+            escaped << c;
+        else {
+            escaped << std::uppercase;
+            escaped << '%' << std::setw(2) << int((unsigned char) c);
+            escaped << std::nouppercase;
+        }
+    }
+    return escaped.str();
+}
+
+
+/**
+ * @brief Looks tracks up on the TIDAL api, shared by everything that needs track metadata.
+ *
+ * Searches go through a <SingleFlight> keyed by the normalized query: lookups of the same track
+ * while one is in flight, or shortly after (titles flicker during track transitions), share its
+ * request and parsed response. Matching the response against the exact title is per caller.
+ * With a <TrackCache> tracks resolved before aren't searched for again, a <SeedIndex> answers
+ * for the tracks it was built with. When the track id is known already a single track is looked
+ * up by it (/v1/tracks/{id}) instead of searching through 50, the search is only the fallback.
+ *
+ * The player's "title - artist" is ambiguous: the title may go on with " - Live" or
+ * " - 2011 Remaster", the artist be a duo with an '&'. With <setParallelism> the plausible
+ * readings are searched for concurrently, the first match whose artist agrees wins and the rest
+ * are left to finish unheard. Off by default, a journal replays one search per track.
+ *
+ * Cached tracks older than <SOFT_TTL> are still answered from the cache right away, while a
+ * by-id request (conditional, if the api gave an etag before) refreshes them in the background.
+ * Past <HARD_TTL> they are looked up again by id, the stale entry is only used if that fails.
+ */
+class TrackResolver {
+  public:
+    /// identical searches within this long of each other share one request
+    static constexpr std::chrono::milliseconds LINGER{5000};
+    /// cached tracks are revalidated once they are this old
+    static constexpr std::chrono::seconds SOFT_TTL{3 * 24 * 3600};
+    /// and not shown anymore without a new lookup once they are this old
+    static constexpr std::chrono::seconds HARD_TTL{90 * 24 * 3600};
+    /// most readings of an ambiguous "title - artist" searched for
+    static const size_t MAX_VARIANTS = 4;
+
+    TrackResolver(ApiQuery query, const Clock &clock, std::string countryCode = "US", TrackCache *cache = nullptr,
+                  const SeedIndex *seeds = nullptr)
+        : query_(std::move(query)), clock_(clock), countryCode_(std::move(countryCode)), cache_(cache),
+          seeds_(seeds) {}
+
+    TrackResolver(const TrackResolver &) = delete;
+    TrackResolver &operator=(const TrackResolver &) = delete;
+
+    /// @brief Waits for the requests still running in the background
+    ~TrackResolver() {
+        std::list<std::future<void>> background;
+        {
+            // they may take the lock once done
+            std::lock_guard<std::mutex> lock(backgroundMutex_);
+            background.swap(background_);
+        }
+        for (auto &work : background)
+            work.wait();
+    }
+
+    /**
+     * @brief Searches for up to <MAX_VARIANTS> readings of a track, <parallelism> at a time, 0
+     * for only the one the player gave. <ApiQuery> has to take that many queries at once.
+     */
+    void setParallelism(size_t parallelism) { parallelism_ = parallelism; }
+
+    /**
+     * @param id TIDAL id of the track if the player tells, 0 if not
+     */
+    TrackInfo resolve(const std::string &title, const std::string &artist, unsigned id = 0) {
+        TrackCache::Entry cached;
+        bool isCached = cache_ && cache_->get(title, artist, cached);
+        if (isCached) {
+            auto age = std::chrono::seconds(clock_.unixTime() - cached.resolvedAt);
+            if (age < SOFT_TTL)
+                return cached.info;
+            if (age < HARD_TTL) {
+                revalidate(title, artist, cached);
+                return cached.info;
+            }
+            if (!id)
+                id = cached.info.id;
+        }
+
+        // not copied into the cache, the index is there on the next run as well
+        if (auto record = seeds_ ? seeds_->find(title, artist) : nullptr) {
+            TrackInfo info;
+            info.isFound = true;
+            info.id = record->id;
+            info.album = std::string(seeds_->album(*record));
+            info.coverId = std::string(seeds_->coverId(*record));
+            info.quality = std::string(seeds_->quality(*record));
+            info.runtime = record->runtime;
+            info.trackNumber = record->trackNumber;
+            info.volumeNumber = record->volumeNumber;
+            return info;
+        }
+
+        TrackInfo info;
+        if (id && lookup(id, info)) {
+            if (cache_)
+                cache_->put(title, artist, info, clock_.unixTime());
+            return info;
+        }
+
+        auto variants = splits(title, artist);
+        if (parallelism_ == 0)
+            variants.resize(1);
+        info = race(std::move(variants));
+        if (!info.isFound)
+            return isCached ? cached.info : info;
+
+        if (cache_)
+            cache_->put(title, artist, info, clock_.unixTime());
+        return info;
+    }
+
+    /// @brief Searches and by-id lookups actually sent to the api
+    uint64_t upstreamCalls() const { return searches_.calls() + tracks_.calls(); }
+
+    /// @brief Lookups answered by a request some other lookup sent
+    uint64_t coalesced() const { return searches_.shared() + tracks_.shared(); }
+
+    /// @brief Background revalidations of cached tracks, and those the api answered 304 to
+    uint64_t revalidations() const { return revalidations_; }
+
+    uint64_t notModified() const { return notModified_; }
+
+    /**
+     * @brief Lower case ascii, whitespace trimmed and collapsed, so trivially different spellings
+     * of a search share a request
+     */
+    static std::string normalize(const std::string &query) {
+        std::string normalized(query.size(), '\0');
+        normalized.resize(SeedIndex::normalize(query, &normalized[0], normalized.size()));
+        return normalized;
+    }
+
+    /// @brief One reading of what the player showed
+    struct Variant {
+        std::string title;    ///< matched against the titles of the results
+        std::string version;  ///< and their versions, e.g. "Live"
+        std::string artist;   ///< matched against their artists
+        std::string search;   ///< normalized query
+    };
+
+    /**
+     * @brief Readings of <title> by <artist>, the player's own first. Readings that only differ
+     * in how the results are matched share the search.
+     */
+    static std::vector<Variant> splits(const std::string &title, const std::string &artist) {
+        std::vector<Variant> variants;
+        auto add = [&variants](const std::string &title, const std::string &version, const std::string &artist,
+                               bool isArtistCut) {
+            if (title.empty() || artist.empty() || variants.size() == MAX_VARIANTS)
+                return;
+            auto search = normalize(title + " - " + (isArtistCut ? artist.substr(0, artist.find('&')) : artist));
+            for (auto &variant : variants)
+                if (variant.search == search && variant.title == title && variant.version == version)
+                    return;
+            variants.push_back({title, version, artist, search});
+        };
+
+        add(title, "", artist, true);
+        // "Simon & Garfunkel" is one artist, not the first of several
+        if (artist.find('&') != std::string::npos)
+            add(title, "", artist, false);
+        // the other places the window title could be split at
+        auto whole = title + " - " + artist;
+        for (auto dash = whole.find(" - "); dash != std::string::npos; dash = whole.find(" - ", dash + 3))
+            add(whole.substr(0, dash), "", whole.substr(dash + 3), true);
+        // "Song - 2011 Remaster" is titled "Song" on the api, the rest is its version
+        auto dash = title.find(" - ");
+        if (dash != std::string::npos)
+            add(title.substr(0, dash), title.substr(dash + 3), artist, true);
+        return variants;
+    }
+
+  private:
+    using Response = std::shared_ptr<const nlohmann::json>;
+
+    Response fetch(const std::string &path) {
+        LOG_INFO("Querying :", path);
+        auto res = query_(path, {});
+        if (!res || res->status != 200) {
+            LOG_WARNING("Did not get results");
+            return nullptr;
+        }
+
+        auto json = nlohmann::json::parse(res->body, nullptr, false);
+        if (json.is_discarded()) {
+            LOG_WARNING("Did not get results");
+            return nullptr;
+        }
+        return std::make_shared<const nlohmann::json>(std::move(json));
+    }
+
+    /// @brief The track with <id> into <info>, false if the api doesn't know it or can't be reached
+    bool lookup(unsigned id, TrackInfo &info) {
+        auto response = tracks_.run(std::to_string(id), clock_.now(), [this, id]() {
+            char path[128];
+            snprintf(path, sizeof(path), "/v1/tracks/%u?countryCode=%s", id, countryCode_.c_str());
+            return fetch(path);
+        });
+        if (!response)
+            return false;
+
+        try {
+            trackFields(*response, info);
+            info.coverId = response->at("album").at("cover").get<std::string>();
+            info.album = response->at("album").at("title").get<std::string>();
+        } catch (...) {
+            LOG_ERROR("Error getting info from api for track ", id);
+            info = TrackInfo();
+            return false;
+        }
+        info.isFound = true;
+        return true;
+    }
+
+    /// @brief Match of one <Variant>, better the higher the score
+    struct Candidate {
+        TrackInfo info;
+        int score = 0;  ///< 0 nothing found, 1 found, 2 found and the artist agrees
+        size_t variant = 0;
+    };
+
+    /**
+     * @brief Searches for the <variants>, <parallelism_> at a time, until one is a confident
+     * match and all before it are done, or all are done
+     * @return The first confident match, else the earliest of the best ones: the same whatever
+     * order the searches finish in
+     */
+    TrackInfo race(std::vector<Variant> variants) {
+        if (variants.size() == 1)
+            return attempt(variants[0], 0).info;
+
+        struct Race {
+            std::vector<Variant> variants;
+            std::atomic<size_t> next{0};
+            std::mutex mutex;
+            std::condition_variable finished;
+            std::vector<Candidate> results;
+            std::vector<bool> isDone;
+            size_t confident;  ///< the earliest variant found with a score of 2, or the count
+        };
+        auto state = std::make_shared<Race>();
+        state->variants = std::move(variants);
+        auto count = state->variants.size();
+        state->results.resize(count);
+        state->isDone.resize(count, false);
+        state->confident = count;
+
+        for (size_t i = 0; i < std::min(parallelism_, count); i++) {
+            inBackground([this, state, count]() {
+                for (size_t v; (v = state->next++) < count;) {
+                    {
+                        std::lock_guard<std::mutex> lock(state->mutex);
+                        if (v > state->confident)
+                            return;
+                    }
+                    // the variant has to be counted whatever happens, resolve() waits for it
+                    Candidate candidate;
+                    try {
+                        candidate = attempt(state->variants[v], v);
+                    } catch (...) {
+                        candidate = Candidate();
+                        candidate.variant = v;
+                    }
+                    std::lock_guard<std::mutex> lock(state->mutex);
+                    if (candidate.score == 2)
+                        state->confident = std::min(state->confident, v);
+                    state->results[v] = std::move(candidate);
+                    state->isDone[v] = true;
+                    state->finished.notify_all();
+                }
+            });
+        }
+
+        // a later variant only wins once none before it can be confident
+        auto decided = [&state, count]() {
+            auto last = std::min(state->confident, count - 1);
+            return std::all_of(state->isDone.begin(), state->isDone.begin() + last + 1, [](bool done) { return done; });
+        };
+        std::unique_lock<std::mutex> lock(state->mutex);
+        state->finished.wait(lock, decided);
+
+        Candidate *best = &state->results[0];
+        for (size_t v = 1; v <= std::min(state->confident, count - 1); v++)
+            if (state->results[v].score > best->score)
+                best = &state->results[v];
+        if (best->variant)
+            LOG_INFO("Found as ", best->info.id, " by variant ", best->variant + 1, "/", count);
+        return best->info;
+    }
+
+    Candidate attempt(const Variant &variant, size_t index) {
+        Candidate candidate;
+        candidate.variant = index;
+        try {
+            auto response = searches_.run(variant.search, clock_.now(), [this, &variant]() {
+                char path[1024];
+                snprintf(path, sizeof(path), "/v1/search?query=%s&limit=50&offset=0&types=TRACKS&countryCode=%s",
+                         urlEncode(variant.search).c_str(), countryCode_.c_str());
+                return fetch(path);
+            });
+            if (!response)
+                return candidate;
+
+            match(*response, variant.title, variant.version, candidate.info);
+            if (candidate.info.isFound)
+                candidate.score = isArtistOf(*response, candidate.info.id, variant.artist) ? 2 : 1;
+        } catch (...) {
+            LOG_ERROR("Error getting info from api: ", variant.title, " from ", variant.artist);
+            candidate = Candidate();
+            candidate.variant = index;
+        }
+        return candidate;
+    }
+
+    /// @brief Whether a credited artist of the track <id> in the search <response> is part of <artist>
+    static bool isArtistOf(const nlohmann::json &response, unsigned id, const std::string &artist) {
+        auto wanted = normalize(artist);
+        for (auto &item : response.at("tracks").at("items")) {
+            if (!item.contains("id") || item.at("id").get<unsigned>() != id || !item.contains("artists"))
+                continue;
+            for (auto &credit : item.at("artists")) {
+                if (!credit.contains("name") || !credit.at("name").is_string())
+                    continue;
+                auto name = normalize(credit.at("name").get<std::string>());
+                if (!name.empty() && wanted.find(name) != std::string::npos)
+                    return true;
+            }
+        }
+        return false;
+    }
+
+    /// @brief Runs <work> on a thread of its own, waited for at the latest by the destructor
+    void inBackground(std::function<void()> work) {
+        std::lock_guard<std::mutex> lock(backgroundMutex_);
+        background_.remove_if([](const std::future<void> &done) {
+            return done.wait_for(std::chrono::seconds(0)) == std::future_status::ready;
+        });
+        background_.push_back(std::async(std::launch::async, std::move(work)));
+    }
+
+    /// @brief Refreshes <cached> with a by-id request on a thread of its own, unless one already is
+    void revalidate(const std::string &title, const std::string &artist, const TrackCache::Entry &cached) {
+        auto key = title + '\x1f' + artist;
+        {
+            std::lock_guard<std::mutex> lock(backgroundMutex_);
+            if (!refreshing_.insert(key).second)
+                return;
+        }
+
+        revalidations_++;
+        inBackground([this, title, artist, cached, key]() {
+            refresh(title, artist, cached);
+            std::lock_guard<std::mutex> lock(backgroundMutex_);
+            refreshing_.erase(key);
+        });
+    }
+
+    void refresh(const std::string &title, const std::string &artist, const TrackCache::Entry &cached) {
+        char path[128];
+        snprintf(path, sizeof(path), "/v1/tracks/%u?countryCode=%s", cached.info.id, countryCode_.c_str());
+        httplib::Headers headers;
+        if (!cached.etag.empty())
+            headers.emplace("If-None-Match", cached.etag);
+
+        LOG_INFO("Revalidating :", path);
+        auto res = query_(path, headers);
+        // kept as it is when the api can't be reached, retried on the next lookup
+        if (!res)
+            return;
+        if (res->status == 304) {
+            notModified_++;
+            cache_->put(title, artist, cached.info, clock_.unixTime(), cached.etag);
+            return;
+        }
+        if (res->status != 200)
+            return;
+
+        auto info = cached.info;
+        try {
+            auto item = nlohmann::json::parse(res->body);
+            trackFields(item, info);
+            // the cover was of the newest album with the track, only corrections of that one count
+            if (item.at("album").at("title").get<std::string>() == info.album)
+                info.coverId = item.at("album").at("cover").get<std::string>();
+        } catch (...) {
+            LOG_WARNING("Could not revalidate ", title, " from ", artist);
+            return;
+        }
+        cache_->put(title, artist, info, clock_.unixTime(), res->get_header_value("ETag"));
+    }
+
+    /// @brief Picks the best of the tracks titled <title>, of <version> if the results have that
+    static void match(const nlohmann::json &j, const std::string &title, const std::string &version,
+                      TrackInfo &info) {
+        // tracks of exactly that version if there are any, "Track" isn't "Track - Live"
+        for (bool isVersionChecked : {true, false}) {
+            matchVersion(j, title, isVersionChecked ? &version : nullptr, info);
+            if (info.isFound)
+                return;
+        }
+    }
+
+    /**
+     * @brief Picks the best of the tracks titled <title> (and of <version> unless nullptr): the
+     * first HI_RES one if any, else the first one, and the newest album of all of them
+     */
+    static void matchVersion(const nlohmann::json &j, const std::string &title, const std::string *version,
+                             TrackInfo &info) {
+        bool isSongSet = false;
+        unsigned int lastAlbumDate = 0;
+        // the response is const, operator[] wouldn't check anything: at() throws on what is missing
+        auto &items = j.at("tracks").at("items");
+        auto count = std::min<size_t>(j.at("tracks").at("totalNumberOfItems").get<size_t>(), items.size());
+        for (size_t i = 0; i < count; i++) {
+            auto &item = items.at(i);
+            // json lib doesn't support wide string so wstrings are pared as strings and have the
+            // same convention errors
+            if (item.at("title").get<std::string>() != title)
+                continue;
+            if (version) {
+                std::string itemVersion;
+                if (item.contains("version") && item.at("version").is_string())
+                    itemVersion = item.at("version").get<std::string>();
+                if (normalize(itemVersion) != normalize(*version))
+                    continue;
+            }
+
+            if (info.runtime == 0 || item.at("audioQuality").get<std::string>() == "HI_RES") {
+                // Ignore songs with same name if you have found song
+                if (!isSongSet) {
+                    info.isFound = true;
+                    trackFields(item, info);
+                }
+
+                // find the newest album
+                int year = 0, month = 0, day = 0;
+                auto &album = item.at("album");
+                LOG_DEBUG("Release date: ", album.at("releaseDate").get<std::string>());
+                sscanf(album.at("releaseDate").get<std::string>().c_str(), "%d-%d-%d", &year, &month, &day);
+                unsigned int albumDate = year * 10000 + month * 100 + day;
+                if (albumDate > lastAlbumDate) {
+                    info.coverId = album.at("cover").get<std::string>();
+                    info.album = album.at("title").get<std::string>();
+                    lastAlbumDate = albumDate;
+                }
+
+                if (info.quality == "HI_RES") {
+                    isSongSet = true;  // keep searching for high-res version.
+                }
+            }
+        }
+    }
+
+    /// @brief What a track object of the api says about the track itself, its album aside. Throws
+    /// if a field is missing
+    static void trackFields(const nlohmann::json &item, TrackInfo &info) {
+        info.quality = item.at("audioQuality").get<std::string>();
+        info.trackNumber = item.at("trackNumber").get<uint_fast8_t>();
+        info.volumeNumber = item.at("volumeNumber").get<uint_fast8_t>();
+        info.runtime = item.at("duration").get<int64_t>();
+        info.id = item.at("id").get<unsigned>();
+    }
+
+    ApiQuery query_;
+    const Clock &clock_;
+    std::string countryCode_;
+    TrackCache *cache_;
+    const SeedIndex *seeds_;
+    SingleFlight<Response> searches_{LINGER};
+    SingleFlight<Response> tracks_{LINGER};  ///< by id
+
+    size_t parallelism_ = 0;
+
+    std::mutex backgroundMutex_;
+    std::list<std::future<void>> background_;
+    std::set<std::string> refreshing_;  ///< tracks being revalidated
+    std::atomic<uint64_t> revalidations_{0};
+    std::atomic<uint64_t> notModified_{0};
+};